@@ -0,0 +1,183 @@
+#pragma once
+
+//
+// Win32 types and system calls used by advbitmap.h.
+// Windows builds take them from windows.h, other platforms get
+// minimal portable replacements, so kernels can be built headless.
+//
+
+#ifdef _WIN32
+
+#include <windows.h>
+
+#ifndef ASSERT
+#include <crtdbg.h>
+#define ASSERT _ASSERTE
+#endif
+
+#else // _WIN32
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <new>
+
+typedef void VOID;
+typedef void *PVOID;
+typedef int INT;
+typedef unsigned int UINT;
+typedef int BOOL;
+typedef unsigned char BYTE;
+typedef unsigned short WORD;
+typedef unsigned int DWORD;
+typedef int LONG;
+typedef unsigned int ULONG;
+typedef long long LONGLONG;
+typedef unsigned long long ULONGLONG;
+typedef DWORD COLORREF;
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#ifndef NULL
+#define NULL 0
+#endif
+
+#define CALLBACK
+#define WINAPI
+
+#define RGB(r,g,b) ((COLORREF)(((BYTE)(r) | ((WORD)((BYTE)(g)) << 8)) | (((DWORD)(BYTE)(b)) << 16)))
+#define GetRValue(rgb) ((BYTE)(rgb))
+#define GetGValue(rgb) ((BYTE)(((WORD)(rgb)) >> 8))
+#define GetBValue(rgb) ((BYTE)((rgb) >> 16))
+
+#ifndef ASSERT
+#define ASSERT assert
+#endif
+
+struct POINT
+{
+    LONG x;
+    LONG y;
+};
+
+struct SIZE
+{
+    LONG cx;
+    LONG cy;
+};
+
+struct RECT
+{
+    LONG left;
+    LONG top;
+    LONG right;
+    LONG bottom;
+};
+
+struct BITMAP
+{
+    LONG bmType;
+    LONG bmWidth;
+    LONG bmHeight;
+    LONG bmWidthBytes;
+    WORD bmPlanes;
+    WORD bmBitsPixel;
+    PVOID bmBits;
+};
+
+struct SYSTEM_INFO
+{
+    DWORD dwNumberOfProcessors;
+};
+
+inline VOID GetSystemInfo(SYSTEM_INFO *pInfo)
+{
+    long n = ::sysconf(_SC_NPROCESSORS_ONLN);
+    pInfo->dwNumberOfProcessors = (n > 0) ? (DWORD)n : 1;
+}
+
+inline LONG InterlockedIncrement(volatile LONG *pValue)
+{
+    return __sync_add_and_fetch(pValue, 1);
+}
+
+//
+// Thread pool work: every submit runs callback on its own thread,
+// wait joins all of them. That is enough for blit workers.
+//
+
+struct TP_CALLBACK_INSTANCE;
+struct TP_CALLBACK_ENVIRON;
+struct TP_WORK;
+
+typedef TP_CALLBACK_INSTANCE *PTP_CALLBACK_INSTANCE;
+typedef TP_CALLBACK_ENVIRON *PTP_CALLBACK_ENVIRON;
+typedef TP_WORK *PTP_WORK;
+typedef VOID (CALLBACK *PTP_WORK_CALLBACK)(PTP_CALLBACK_INSTANCE, PVOID, PTP_WORK);
+
+// Workers number of one work object
+const INT TP_MAX_WORKERS = 256;
+
+struct TP_WORK
+{
+    PTP_WORK_CALLBACK pfnCallback;
+    PVOID pvContext;
+    INT nThreads;
+    pthread_t threads[TP_MAX_WORKERS];
+
+    static PVOID ThreadProc(PVOID pvWork)
+    {
+        PTP_WORK pWork = (PTP_WORK)pvWork;
+        pWork->pfnCallback(NULL, pWork->pvContext, pWork);
+        return NULL;
+    }
+};
+
+inline PTP_WORK CreateThreadpoolWork(PTP_WORK_CALLBACK pfnCallback, PVOID pvContext, PTP_CALLBACK_ENVIRON)
+{
+    // NULL on failure, like system thread pool
+    PTP_WORK pWork = new (std::nothrow) TP_WORK;
+    if (pWork == NULL)
+        return NULL;
+
+    pWork->pfnCallback = pfnCallback;
+    pWork->pvContext = pvContext;
+    pWork->nThreads = 0;
+    return pWork;
+}
+
+inline VOID SubmitThreadpoolWork(PTP_WORK pWork)
+{
+    if (pWork->nThreads < TP_MAX_WORKERS &&
+        ::pthread_create(&pWork->threads[pWork->nThreads], NULL, &TP_WORK::ThreadProc, pWork) == 0)
+    {
+        ++pWork->nThreads;
+    }
+    else
+    {
+        // No thread, run in place
+        pWork->pfnCallback(NULL, pWork->pvContext, pWork);
+    }
+}
+
+inline VOID WaitForThreadpoolWorkCallbacks(PTP_WORK pWork, BOOL)
+{
+    for (INT i=0 ; i<pWork->nThreads ; ++i)
+        ::pthread_join(pWork->threads[i], NULL);
+    pWork->nThreads = 0;
+}
+
+inline VOID CloseThreadpoolWork(PTP_WORK pWork)
+{
+    delete pWork;
+}
+
+#endif // _WIN32
@@ -1,6 +1,14 @@
 #pragma once
 
-#include <math.h> // sqrt
+#include "aatypes.h"
+
+#include <math.h> // sqrt, sin, floor
+
+// SSE2 kernels are compiled in for x86/x64 unless AA_NO_SSE2 is defined
+#if !defined(AA_NO_SSE2) && (defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__))
+#define AA_SSE2
+#include <emmintrin.h>
+#endif
 
 //
 // Pixel format structs
@@ -29,8 +37,26 @@ template <INT bpp> struct PIXELFORMAT {};
 template <> struct PIXELFORMAT<24> : public RGB24 {};
 template <> struct PIXELFORMAT<32> : public RGB32 {};
 
+// 32bpp premultiplied alpha pixel format, Reserved is alpha
+// and color channels are already multiplied by it
+struct PARGB32 : public RGB32 {};
+
 #pragma pack(pop)
 
+// AAPIXEL_TRAITS struct
+// Premultiplied source is composited over destination by Porter-Duff "over"
+template <typename PIXEL> struct AAPIXEL_TRAITS { static const BOOL PREMULTIPLIED = FALSE; };
+template <> struct AAPIXEL_TRAITS<PARGB32> { static const BOOL PREMULTIPLIED = TRUE; };
+
+// Pixel alpha, pixels without alpha are opaque
+inline INT AAGetPixelAlpha(const PARGB32 *p) { return p->Reserved; }
+inline INT AAGetPixelAlpha(const RGB32 *) { return 255; }
+inline INT AAGetPixelAlpha(const RGB24 *) { return 255; }
+
+inline VOID AASetPixelAlpha(PARGB32 *p, INT nAlpha) { p->Reserved = (BYTE)nAlpha; }
+inline VOID AASetPixelAlpha(RGB32 *, INT) {}
+inline VOID AASetPixelAlpha(RGB24 *, INT) {}
+
 // 24bpp colors comparison
 
 inline bool operator == (const RGB24 &a, const RGB24 &b)
@@ -119,6 +145,22 @@ VOID MultMatrix(
 // Advanced bitmap API
 //
 
+// Source is reduced by chunks filtering when ratio of source pixels
+// per one destination pixel exceeds this value
+const double AA_CHUNK_FILTER_RATIO = 1.75;
+
+// Check transformation reduces source enough to use chunks filtering
+inline BOOL AAIsChunkFiltering(
+        const XFORM_MATRIX *pMatrix)
+{
+    ASSERT(pMatrix != NULL);
+
+    // See kx and ky in AATransformBltTempl
+    double kx = 1.0 / sqrt( pMatrix->eM11 * pMatrix->eM11 + pMatrix->eM21 * pMatrix->eM21 );
+    double ky = 1.0 / sqrt( pMatrix->eM12 * pMatrix->eM12 + pMatrix->eM22 * pMatrix->eM22 );
+    return !(kx <= AA_CHUNK_FILTER_RATIO && ky <= AA_CHUNK_FILTER_RATIO);
+}
+
 // Calculate bound box for transformed rect 
 inline VOID AAGetTransformationBoundBox(
         const RECT *prcSrc, 
@@ -163,35 +205,19 @@ inline VOID AAGetTransformationBoundBox(
     }
 }
 
-// AAGetAverageColor method
-// Calculate average color in extent.
-// Extent is defined as [nX...nX+nAvrCntX)[nY...nY+nAvrCntY)
-// If defined pClrKey not null then pixels coresponding to color key
-// will be replaced by pSubstitutePixel color
-template <typename PIXELSRC, typename PIXELDST, typename PIXELSUB>
-INT AAGetAverageColor(
-        const BITMAP *pSrcBitmap, 
+// Clip averaging extent [nX...nX+nAvrCntX)[nY...nY+nAvrCntY) to bitmap size.
+// Negative counts mean extent goes left/up from nX/nY.
+// Extent is never empty, it degrades to the nearest edge pixel.
+inline VOID AAClipAverageExtent(
+        INT nWidth,
+        INT nHeight,
         INT nX, 
         INT nY, 
         INT nAvrCntX, 
         INT nAvrCntY, 
-        PIXELDST *pAvrPixel, 
-        const COLORREF *pClrKey = NULL, 
-        PIXELSUB *pSubstitutePixel = NULL)
+        RECT *prExtent)
 {
-    ASSERT(pAvrPixel != NULL);
-    ASSERT(pSrcBitmap != NULL);
-    ASSERT(pSrcBitmap->bmBits != NULL);
-    ASSERT(pSrcBitmap->bmBitsPixel == sizeof(PIXELSRC) * 8);
-
-    #ifdef _DEBUG
-    if (pClrKey != NULL) 
-        ASSERT(pSubstitutePixel != NULL);
-    #endif
-    
-    INT nWidth = pSrcBitmap->bmWidth;
-    INT nHeight = pSrcBitmap->bmHeight;
-    INT nWidthBytes = pSrcBitmap->bmWidthBytes;
+    ASSERT(prExtent != NULL);
 
     INT yFrom = nY, yTo = nY + nAvrCntY;
     INT xFrom = nX, xTo = nX + nAvrCntX;
@@ -235,8 +261,55 @@ INT AAGetAverageColor(
     ASSERT(yFrom >= 0 && yFrom < nHeight);
     ASSERT(yTo >= 0 && yTo <= nHeight);
 
+    // Empty extent is averaged as one pixel
+    if (xTo == xFrom)
+        xTo = xFrom + 1;
+    if (yTo == yFrom)
+        yTo = yFrom + 1;
+
+    prExtent->left = xFrom;
+    prExtent->top = yFrom;
+    prExtent->right = xTo;
+    prExtent->bottom = yTo;
+}
+
+// AAGetAverageColor method
+// Calculate average color in extent.
+// Extent is defined as [nX...nX+nAvrCntX)[nY...nY+nAvrCntY)
+// If defined pClrKey not null then pixels coresponding to color key
+// will be replaced by pSubstitutePixel color
+template <typename PIXELSRC, typename PIXELDST, typename PIXELSUB>
+INT AAGetAverageColor(
+        const BITMAP *pSrcBitmap, 
+        INT nX, 
+        INT nY, 
+        INT nAvrCntX, 
+        INT nAvrCntY, 
+        PIXELDST *pAvrPixel, 
+        const COLORREF *pClrKey = NULL, 
+        PIXELSUB *pSubstitutePixel = NULL)
+{
+    ASSERT(pAvrPixel != NULL);
+    ASSERT(pSrcBitmap != NULL);
+    ASSERT(pSrcBitmap->bmBits != NULL);
+    ASSERT(pSrcBitmap->bmBitsPixel == sizeof(PIXELSRC) * 8);
+
+    #ifdef _DEBUG
+    if (pClrKey != NULL) 
+        ASSERT(pSubstitutePixel != NULL);
+    #endif
+    
+    INT nWidth = pSrcBitmap->bmWidth;
+    INT nHeight = pSrcBitmap->bmHeight;
+    INT nWidthBytes = pSrcBitmap->bmWidthBytes;
+
+    RECT rExtent;
+    AAClipAverageExtent(nWidth, nHeight, nX, nY, nAvrCntX, nAvrCntY, &rExtent);
+    INT xFrom = rExtent.left, xTo = rExtent.right;
+    INT yFrom = rExtent.top, yTo = rExtent.bottom;
+
     INT nCnt = 0;
-    INT nR = 0, nG = 0, nB = 0;
+    INT nR = 0, nG = 0, nB = 0, nA = 0;
 
     const BYTE *pBits = (const BYTE *)pSrcBitmap->bmBits + yFrom * nWidthBytes + xFrom * sizeof(PIXELSRC);
     const BYTE *pBitsTo = pBits + (yTo - yFrom) * nWidthBytes;
@@ -261,6 +334,8 @@ INT AAGetAverageColor(
                 nR += p->Red;
                 nG += p->Green;
                 nB += p->Blue;
+                if (AAPIXEL_TRAITS<PIXELSRC>::PREMULTIPLIED)
+                    nA += AAGetPixelAlpha(p);
             }
 
             ++nCnt;
@@ -277,190 +352,2056 @@ INT AAGetAverageColor(
     pAvrPixel->Red   = (BYTE)(nR / nCnt);
     pAvrPixel->Green = (BYTE)(nG / nCnt);
     pAvrPixel->Blue  = (BYTE)(nB / nCnt);
+    if (AAPIXEL_TRAITS<PIXELSRC>::PREMULTIPLIED)
+        AASetPixelAlpha(pAvrPixel, nA / nCnt);
 
     return nCnt;
 }
 
-// Transform (rotate/scale) bitmap and set onto destination 
-// bitmap in predefined left/top position
-template <typename PIXELSRC, typename PIXELDST>
-VOID AATransformBltTempl(
-        const BITMAP *pDstBitmap, 
-        INT nDstX,
-        INT nDstY,
+//
+// Summed area table
+//
+
+// AASUMMEDAREA_ENTRY struct
+// Sums of pixel channels over [0...x)[0...y) extent.
+// Sums wrap modulo 2^32, but difference of four entries is still exact
+// while sum over an extent fits 32 bits, i.e. up to 16M pixels.
+struct AASUMMEDAREA_ENTRY
+{
+    UINT Blue;
+    UINT Green;
+    UINT Red;
+    UINT KeyCnt; // color key pixels number, they are excluded from channel sums
+};
+
+// AASUMMEDAREATABLE struct
+// Integral image of a source bitmap, (bmWidth+1) x (bmHeight+1) entries,
+// i.e. 16 bytes per source pixel. Built once per source bitmap, 
+// it makes averaging of any extent O(1).
+struct AASUMMEDAREATABLE
+{
+    INT nWidth;     // source bitmap width
+    INT nHeight;    // source bitmap height
+    BOOL bClrKey;   // table is built with color key
+    COLORREF clrKey;
+    AASUMMEDAREA_ENTRY *pEntries;
+};
+
+// Fill summed area table entries from source bitmap
+template <typename PIXELSRC>
+VOID AABuildSummedAreaTableTempl(
         const BITMAP *pSrcBitmap,
-        INT nSrcX,
-        INT nSrcY,
-        INT nSrcWidth,
-        INT nSrcHeight,
-        const XFORM_MATRIX *pMatrix,
-        const COLORREF *pClrKey = NULL)
+        AASUMMEDAREATABLE *pTable)
 {
-    ASSERT(pMatrix != NULL);
-    ASSERT(pDstBitmap != NULL);
-    ASSERT(pDstBitmap->bmBits != NULL);
     ASSERT(pSrcBitmap != NULL);
     ASSERT(pSrcBitmap->bmBits != NULL);
     ASSERT(pSrcBitmap->bmBitsPixel == sizeof(PIXELSRC) * 8);
-    ASSERT(pDstBitmap->bmBitsPixel == sizeof(PIXELDST) * 8);
+    ASSERT(pTable != NULL);
+    ASSERT(pTable->pEntries != NULL);
 
-    // Destination bitmap
-    INT nDstBitmapWidth = pDstBitmap->bmWidth;
-    INT nDstBitmapHeight = pDstBitmap->bmHeight;
-    INT nDstBitmapWidthBytes = pDstBitmap->bmWidthBytes;
+    INT nWidth = pTable->nWidth;
+    INT nHeight = pTable->nHeight;
+    INT nStride = nWidth + 1;
+    BOOL bClrKey = pTable->bClrKey;
+    COLORREF clrKey = pTable->clrKey;
 
-    // Source bitmap
-    INT nSrcBitmapWidth = pSrcBitmap->bmWidth;
-    INT nSrcBitmapHeight = pSrcBitmap->bmHeight;
-    INT nSrcBitmapWidthBytes = pSrcBitmap->bmWidthBytes;
+    // Row 0 is zero
+    memset(pTable->pEntries, 0, nStride * sizeof(AASUMMEDAREA_ENTRY));
 
-    // Override matrix for adjust eDx and eDy for matrix
-    // Since bitmap transformed from src to dst then eDx and eDy shoul be:
-    XFORM_MATRIX matrix(*pMatrix);
-    matrix.eDx = nDstX - nSrcX;
-    matrix.eDy = nDstY - nSrcY;
-    pMatrix = &matrix;
+    const BYTE *pBits = (const BYTE *)pSrcBitmap->bmBits;
+    for (INT y=0 ; y<nHeight ; ++y, pBits += pSrcBitmap->bmWidthBytes)
+    {
+        const AASUMMEDAREA_ENTRY *pAbove = pTable->pEntries + y * nStride;
+        AASUMMEDAREA_ENTRY *pRow = pTable->pEntries + (y + 1) * nStride;
 
-    // Calculation destination position
-    RECT rDst = { 0 };
-    RECT rSrc = { nSrcX-1, nSrcY-1, nSrcX+nSrcWidth+1, nSrcY+nSrcHeight+1 };
-    AAGetTransformationBoundBox(&rSrc, pMatrix, &rDst);
-    if (rDst.left < 0)
-        rDst.left = 0;
-    if (rDst.top < 0)
-        rDst.top = 0;
-    if (rDst.right >= nDstBitmapWidth)
-        rDst.right = nDstBitmapWidth - 1;
-    if (rDst.bottom >= nDstBitmapHeight)
-        rDst.bottom = nDstBitmapHeight - 1;
+        // Column 0 is zero
+        AASUMMEDAREA_ENTRY acc = { 0 };
+        pRow[0] = acc;
 
-    // Ratio source size to destination size
-    // Scaling/rotation matrix is:
-    // | ( cos x kx) (sin x ky) ... |  i.e. | m00 m01 ... |
-    // | (-sin x kx) (cos x ky) ... |       | m10 m10 ... |
-    // | ...                    ... |       | ...         |
-    // i.e.
-    // kx = sqrt( m00 x m00 + m10 x m10 )
-    // ky = sqrt( m01 x m01 + m11 x m11 )
-    double kx = 1.0 / sqrt( matrix.eM11 * matrix.eM11 + matrix.eM21 * matrix.eM21 ); // src pixel per one dst pixel 
-    double ky = 1.0 / sqrt( matrix.eM12 * matrix.eM12 + matrix.eM22 * matrix.eM22 ); // src pixel per one dst pixel 
+        const PIXELSRC *p = (const PIXELSRC *)pBits;
+        for (INT x=0 ; x<nWidth ; ++x, ++p)
+        {
+            if (bClrKey && *p == clrKey)
+            {
+                acc.KeyCnt += 1;
+            }
+            else
+            {
+                acc.Blue  += p->Blue;
+                acc.Green += p->Green;
+                acc.Red   += p->Red;
+            }
 
-    // Averaging points number
-    INT nAvrSrcX = (INT)kx; 
-    INT nAvrSrcY = (INT)ky; 
-    if (kx > nAvrSrcX)
-        nAvrSrcX += 1;
-    if (ky > nAvrSrcY)
-        nAvrSrcY += 1;
+            pRow[x+1].Blue   = pAbove[x+1].Blue   + acc.Blue;
+            pRow[x+1].Green  = pAbove[x+1].Green  + acc.Green;
+            pRow[x+1].Red    = pAbove[x+1].Red    + acc.Red;
+            pRow[x+1].KeyCnt = pAbove[x+1].KeyCnt + acc.KeyCnt;
+        }
+    }
+}
 
-    // Transformation is
-    const double &eM11 = pMatrix->eM11;
-    const double &eM12 = pMatrix->eM12;
-    const double &eM21 = pMatrix->eM21;
-    const double &eM22 = pMatrix->eM22;
-    const double &eDx  = pMatrix->eDx;
-    const double &eDy  = pMatrix->eDy;
+// Create summed area table for 24 or 32 bpp source bitmap.
+// Color key is baked into table, blits with other color key do not use it.
+// Table must be released by AADeleteSummedAreaTable.
+inline BOOL AACreateSummedAreaTable(
+        const BITMAP *pSrcBitmap,
+        const COLORREF *pClrKey,
+        AASUMMEDAREATABLE *pTable)
+{
+    ASSERT(pSrcBitmap != NULL);
+    ASSERT(pSrcBitmap->bmBits != NULL);
+    ASSERT(pTable != NULL);
 
-    // Transformation formula is:
-    // dx = sx * eM11 + sy * eM21 + eDx
-    // dy = sx * eM12 + sy * eM22 + eDy
-    // for case eM21 = eM12 = 0 
-    // dx = sx * eM11 + eDx
-    // dy = sy * eM22 + eDy
+    pTable->nWidth = pSrcBitmap->bmWidth;
+    pTable->nHeight = pSrcBitmap->bmHeight;
+    pTable->bClrKey = (pClrKey != NULL);
+    pTable->clrKey = (pClrKey != NULL) ? *pClrKey : 0;
+    pTable->pEntries = NULL;
 
-    // Revert transformation formula is:
-    // sx = (eM21 * (dy - eDy) - eM22 * (dx - eDx)) / (eM12 * eM21 - eM11 * eM22)
-    // sy = (dx - eDx) / eM21 - sx * eM11 / eM21
-    // for case eM21 = eM12 = 0 
-    // sx = (dx - eDx) / eM11
-    // sy = (dy - eDy) / eM22
-    // Precalculates are:
-    double d  = eM12 * eM21 - eM11 * eM22;
-    double a1 = eM21 / d;
-    double a2 = eM22 / d;
-    double b1 = eDx * a2 - eDy * a1;
-    double e1 = eM11 / eM21;
-    double e2 = eDx / eM21;
-    double a3 = (e1 * a2 + 1.0 / eM21);
-    double a4 = e1 * a1;
-    double b2 = e2 + e1 * b1;
-    // Therefore formula is:
-    // sx = a1 * dy - a2 * dx + b1
-    // sy = a3 * dx - a4 * dy - b2
-    double a5 = eDx / eM11;
-    double a6 = eDy / eM22;
-    double a7 = 1.0 / eM11;
-    double a8 = 1.0 / eM22;
-    // Therefore formula for case without rotation is:
-    // sx = dx * a7 - a5
-    // sy = dy * a8 - a6
-  
-    BOOL bNoRotation = (eM21 >= -1e-6 && eM21 <= 1e-6);
-    ASSERT((eM21 >= -1e-6 && eM21 <= 1e-6) == (eM12 >= -1e-6 && eM12 <= 1e-6));
+    if (pSrcBitmap->bmBitsPixel != 24 && pSrcBitmap->bmBitsPixel != 32)
+        return FALSE;
 
-    BOOL bPixelBilinear = (kx <= 1.75 && ky <= 1.75);
-        // Two cases diffently handled:
-        // 1. Pixel bilinear filtering
-        //    when source is smaller than destination (S < D)
-        // 2. Chuncks bilinear filtering
-        //    when source is bigger than destination (S > D)
+    size_t nEntries = (size_t)(pTable->nWidth + 1) * (size_t)(pTable->nHeight + 1);
+    pTable->pEntries = (AASUMMEDAREA_ENTRY *)malloc(nEntries * sizeof(AASUMMEDAREA_ENTRY));
+    if (pTable->pEntries == NULL)
+        return FALSE;
 
-    BYTE *pDst = (BYTE *)pDstBitmap->bmBits + rDst.top * nDstBitmapWidthBytes;
-    const BYTE *pSrc = (const BYTE *)pSrcBitmap->bmBits;
+    if (pSrcBitmap->bmBitsPixel == 24)
+        AABuildSummedAreaTableTempl< PIXELFORMAT<24> >(pSrcBitmap, pTable);
+    else
+        AABuildSummedAreaTableTempl< PIXELFORMAT<32> >(pSrcBitmap, pTable);
 
-    // Scaling ratio
-    const INT iSHIFT = 8;
-    const INT iSCALE = 1 << iSHIFT;
-    const double dSCALE = (double)iSCALE;
+    return TRUE;
+}
 
-    INT nSrcBitmapWidthScaled = (nSrcBitmapWidth << iSHIFT);
-    INT nSrcBitmapHeightScaled = (nSrcBitmapHeight << iSHIFT);
-    INT nSrcLastAvailIndexX = nSrcBitmapWidth-1;
-    INT nSrcLastAvailIndexY = nSrcBitmapHeight-1;
+inline VOID AADeleteSummedAreaTable(
+        AASUMMEDAREATABLE *pTable)
+{
+    ASSERT(pTable != NULL);
 
-    INT sxFrom = 0, syFrom = 0; // start for sx and sy per dy
-    INT sxStep = 0, syStep = 0; // step for sx and sy per dx
-    INT sxNext = 0, syNext = 0; // step for sx and sy per dy
-    INT rxStep = 0, ryStep = 0; // remainder for step per dx
-    INT rxNext = 0, ryNext = 0; // remainder for step per dy
-    INT rxFrom = 0, ryFrom = 0; // remainder of from point
+    free(pTable->pEntries);
+    pTable->pEntries = NULL;
+}
 
-    // Remainder compensators
-    INT sxStepCorr = 1, syStepCorr = 1;
-    INT sxNextCorr = 1, syNextCorr = 1;
+// Check table can be used for blit with color key pClrKey
+inline BOOL AAIsSummedAreaTableApplicable(
+        const AASUMMEDAREATABLE *pTable,
+        const BITMAP *pSrcBitmap,
+        const COLORREF *pClrKey)
+{
+    if (pTable == NULL || pTable->pEntries == NULL)
+        return FALSE;
+    if (pTable->nWidth != pSrcBitmap->bmWidth || pTable->nHeight != pSrcBitmap->bmHeight)
+        return FALSE;
+    if (pTable->bClrKey != (pClrKey != NULL))
+        return FALSE;
+    return (pClrKey == NULL || pTable->clrKey == *pClrKey);
+}
 
-    if (bNoRotation)
-    {
-        // sx = dx * a7 - a5
-        // sy = dy * a8 - a6
-        double fxFrom = ((double)(rDst.left) * a7 - a5) * dSCALE + 1e-6;
-        double fyFrom = ((double)(rDst.top) * a8 - a6) * dSCALE + 1e-6;
-        double fxStep = a7 * dSCALE;
-        double fyNext = a8 * dSCALE;
+// AAGetSummedAverageColor method
+// Same as AAGetAverageColor but extent sums are taken from summed area table.
+// Color key pixels are replaced by pSubstitutePixel color.
+template <typename PIXELDST, typename PIXELSUB>
+INT AAGetSummedAverageColor(
+        const AASUMMEDAREATABLE *pTable, 
+        INT nX, 
+        INT nY, 
+        INT nAvrCntX, 
+        INT nAvrCntY, 
+        PIXELDST *pAvrPixel, 
+        PIXELSUB *pSubstitutePixel = NULL)
+{
+    ASSERT(pAvrPixel != NULL);
+    ASSERT(pTable != NULL);
+    ASSERT(pTable->pEntries != NULL);
 
-        sxFrom = (INT)(fxFrom); 
-        syFrom = (INT)(fyFrom);
-        sxStep = (INT)(fxStep);
-        syStep = 0;
-        syNext = (INT)(fyNext);
-        sxNext = 0;
-        rxStep = (INT)((fxStep - (double)sxStep) * dSCALE);
-        ryNext = (INT)((fyNext - (double)syNext) * dSCALE);
-        rxFrom = (INT)((fxFrom - (double)sxFrom) * dSCALE);
-        ryFrom = (INT)((fyFrom - (double)syFrom) * dSCALE);
-    }
-    else
-    {
-        // sx = a1 * dy - a2 * dx + b1
-        // sy = a3 * dx - a4 * dy - b2
-        double fxFrom = ((a1 * (double)(rDst.top) + b1) - a2 * (double)(rDst.left)) * dSCALE;
-        double fyFrom = (a3 * (double)(rDst.left) - (b2 + a4 * (double)(rDst.top))) * dSCALE;
-        double fxStep = -a2 * dSCALE; // step per one dx 
-        double fxNext = a1 * dSCALE;  // step per one dy
-        double fyStep = a3 * dSCALE;  // step per one dx
-        double fyNext = -a4 * dSCALE; // step per one dy
+    RECT rExtent;
+    AAClipAverageExtent(pTable->nWidth, pTable->nHeight, nX, nY, nAvrCntX, nAvrCntY, &rExtent);
 
-        sxFrom = (INT)(fxFrom);
+    INT nStride = pTable->nWidth + 1;
+    const AASUMMEDAREA_ENTRY *pTop = pTable->pEntries + rExtent.top * nStride;
+    const AASUMMEDAREA_ENTRY *pBottom = pTable->pEntries + rExtent.bottom * nStride;
+    const AASUMMEDAREA_ENTRY &a = pTop[rExtent.left],    &b = pTop[rExtent.right];
+    const AASUMMEDAREA_ENTRY &c = pBottom[rExtent.left], &d = pBottom[rExtent.right];
+
+    INT nCnt = (rExtent.right - rExtent.left) * (rExtent.bottom - rExtent.top);
+    INT nR = (INT)(d.Red   - b.Red   - c.Red   + a.Red);
+    INT nG = (INT)(d.Green - b.Green - c.Green + a.Green);
+    INT nB = (INT)(d.Blue  - b.Blue  - c.Blue  + a.Blue);
+    INT nKeyCnt = (INT)(d.KeyCnt - b.KeyCnt - c.KeyCnt + a.KeyCnt);
+
+    if (nKeyCnt > 0)
+    {
+        ASSERT(pSubstitutePixel != NULL);
+        nR += nKeyCnt * pSubstitutePixel->Red;
+        nG += nKeyCnt * pSubstitutePixel->Green;
+        nB += nKeyCnt * pSubstitutePixel->Blue;
+    }
+
+    ASSERT(nCnt > 0);
+
+    pAvrPixel->Red   = (BYTE)(nR / nCnt);
+    pAvrPixel->Green = (BYTE)(nG / nCnt);
+    pAvrPixel->Blue  = (BYTE)(nB / nCnt);
+
+    return nCnt;
+}
+
+// Fixed point precision of source coordinates
+const INT AA_FIXED_SHIFT = 8;
+const INT AA_FIXED_SCALE = 1 << AA_FIXED_SHIFT;
+
+//
+// Mipmap
+//
+
+// Maximal number of mipmap levels including source itself
+const INT AA_MIPMAP_MAX_LEVELS = 16;
+
+// AAMIPMAP struct
+// Power-of-two pyramid of source bitmap for large downscaling.
+// Level 0 is the source bitmap itself and is not stored, levels 1...nLevels-1 
+// are owned 32bpp bitmaps. Pyramid depends only on source content, so it can
+// be kept per image and reused with any copy of the source bits.
+struct AAMIPMAP
+{
+    INT nWidth;     // level 0 width
+    INT nHeight;    // level 0 height
+    INT nLevels;    // 0 if pyramid is not built
+    BITMAP bmLevels[AA_MIPMAP_MAX_LEVELS - 1]; // levels 1, 2, ...
+};
+
+// Reduce bitmap twice by 2x2 box filter, odd edge row/column is clamped
+template <typename PIXELSRC>
+VOID AAReduceBitmapTempl(
+        const BITMAP *pSrcBitmap,
+        const BITMAP *pDstBitmap)
+{
+    ASSERT(pSrcBitmap != NULL);
+    ASSERT(pSrcBitmap->bmBits != NULL);
+    ASSERT(pSrcBitmap->bmBitsPixel == sizeof(PIXELSRC) * 8);
+    ASSERT(pDstBitmap != NULL);
+    ASSERT(pDstBitmap->bmBits != NULL);
+    ASSERT(pDstBitmap->bmBitsPixel == 32);
+
+    INT nSrcLastX = pSrcBitmap->bmWidth - 1;
+    INT nSrcLastY = pSrcBitmap->bmHeight - 1;
+
+    for (INT y=0 ; y<pDstBitmap->bmHeight ; ++y)
+    {
+        INT y0 = 2 * y, y1 = 2 * y + 1;
+        if (y1 > nSrcLastY)
+            y1 = nSrcLastY;
+
+        const BYTE *pRow0 = (const BYTE *)pSrcBitmap->bmBits + y0 * pSrcBitmap->bmWidthBytes;
+        const BYTE *pRow1 = (const BYTE *)pSrcBitmap->bmBits + y1 * pSrcBitmap->bmWidthBytes;
+        RGB32 *pDstPixel = (RGB32 *)((BYTE *)pDstBitmap->bmBits + y * pDstBitmap->bmWidthBytes);
+
+        for (INT x=0 ; x<pDstBitmap->bmWidth ; ++x, ++pDstPixel)
+        {
+            INT x0 = 2 * x, x1 = 2 * x + 1;
+            if (x1 > nSrcLastX)
+                x1 = nSrcLastX;
+
+            const PIXELSRC *p1 = (const PIXELSRC *)pRow0 + x0;
+            const PIXELSRC *p2 = (const PIXELSRC *)pRow0 + x1;
+            const PIXELSRC *p3 = (const PIXELSRC *)pRow1 + x0;
+            const PIXELSRC *p4 = (const PIXELSRC *)pRow1 + x1;
+
+            pDstPixel->Red      = (BYTE)( (p1->Red   + p2->Red   + p3->Red   + p4->Red   + 2) >> 2 );
+            pDstPixel->Green    = (BYTE)( (p1->Green + p2->Green + p3->Green + p4->Green + 2) >> 2 );
+            pDstPixel->Blue     = (BYTE)( (p1->Blue  + p2->Blue  + p3->Blue  + p4->Blue  + 2) >> 2 );
+            pDstPixel->Reserved = 0;
+        }
+    }
+}
+
+inline VOID AADeleteMipmap(
+        AAMIPMAP *pMipmap)
+{
+    ASSERT(pMipmap != NULL);
+
+    for (INT i=1 ; i<pMipmap->nLevels ; ++i)
+    {
+        free(pMipmap->bmLevels[i-1].bmBits);
+        pMipmap->bmLevels[i-1].bmBits = NULL;
+    }
+    pMipmap->nLevels = 0;
+}
+
+// Create mipmap pyramid for 24 or 32 bpp source bitmap down to 1x1 level.
+// Pyramid must be released by AADeleteMipmap.
+inline BOOL AACreateMipmap(
+        const BITMAP *pSrcBitmap,
+        AAMIPMAP *pMipmap)
+{
+    ASSERT(pSrcBitmap != NULL);
+    ASSERT(pSrcBitmap->bmBits != NULL);
+    ASSERT(pMipmap != NULL);
+
+    memset(pMipmap, 0, sizeof(AAMIPMAP));
+
+    if (pSrcBitmap->bmBitsPixel != 24 && pSrcBitmap->bmBitsPixel != 32)
+        return FALSE;
+
+    pMipmap->nWidth = pSrcBitmap->bmWidth;
+    pMipmap->nHeight = pSrcBitmap->bmHeight;
+    pMipmap->nLevels = 1;
+
+    const BITMAP *pPrev = pSrcBitmap;
+    while (pMipmap->nLevels < AA_MIPMAP_MAX_LEVELS && (pPrev->bmWidth > 1 || pPrev->bmHeight > 1))
+    {
+        BITMAP *pLevel = &pMipmap->bmLevels[pMipmap->nLevels - 1];
+        pLevel->bmWidth = (pPrev->bmWidth > 1) ? pPrev->bmWidth / 2 : 1;
+        pLevel->bmHeight = (pPrev->bmHeight > 1) ? pPrev->bmHeight / 2 : 1;
+        pLevel->bmWidthBytes = pLevel->bmWidth * sizeof(RGB32);
+        pLevel->bmPlanes = 1;
+        pLevel->bmBitsPixel = 32;
+        pLevel->bmBits = malloc((size_t)pLevel->bmWidthBytes * (size_t)pLevel->bmHeight);
+        if (pLevel->bmBits == NULL)
+        {
+            AADeleteMipmap(pMipmap);
+            return FALSE;
+        }
+
+        if (pPrev->bmBitsPixel == 24)
+            AAReduceBitmapTempl< PIXELFORMAT<24> >(pPrev, pLevel);
+        else
+            AAReduceBitmapTempl< PIXELFORMAT<32> >(pPrev, pLevel);
+
+        pMipmap->nLevels += 1;
+        pPrev = pLevel;
+    }
+
+    return TRUE;
+}
+
+// Check mipmap can be used for blit of source bitmap
+inline BOOL AAIsMipmapApplicable(
+        const AAMIPMAP *pMipmap,
+        const BITMAP *pSrcBitmap,
+        const COLORREF *pClrKey)
+{
+    // Color key can not be averaged into pyramid levels
+    if (pMipmap == NULL || pMipmap->nLevels == 0 || pClrKey != NULL)
+        return FALSE;
+    return (pMipmap->nWidth == pSrcBitmap->bmWidth && pMipmap->nHeight == pSrcBitmap->bmHeight);
+}
+
+//
+// Key mask
+//
+
+// AAKEYMASK struct
+// Color keyed source converted to owned 32bpp bitmap. Alpha (Reserved byte)
+// is 0 for key pixels and 255 for others, key pixels are black, so kernels 
+// weight pixels by alpha instead of comparing every tap with color key.
+struct AAKEYMASK
+{
+    INT nWidth;         // source width
+    INT nHeight;        // source height
+    COLORREF clrKey;    // key of mask
+    BITMAP bmMask;      // bits are NULL if mask is not built
+};
+
+template <typename PIXELSRC>
+VOID AABuildKeyMaskTempl(
+        const BITMAP *pSrcBitmap,
+        COLORREF clrKey,
+        const BITMAP *pMaskBitmap)
+{
+    ASSERT(pSrcBitmap != NULL);
+    ASSERT(pSrcBitmap->bmBits != NULL);
+    ASSERT(pSrcBitmap->bmBitsPixel == sizeof(PIXELSRC) * 8);
+    ASSERT(pMaskBitmap != NULL);
+    ASSERT(pMaskBitmap->bmBitsPixel == 32);
+
+    // Key is unpacked once instead of per pixel comparison
+    PIXELFORMAT<32> key;
+    key.Red = GetRValue(clrKey);
+    key.Green = GetGValue(clrKey);
+    key.Blue = GetBValue(clrKey);
+
+    for (INT y=0 ; y<pSrcBitmap->bmHeight ; ++y)
+    {
+        const PIXELSRC *pSrcPixel = (const PIXELSRC *)((const BYTE *)pSrcBitmap->bmBits + y * pSrcBitmap->bmWidthBytes);
+        PIXELFORMAT<32> *pMaskPixel = (PIXELFORMAT<32> *)((BYTE *)pMaskBitmap->bmBits + y * pMaskBitmap->bmWidthBytes);
+
+        for (INT x=0 ; x<pSrcBitmap->bmWidth ; ++x, ++pSrcPixel, ++pMaskPixel)
+        {
+            BOOL bKey = (pSrcPixel->Red == key.Red && pSrcPixel->Green == key.Green && pSrcPixel->Blue == key.Blue);
+            BYTE bMask = bKey ? 0 : 255;
+            pMaskPixel->Red      = pSrcPixel->Red   & bMask;
+            pMaskPixel->Green    = pSrcPixel->Green & bMask;
+            pMaskPixel->Blue     = pSrcPixel->Blue  & bMask;
+            pMaskPixel->Reserved = bMask;
+        }
+    }
+}
+
+inline VOID AADeleteKeyMask(
+        AAKEYMASK *pMask)
+{
+    ASSERT(pMask != NULL);
+
+    free(pMask->bmMask.bmBits);
+    pMask->bmMask.bmBits = NULL;
+}
+
+// Create key mask of 24 or 32 bpp source bitmap for color key clrKey.
+// Mask must be released by AADeleteKeyMask.
+inline BOOL AACreateKeyMask(
+        const BITMAP *pSrcBitmap,
+        COLORREF clrKey,
+        AAKEYMASK *pMask)
+{
+    ASSERT(pSrcBitmap != NULL);
+    ASSERT(pSrcBitmap->bmBits != NULL);
+    ASSERT(pMask != NULL);
+
+    memset(pMask, 0, sizeof(AAKEYMASK));
+
+    if (pSrcBitmap->bmBitsPixel != 24 && pSrcBitmap->bmBitsPixel != 32)
+        return FALSE;
+
+    pMask->nWidth = pSrcBitmap->bmWidth;
+    pMask->nHeight = pSrcBitmap->bmHeight;
+    pMask->clrKey = clrKey;
+
+    BITMAP *pMaskBitmap = &pMask->bmMask;
+    pMaskBitmap->bmWidth = pSrcBitmap->bmWidth;
+    pMaskBitmap->bmHeight = pSrcBitmap->bmHeight;
+    pMaskBitmap->bmWidthBytes = pSrcBitmap->bmWidth * sizeof(RGB32);
+    pMaskBitmap->bmPlanes = 1;
+    pMaskBitmap->bmBitsPixel = 32;
+    pMaskBitmap->bmBits = malloc((size_t)pMaskBitmap->bmWidthBytes * (size_t)pMaskBitmap->bmHeight);
+    if (pMaskBitmap->bmBits == NULL)
+        return FALSE;
+
+    if (pSrcBitmap->bmBitsPixel == 24)
+        AABuildKeyMaskTempl< PIXELFORMAT<24> >(pSrcBitmap, clrKey, pMaskBitmap);
+    else
+        AABuildKeyMaskTempl< PIXELFORMAT<32> >(pSrcBitmap, clrKey, pMaskBitmap);
+
+    return TRUE;
+}
+
+// Check key mask can be used for blit of source bitmap with color key pClrKey
+inline BOOL AAIsKeyMaskApplicable(
+        const AAKEYMASK *pMask,
+        const BITMAP *pSrcBitmap,
+        const COLORREF *pClrKey)
+{
+    if (pMask == NULL || pMask->bmMask.bmBits == NULL || pClrKey == NULL || pMask->clrKey != *pClrKey)
+        return FALSE;
+    return (pMask->nWidth == pSrcBitmap->bmWidth && pMask->nHeight == pSrcBitmap->bmHeight);
+}
+
+// Same as AAGetAverageColor with color key but pixels are taken from key mask.
+// Transparent part of extent is replaced by pSubstitutePixel color.
+template <typename PIXELDST, typename PIXELSUB>
+INT AAGetMaskedAverageColor(
+        const BITMAP *pMaskBitmap, 
+        INT nX, 
+        INT nY, 
+        INT nAvrCntX, 
+        INT nAvrCntY, 
+        PIXELDST *pAvrPixel, 
+        PIXELSUB *pSubstitutePixel)
+{
+    ASSERT(pAvrPixel != NULL);
+    ASSERT(pSubstitutePixel != NULL);
+    ASSERT(pMaskBitmap != NULL);
+    ASSERT(pMaskBitmap->bmBits != NULL);
+    ASSERT(pMaskBitmap->bmBitsPixel == 32);
+
+    INT nWidthBytes = pMaskBitmap->bmWidthBytes;
+
+    RECT rExtent;
+    AAClipAverageExtent(pMaskBitmap->bmWidth, pMaskBitmap->bmHeight, nX, nY, nAvrCntX, nAvrCntY, &rExtent);
+    INT nPixelsInRow = rExtent.right - rExtent.left;
+    INT nCnt = nPixelsInRow * (rExtent.bottom - rExtent.top);
+
+    // Key pixels are black, so plain sums need no comparison
+    INT nR = 0, nG = 0, nB = 0, nA = 0;
+
+    const BYTE *pBits = (const BYTE *)pMaskBitmap->bmBits + rExtent.top * nWidthBytes + rExtent.left * sizeof(RGB32);
+    const BYTE *pBitsTo = pBits + (rExtent.bottom - rExtent.top) * nWidthBytes;
+    for ( ; pBits<pBitsTo ; pBits+=nWidthBytes)
+    {
+        const RGB32 *p = (const RGB32 *)pBits;
+        const RGB32 *pTo = p + nPixelsInRow;
+        for ( ; p<pTo ; ++p)
+        {
+            nR += p->Red;
+            nG += p->Green;
+            nB += p->Blue;
+            nA += p->Reserved;
+        }
+    }
+
+    ASSERT(nCnt > 0);
+
+    INT nKeyCnt = nCnt - nA / 255;
+    nR += nKeyCnt * pSubstitutePixel->Red;
+    nG += nKeyCnt * pSubstitutePixel->Green;
+    nB += nKeyCnt * pSubstitutePixel->Blue;
+
+    pAvrPixel->Red   = (BYTE)(nR / nCnt);
+    pAvrPixel->Green = (BYTE)(nG / nCnt);
+    pAvrPixel->Blue  = (BYTE)(nB / nCnt);
+
+    return nCnt;
+}
+
+// Bilinear sample of bitmap at fixed point point sx, sy.
+// Points outside of bitmap are clamped to edge.
+// Channels are returned multiplied by 255.
+template <typename PIXEL>
+inline VOID AAGetBilinearColor(
+        const BITMAP *pBitmap,
+        INT sx,
+        INT sy,
+        INT *pRed,
+        INT *pGreen,
+        INT *pBlue)
+{
+    INT x0 = sx >> AA_FIXED_SHIFT, x1 = x0 + 1;
+    INT y0 = sy >> AA_FIXED_SHIFT, y1 = y0 + 1;
+    INT du = (sx & (AA_FIXED_SCALE - 1)) >> (AA_FIXED_SHIFT - 8);
+    INT dv = (sy & (AA_FIXED_SCALE - 1)) >> (AA_FIXED_SHIFT - 8);
+    INT dui = 255 - du;
+    INT dvi = 255 - dv;
+
+    INT nLastX = pBitmap->bmWidth - 1;
+    INT nLastY = pBitmap->bmHeight - 1;
+    x0 = (x0 < 0) ? 0 : (x0 > nLastX) ? nLastX : x0;
+    x1 = (x1 < 0) ? 0 : (x1 > nLastX) ? nLastX : x1;
+    y0 = (y0 < 0) ? 0 : (y0 > nLastY) ? nLastY : y0;
+    y1 = (y1 < 0) ? 0 : (y1 > nLastY) ? nLastY : y1;
+
+    const BYTE *pRow0 = (const BYTE *)pBitmap->bmBits + y0 * pBitmap->bmWidthBytes;
+    const BYTE *pRow1 = (const BYTE *)pBitmap->bmBits + y1 * pBitmap->bmWidthBytes;
+    const PIXEL *p1 = (const PIXEL *)pRow0 + x0;
+    const PIXEL *p2 = (const PIXEL *)pRow0 + x1;
+    const PIXEL *p3 = (const PIXEL *)pRow1 + x0;
+    const PIXEL *p4 = (const PIXEL *)pRow1 + x1;
+
+    INT a = dui * dvi; // a b
+    INT b = du  * dvi; // c d
+    INT c = dui * dv;
+    INT d = du  * dv;
+
+    // a + b + c + d = 255 * 255
+    *pRed   = ( p1->Red   * a + p2->Red   * b + p3->Red   * c + p4->Red   * d ) / 255;
+    *pGreen = ( p1->Green * a + p2->Green * b + p3->Green * c + p4->Green * d ) / 255;
+    *pBlue  = ( p1->Blue  * a + p2->Blue  * b + p3->Blue  * c + p4->Blue  * d ) / 255;
+}
+
+// Sample mipmap level at fixed point point sx, sy of level 0.
+// Level 0 is taken from source bitmap. Channels are multiplied by 255.
+template <typename PIXELSRC>
+inline VOID AAGetMipmapColor(
+        const AAMIPMAP *pMipmap,
+        const BITMAP *pSrcBitmap,
+        INT nLevel,
+        INT sx,
+        INT sy,
+        INT *pRed,
+        INT *pGreen,
+        INT *pBlue)
+{
+    ASSERT(nLevel >= 0 && nLevel < pMipmap->nLevels);
+
+    if (nLevel == 0)
+    {
+        AAGetBilinearColor<PIXELSRC>(pSrcBitmap, sx, sy, pRed, pGreen, pBlue);
+    }
+    else
+    {
+        // Pixel centers of level n are (x + 0.5) * 2^n - 0.5 of level 0
+        const INT iHALF = AA_FIXED_SCALE / 2;
+        INT sxLevel = ((sx + iHALF) >> nLevel) - iHALF;
+        INT syLevel = ((sy + iHALF) >> nLevel) - iHALF;
+        AAGetBilinearColor< PIXELFORMAT<32> >(
+                &pMipmap->bmLevels[nLevel - 1], sxLevel, syLevel, pRed, pGreen, pBlue);
+    }
+}
+
+// Choose mipmap levels for kx, ky ratios (src pixels per one dst pixel).
+// Result is level n and blending fraction (0...255) with level n+1.
+inline VOID AAGetMipmapLevel(
+        const AAMIPMAP *pMipmap,
+        double kx,
+        double ky,
+        INT *pnLevel,
+        INT *pnFrac)
+{
+    ASSERT(pMipmap != NULL);
+    ASSERT(pMipmap->nLevels > 0);
+
+    // Bigger ratio wins to avoid aliasing
+    double k = (kx > ky) ? kx : ky;
+    double lod = (k > 1.0) ? log(k) / log(2.0) : 0.0;
+
+    INT nLevel = (INT)lod;
+    INT nFrac = (INT)( (lod - (double)nLevel) * 256.0 );
+    if (nLevel >= pMipmap->nLevels - 1)
+        nLevel = pMipmap->nLevels - 1, nFrac = 0;
+
+    *pnLevel = nLevel;
+    *pnFrac = nFrac;
+}
+
+// Filtering of transformation kernels
+enum AAFILTER
+{
+    AA_FILTER_BILINEAR,     // pixel bilinear filtering (S < D)
+    AA_FILTER_CHUNKS,       // chunks averaging by AAGetAverageColor (S > D)
+    AA_FILTER_SUMMEDAREA,   // chunks averaging by summed area table (S > D)
+    AA_FILTER_MIPMAP        // trilinear mipmap sampling (S > D)
+};
+
+// AAKERNEL struct
+// Compile time parameters of transformation kernels. They are fixed for
+// the whole blit, so hot loops are instantiated without invariant branches.
+template <AAFILTER nFilter, BOOL bClrKey, BOOL bRotation, BOOL bKeyMask = FALSE>
+struct AAKERNEL
+{
+    static const AAFILTER FILTER = nFilter;
+    static const BOOL CLRKEY = bClrKey;     // color key is set
+    static const BOOL ROTATION = bRotation; // source Y changes along destination row
+    static const BOOL KEYMASK = bKeyMask;   // source is key mask, pixels are weighted by alpha
+};
+
+// AATRANSFORM_CONTEXT struct
+// Per-blit invariants shared by the pixel kernels
+struct AATRANSFORM_CONTEXT
+{
+    const BITMAP *pSrcBitmap;
+    const BYTE *pSrc;           // source bits
+    INT nSrcWidthBytes;         // source row length in bytes
+    INT nSrcWidthScaled;        // source width in fixed point
+    INT nSrcHeightScaled;       // source height in fixed point
+    INT nSrcLastAvailIndexX;
+    INT nSrcLastAvailIndexY;
+    double kx;                  // src pixel per one dst pixel
+    double ky;                  // src pixel per one dst pixel
+    INT nAvrSrcX;               // averaging points number
+    INT nAvrSrcY;               // averaging points number
+    AAFILTER nFilter;           // filtering of chunks or pixels
+    BOOL bSimd;                 // vectorized kernel is used for pixel bilinear filtering
+    BOOL bTiles;                // rotated bitmap is traversed by tiles
+    BOOL bKeyMask;              // source is AAKEYMASK of color keyed bitmap
+    const COLORREF *pClrKey;
+    const AASUMMEDAREATABLE *pSumTable; // table for AA_FILTER_SUMMEDAREA
+    const AAMIPMAP *pMipmap;    // pyramid for AA_FILTER_MIPMAP
+    INT nMipLevel;              // mipmap level to sample
+    INT nMipFrac;               // blending fraction with next level (0...255)
+};
+
+// Weight scaled by pixel alpha, exact for alpha 0 and 255.
+// 24bpp pixels have no alpha and are opaque.
+inline INT AAWeightByAlpha(INT nWeight, const RGB32 *p)
+{
+    INT nAlpha = p->Reserved;
+    return (nWeight * (nAlpha + (nAlpha >> 7))) >> 8;
+}
+
+inline INT AAWeightByAlpha(INT nWeight, const RGB24 *)
+{
+    return nWeight;
+}
+
+// Blend source pixels 1, 2, 3 and 4 with weights a, b, c, d into destination.
+// Weights sum less than 255 * 255 is edge coverage, destination is blended then.
+template <typename PIXELSRC, typename PIXELDST>
+inline VOID AABlendPixel(
+        const PIXELSRC *p1,
+        const PIXELSRC *p2,
+        const PIXELSRC *p3,
+        const PIXELSRC *p4,
+        INT a,
+        INT b,
+        INT c,
+        INT d,
+        PIXELDST *pDstPixel)
+{
+    INT ratio = a + b + c + d;
+
+    // Calculation transparency
+    // 0 fully transparent, 255 fully opaque
+    INT bAlpha = (INT)( ratio / 255 );
+
+    if (bAlpha > 0)
+    {
+        BYTE Red   = (BYTE)( ( p1->Red   * a + p2->Red   * b + p3->Red   * c + p4->Red   * d ) / ratio );
+        BYTE Green = (BYTE)( ( p1->Green * a + p2->Green * b + p3->Green * c + p4->Green * d ) / ratio );
+        BYTE Blue  = (BYTE)( ( p1->Blue  * a + p2->Blue  * b + p3->Blue  * c + p4->Blue  * d ) / ratio );
+
+        if (bAlpha == 255)
+        {
+            pDstPixel->Red = Red;
+            pDstPixel->Green = Green;
+            pDstPixel->Blue = Blue;
+        } 
+        else 
+        {
+            ASSERT(bAlpha > 0 && bAlpha < 255);
+            INT bOneMinusAlpha = 255 - bAlpha;
+            pDstPixel->Red   = (BYTE)( (pDstPixel->Red   * bOneMinusAlpha + Red   * bAlpha) >> 8 );
+            pDstPixel->Green = (BYTE)( (pDstPixel->Green * bOneMinusAlpha + Green * bAlpha) >> 8 );
+            pDstPixel->Blue  = (BYTE)( (pDstPixel->Blue  * bOneMinusAlpha + Blue  * bAlpha) >> 8 );
+        }
+    }
+}
+
+// Rounded division by 255 for 0 <= n <= 255 * 255, exact as n / 255.0 rounded
+inline INT AADiv255(INT n)
+{
+    n += 128;
+    return (n + (n >> 8)) >> 8;
+}
+
+// Porter-Duff "over" of one premultiplied channel: src + dst * (255 - alpha) / 255.
+// Result is saturated since not premultiplied input may exceed 255.
+inline BYTE AAOverChannel(INT nSrc, INT nDst, INT nOneMinusAlpha)
+{
+    INT n = nSrc + AADiv255(nDst * nOneMinusAlpha);
+    return (BYTE)(n < 255 ? n : 255);
+}
+
+// Composite premultiplied color over destination.
+// 32bpp destination is premultiplied and gets composited alpha,
+// 24bpp destination is opaque.
+inline VOID AACompositeOver(INT nRed, INT nGreen, INT nBlue, INT nAlpha, RGB32 *pDstPixel)
+{
+    INT nOneMinusAlpha = 255 - nAlpha;
+    pDstPixel->Red      = AAOverChannel(nRed,   pDstPixel->Red,      nOneMinusAlpha);
+    pDstPixel->Green    = AAOverChannel(nGreen, pDstPixel->Green,    nOneMinusAlpha);
+    pDstPixel->Blue     = AAOverChannel(nBlue,  pDstPixel->Blue,     nOneMinusAlpha);
+    pDstPixel->Reserved = AAOverChannel(nAlpha, pDstPixel->Reserved, nOneMinusAlpha);
+}
+
+inline VOID AACompositeOver(INT nRed, INT nGreen, INT nBlue, INT nAlpha, RGB24 *pDstPixel)
+{
+    INT nOneMinusAlpha = 255 - nAlpha;
+    pDstPixel->Red   = AAOverChannel(nRed,   pDstPixel->Red,   nOneMinusAlpha);
+    pDstPixel->Green = AAOverChannel(nGreen, pDstPixel->Green, nOneMinusAlpha);
+    pDstPixel->Blue  = AAOverChannel(nBlue,  pDstPixel->Blue,  nOneMinusAlpha);
+}
+
+// Same as AABlendPixel for premultiplied source, which is composited over
+// destination. Source outside of bitmap is transparent, so weights sum less 
+// than 255 * 255 scales alpha and colors alike.
+template <typename PIXELDST>
+inline VOID AABlendPixel(
+        const PARGB32 *p1,
+        const PARGB32 *p2,
+        const PARGB32 *p3,
+        const PARGB32 *p4,
+        INT a,
+        INT b,
+        INT c,
+        INT d,
+        PIXELDST *pDstPixel)
+{
+    AACompositeOver(
+            ( p1->Red      * a + p2->Red      * b + p3->Red      * c + p4->Red      * d ) / (255 * 255),
+            ( p1->Green    * a + p2->Green    * b + p3->Green    * c + p4->Green    * d ) / (255 * 255),
+            ( p1->Blue     * a + p2->Blue     * b + p3->Blue     * c + p4->Blue     * d ) / (255 * 255),
+            ( p1->Reserved * a + p2->Reserved * b + p3->Reserved * c + p4->Reserved * d ) / (255 * 255),
+            pDstPixel);
+}
+
+// Pixel bilinear filtering of source point sx, sy (fixed point).
+// Point is inside (-1...width)(-1...height), edges are anti-aliased.
+template <typename KERNEL, typename PIXELSRC, typename PIXELDST>
+inline VOID AABilinearPixel(
+        const AATRANSFORM_CONTEXT *pCtx,
+        INT sx,
+        INT sy,
+        PIXELDST *pDstPixel)
+{
+    const INT iSHIFT = AA_FIXED_SHIFT;
+    const INT iSCALE = AA_FIXED_SCALE;
+
+    INT x = sx >> iSHIFT; // source point X
+    INT y = sy >> iSHIFT; // source point Y
+
+    ASSERT(x >= -1 && x < pCtx->pSrcBitmap->bmWidth);
+    ASSERT(y >= -1 && y < pCtx->pSrcBitmap->bmHeight);
+
+    // Blending nearest pixels
+    // Destination point placed inside 0 area
+
+    INT du  = (sx % iSCALE) >> (iSHIFT - 8); 
+    INT dv  = (sy % iSCALE) >> (iSHIFT - 8);
+    if (du < 0)
+        du += iSCALE;
+    if (dv < 0)
+        dv += iSCALE;
+    INT dui = 255 - du;
+    INT dvi = 255 - dv;
+
+    INT a = dui * dvi; // blending coefficient for pixel 1    a b
+    INT b = du  * dvi; // blending coefficient for pixel 2    c d
+    INT c = dui * dv;  // blending coefficient for pixel 3
+    INT d = du  * dv;  // blending coefficient for pixel 4
+
+    // Source pixels 1, 2, 3 and 4
+    const PIXELSRC *p1 = (const PIXELSRC *)(pCtx->pSrc + y * pCtx->nSrcWidthBytes) + x; // row 0
+    const PIXELSRC *p3 = (const PIXELSRC *)((const BYTE *)p1 + pCtx->nSrcWidthBytes);   // row 1
+    if (y == -1)
+        p1 = p3, a = 0, b = 0;
+    else if (y == pCtx->nSrcLastAvailIndexY)
+        p3 = p1, c = 0, d = 0;
+    const PIXELSRC *p2 = p1 + 1; // col 0
+    const PIXELSRC *p4 = p3 + 1; // col 1
+    if (x == -1)
+        p1 = p2, p3 = p4, a = 0, c = 0;
+    else if (x == pCtx->nSrcLastAvailIndexX)
+        p2 = p1, p4 = p3, b = 0, d = 0;
+
+    if (KERNEL::KEYMASK)
+    {
+        a = AAWeightByAlpha(a, p1);
+        b = AAWeightByAlpha(b, p2);
+        c = AAWeightByAlpha(c, p3);
+        d = AAWeightByAlpha(d, p4);
+    }
+    else if (KERNEL::CLRKEY)
+    {
+        COLORREF clrKey = *pCtx->pClrKey;
+        if (*p1 == clrKey)
+            a = 0;
+        if (*p2 == clrKey)
+            b = 0;
+        if (*p3 == clrKey)
+            c = 0;
+        if (*p4 == clrKey)
+            d = 0;
+    }
+
+    AABlendPixel(p1, p2, p3, p4, a, b, c, d, pDstPixel);
+}
+
+// Pixel bilinear filtering of inner source point sx, sy (fixed point),
+// i.e. point is inside [0...width-1)[0...height-1) and needs no edge handling.
+// Result is identical to AABilinearPixel.
+template <typename KERNEL, typename PIXELSRC, typename PIXELDST>
+inline VOID AABilinearInnerPixel(
+        const AATRANSFORM_CONTEXT *pCtx,
+        INT sx,
+        INT sy,
+        PIXELDST *pDstPixel)
+{
+    INT x = sx >> AA_FIXED_SHIFT;
+    INT y = sy >> AA_FIXED_SHIFT;
+
+    ASSERT(x >= 0 && x < pCtx->nSrcLastAvailIndexX);
+    ASSERT(y >= 0 && y < pCtx->nSrcLastAvailIndexY);
+
+    INT du  = (sx & (AA_FIXED_SCALE - 1)) >> (AA_FIXED_SHIFT - 8); 
+    INT dv  = (sy & (AA_FIXED_SCALE - 1)) >> (AA_FIXED_SHIFT - 8);
+    INT dui = 255 - du;
+    INT dvi = 255 - dv;
+
+    INT a = dui * dvi; // a b
+    INT b = du  * dvi; // c d
+    INT c = dui * dv;
+    INT d = du  * dv;
+
+    const PIXELSRC *p1 = (const PIXELSRC *)(pCtx->pSrc + y * pCtx->nSrcWidthBytes) + x;
+    const PIXELSRC *p3 = (const PIXELSRC *)((const BYTE *)p1 + pCtx->nSrcWidthBytes);
+    const PIXELSRC *p2 = p1 + 1;
+    const PIXELSRC *p4 = p3 + 1;
+
+    if (KERNEL::KEYMASK)
+    {
+        a = AAWeightByAlpha(a, p1);
+        b = AAWeightByAlpha(b, p2);
+        c = AAWeightByAlpha(c, p3);
+        d = AAWeightByAlpha(d, p4);
+
+        AABlendPixel(p1, p2, p3, p4, a, b, c, d, pDstPixel);
+    }
+    else if (KERNEL::CLRKEY)
+    {
+        COLORREF clrKey = *pCtx->pClrKey;
+        if (*p1 == clrKey)
+            a = 0;
+        if (*p2 == clrKey)
+            b = 0;
+        if (*p3 == clrKey)
+            c = 0;
+        if (*p4 == clrKey)
+            d = 0;
+
+        AABlendPixel(p1, p2, p3, p4, a, b, c, d, pDstPixel);
+    }
+    else if (AAPIXEL_TRAITS<PIXELSRC>::PREMULTIPLIED)
+    {
+        // Source is composited over destination
+        AABlendPixel(p1, p2, p3, p4, a, b, c, d, pDstPixel);
+    }
+    else
+    {
+        // Weights sum is 255 * 255, destination is opaque
+        pDstPixel->Red   = (BYTE)( ( p1->Red   * a + p2->Red   * b + p3->Red   * c + p4->Red   * d ) / (255 * 255) );
+        pDstPixel->Green = (BYTE)( ( p1->Green * a + p2->Green * b + p3->Green * c + p4->Green * d ) / (255 * 255) );
+        pDstPixel->Blue  = (BYTE)( ( p1->Blue  * a + p2->Blue  * b + p3->Blue  * c + p4->Blue  * d ) / (255 * 255) );
+    }
+}
+
+// Chunks filtering of source point sx, sy (fixed point) for downscaling.
+// Point is inside (-1...width)(-1...height).
+template <typename KERNEL, typename PIXELSRC, typename PIXELDST>
+inline VOID AAChunkPixel(
+        const AATRANSFORM_CONTEXT *pCtx,
+        INT sx,
+        INT sy,
+        PIXELDST *pDstPixel)
+{
+    const INT iSHIFT = AA_FIXED_SHIFT;
+    const INT iSCALE = AA_FIXED_SCALE;
+
+    INT x = sx >> iSHIFT; // source point X
+    INT y = sy >> iSHIFT; // source point Y
+
+    ASSERT(x >= -1 && x < pCtx->pSrcBitmap->bmWidth);
+    ASSERT(y >= -1 && y < pCtx->pSrcBitmap->bmHeight);
+
+    if (KERNEL::FILTER == AA_FILTER_MIPMAP)
+    {
+        // Trilinear sampling of two nearest mipmap levels
+
+        INT nRed, nGreen, nBlue;
+        AAGetMipmapColor<PIXELSRC>(pCtx->pMipmap, pCtx->pSrcBitmap, pCtx->nMipLevel, sx, sy, &nRed, &nGreen, &nBlue);
+
+        INT nFrac = pCtx->nMipFrac;
+        if (nFrac > 0)
+        {
+            INT nRed1, nGreen1, nBlue1;
+            AAGetMipmapColor<PIXELSRC>(pCtx->pMipmap, pCtx->pSrcBitmap, pCtx->nMipLevel + 1, sx, sy, &nRed1, &nGreen1, &nBlue1);
+
+            nRed   = (nRed   * (256 - nFrac) + nRed1   * nFrac) >> 8;
+            nGreen = (nGreen * (256 - nFrac) + nGreen1 * nFrac) >> 8;
+            nBlue  = (nBlue  * (256 - nFrac) + nBlue1  * nFrac) >> 8;
+        }
+
+        pDstPixel->Red   = (BYTE)( nRed / 255 );
+        pDstPixel->Green = (BYTE)( nGreen / 255 );
+        pDstPixel->Blue  = (BYTE)( nBlue / 255 );
+        return;
+    }
+
+    // Blending nearest chunks
+    // Destination point placed inside in areas intersection
+
+    INT dui = (INT)( (double)((sx % iSCALE) >> (iSHIFT - 8)) / pCtx->kx );
+    INT dvi = (INT)( (double)((sy % iSCALE) >> (iSHIFT - 8)) / pCtx->ky ); 
+    INT du  = 255 - dui;
+    INT dv  = 255 - dvi;
+
+    // Averaged source color of chunk 1, 2, 3 and 4
+    PIXELSRC p[4]; 
+    PIXELSRC *p1 = p, *p2 = p+1, *p3 = p+2, *p4 = p+3;
+
+    // Calculation average chunks color and 
+    // weight of chunks for dest pixel color blending
+    INT na, nb, nc, nd;
+    if (KERNEL::FILTER == AA_FILTER_SUMMEDAREA)
+    {
+        na = AAGetSummedAverageColor(pCtx->pSumTable, x, y, -pCtx->nAvrSrcX, -pCtx->nAvrSrcY, p+0, pDstPixel);
+        nb = AAGetSummedAverageColor(pCtx->pSumTable, x, y,  pCtx->nAvrSrcX, -pCtx->nAvrSrcY, p+1, pDstPixel);
+        nc = AAGetSummedAverageColor(pCtx->pSumTable, x, y, -pCtx->nAvrSrcX,  pCtx->nAvrSrcY, p+2, pDstPixel);
+        nd = AAGetSummedAverageColor(pCtx->pSumTable, x, y,  pCtx->nAvrSrcX,  pCtx->nAvrSrcY, p+3, pDstPixel);
+    }
+    else if (KERNEL::KEYMASK)
+    {
+        na = AAGetMaskedAverageColor(pCtx->pSrcBitmap, x, y, -pCtx->nAvrSrcX, -pCtx->nAvrSrcY, p+0, pDstPixel);
+        nb = AAGetMaskedAverageColor(pCtx->pSrcBitmap, x, y,  pCtx->nAvrSrcX, -pCtx->nAvrSrcY, p+1, pDstPixel);
+        nc = AAGetMaskedAverageColor(pCtx->pSrcBitmap, x, y, -pCtx->nAvrSrcX,  pCtx->nAvrSrcY, p+2, pDstPixel);
+        nd = AAGetMaskedAverageColor(pCtx->pSrcBitmap, x, y,  pCtx->nAvrSrcX,  pCtx->nAvrSrcY, p+3, pDstPixel);
+    }
+    else
+    {
+        const COLORREF *pClrKey = KERNEL::CLRKEY ? pCtx->pClrKey : NULL;
+        na = AAGetAverageColor<PIXELSRC>(pCtx->pSrcBitmap, x, y, -pCtx->nAvrSrcX, -pCtx->nAvrSrcY, p+0, pClrKey, pDstPixel);
+        nb = AAGetAverageColor<PIXELSRC>(pCtx->pSrcBitmap, x, y,  pCtx->nAvrSrcX, -pCtx->nAvrSrcY, p+1, pClrKey, pDstPixel);
+        nc = AAGetAverageColor<PIXELSRC>(pCtx->pSrcBitmap, x, y, -pCtx->nAvrSrcX,  pCtx->nAvrSrcY, p+2, pClrKey, pDstPixel);
+        nd = AAGetAverageColor<PIXELSRC>(pCtx->pSrcBitmap, x, y,  pCtx->nAvrSrcX,  pCtx->nAvrSrcY, p+3, pClrKey, pDstPixel);
+    }
+
+    double a = na * dui * dvi; // blending coefficient for chunk 0     a b
+    double b = nb * du  * dvi; // blending coefficient for chunk 1     c d
+    double c = nc * dui * dv;  // blending coefficient for chunk 2
+    double d = nd * du  * dv;  // blending coefficient for chunk 3
+    double ratio = a + b + c + d;
+
+    if (AAPIXEL_TRAITS<PIXELSRC>::PREMULTIPLIED)
+    {
+        // Averaged premultiplied chunks are composited over destination
+        AACompositeOver(
+                (INT)( ( p1->Red   * a + p2->Red   * b + p3->Red   * c + p4->Red   * d ) / ratio ),
+                (INT)( ( p1->Green * a + p2->Green * b + p3->Green * c + p4->Green * d ) / ratio ),
+                (INT)( ( p1->Blue  * a + p2->Blue  * b + p3->Blue  * c + p4->Blue  * d ) / ratio ),
+                (INT)( ( AAGetPixelAlpha(p1) * a + AAGetPixelAlpha(p2) * b + 
+                         AAGetPixelAlpha(p3) * c + AAGetPixelAlpha(p4) * d ) / ratio ),
+                pDstPixel);
+        return;
+    }
+
+    pDstPixel->Red   = (BYTE)( ( p1->Red   * a + p2->Red   * b + p3->Red   * c + p4->Red   * d ) / ratio );
+    pDstPixel->Green = (BYTE)( ( p1->Green * a + p2->Green * b + p3->Green * c + p4->Green * d ) / ratio );
+    pDstPixel->Blue  = (BYTE)( ( p1->Blue  * a + p2->Blue  * b + p3->Blue  * c + p4->Blue  * d ) / ratio );
+}
+
+// Calculate one destination pixel from source point sx, sy (fixed point)
+// Scalar kernel, it handles all cases: points out of source, edges, 
+// color key, pixel and chunks filtering
+template <typename KERNEL, typename PIXELSRC, typename PIXELDST>
+inline VOID AATransformPixel(
+        const AATRANSFORM_CONTEXT *pCtx,
+        INT sx,
+        INT sy,
+        PIXELDST *pDstPixel)
+{
+    const INT iSCALE = AA_FIXED_SCALE;
+
+    if (sx > -iSCALE && sy > -iSCALE && sx < pCtx->nSrcWidthScaled && sy < pCtx->nSrcHeightScaled)
+    {
+        if (KERNEL::FILTER == AA_FILTER_BILINEAR)
+            AABilinearPixel<KERNEL, PIXELSRC>(pCtx, sx, sy, pDstPixel);
+        else 
+            AAChunkPixel<KERNEL, PIXELSRC>(pCtx, sx, sy, pDstPixel);
+    }
+}
+
+#ifdef AA_SSE2
+
+// Check SSE2 instructions are available on current CPU
+inline BOOL AAIsSSE2Available()
+{
+#if defined(_M_IX86) && !(defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    static const BOOL bAvailable = ::IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE);
+    return bAvailable;
+#else
+    return TRUE; // x64 and /arch:SSE2 builds
+#endif
+}
+
+// Load pixel as 0x00RRGGBB (32bpp pixel keeps its reserved byte)
+inline UINT AALoadPixel(const RGB32 *p)
+{ return *(const UINT *)p; }
+inline UINT AALoadPixel(const RGB24 *p)
+{ return (UINT)p->Blue | ((UINT)p->Green << 8) | ((UINT)p->Red << 16); }
+
+#endif // AA_SSE2
+
+// AABilinearSSE2 struct
+// Vectorized pixel bilinear filtering of 4 destination pixels per call.
+// Generic version is stub, specialization exists for 32bpp destination.
+template <typename PIXELSRC, typename PIXELDST>
+struct AABilinearSSE2
+{
+    static BOOL IsSupported() 
+    { return FALSE; }
+    static VOID Blend4(const AATRANSFORM_CONTEXT *, const INT *, const INT *, PIXELDST *) 
+    { ASSERT(FALSE); }
+    static INT Blend4Masked(const AATRANSFORM_CONTEXT *, const INT *, const INT *, PIXELDST *) 
+    { return 0xF; }
+};
+
+#ifdef AA_SSE2
+
+template <typename PIXELSRC>
+struct AABilinearSSE2<PIXELSRC, PIXELFORMAT<32> >
+{
+    static BOOL IsSupported() 
+    { return AAIsSSE2Available(); }
+
+    // Blend 4 consecutive destination pixels for source points psx[i], psy[i].
+    // Result is bit-identical to AATransformPixel. Points must be inner ones,
+    // i.e. inside [0...width-1)[0...height-1), span is checked by caller.
+    static VOID Blend4(
+            const AATRANSFORM_CONTEXT *pCtx, 
+            const INT *psx, 
+            const INT *psy, 
+            PIXELFORMAT<32> *pDstPixel)
+    {
+        Blend4Templ<FALSE>(pCtx, psx, psy, pDstPixel);
+    }
+
+    // Same as Blend4 for key mask source. Opaque pixels are blended, fully
+    // transparent ones keep destination. Returns bit mask of partially 
+    // transparent pixels, they are left untouched for scalar kernel.
+    static INT Blend4Masked(
+            const AATRANSFORM_CONTEXT *pCtx, 
+            const INT *psx, 
+            const INT *psy, 
+            PIXELFORMAT<32> *pDstPixel)
+    {
+        return Blend4Templ<TRUE>(pCtx, psx, psy, pDstPixel);
+    }
+
+private:
+    template <BOOL bCheckAlpha>
+    static INT Blend4Templ(
+            const AATRANSFORM_CONTEXT *pCtx, 
+            const INT *psx, 
+            const INT *psy, 
+            PIXELFORMAT<32> *pDstPixel)
+    {
+        // Gather source pixels 1, 2, 3 and 4 (a b / c d) of each point
+        UINT p1[4], p2[4], p3[4], p4[4];
+        short du[4], dv[4];
+        const INT nWidthBytes = pCtx->nSrcWidthBytes;
+        for (INT i=0 ; i<4 ; ++i)
+        {
+            INT x = psx[i] >> AA_FIXED_SHIFT;
+            INT y = psy[i] >> AA_FIXED_SHIFT;
+            const PIXELSRC *pRow0 = (const PIXELSRC *)(pCtx->pSrc + y * nWidthBytes) + x;
+            const PIXELSRC *pRow1 = (const PIXELSRC *)((const BYTE *)pRow0 + nWidthBytes);
+            p1[i] = AALoadPixel(pRow0);
+            p2[i] = AALoadPixel(pRow0 + 1);
+            p3[i] = AALoadPixel(pRow1);
+            p4[i] = AALoadPixel(pRow1 + 1);
+            du[i] = (short)((psx[i] & (AA_FIXED_SCALE - 1)) >> (AA_FIXED_SHIFT - 8));
+            dv[i] = (short)((psy[i] & (AA_FIXED_SCALE - 1)) >> (AA_FIXED_SHIFT - 8));
+        }
+
+        const __m128i zero = _mm_setzero_si128();
+        __m128i v1 = _mm_loadu_si128((const __m128i *)p1);
+        __m128i v2 = _mm_loadu_si128((const __m128i *)p2);
+        __m128i v3 = _mm_loadu_si128((const __m128i *)p3);
+        __m128i v4 = _mm_loadu_si128((const __m128i *)p4);
+
+        // Weights are replicated over 4 channels of each pixel
+        __m128i du01 = _mm_setr_epi16(du[0], du[0], du[0], du[0], du[1], du[1], du[1], du[1]);
+        __m128i du23 = _mm_setr_epi16(du[2], du[2], du[2], du[2], du[3], du[3], du[3], du[3]);
+        __m128i dv01 = _mm_setr_epi16(dv[0], dv[0], dv[0], dv[0], dv[1], dv[1], dv[1], dv[1]);
+        __m128i dv23 = _mm_setr_epi16(dv[2], dv[2], dv[2], dv[2], dv[3], dv[3], dv[3], dv[3]);
+
+        __m128i s0, s1, s2, s3;
+        Sum2(_mm_unpacklo_epi8(v1, zero), _mm_unpacklo_epi8(v2, zero), 
+             _mm_unpacklo_epi8(v3, zero), _mm_unpacklo_epi8(v4, zero), du01, dv01, &s0, &s1);
+        Sum2(_mm_unpackhi_epi8(v1, zero), _mm_unpackhi_epi8(v2, zero), 
+             _mm_unpackhi_epi8(v3, zero), _mm_unpackhi_epi8(v4, zero), du23, dv23, &s2, &s3);
+
+        // Destination bytes kept, reserved byte is kept as scalar kernel does
+        __m128i keep = _mm_set1_epi32(0xFF000000);
+        INT nScalar = 0;
+        if (bCheckAlpha)
+        {
+            // Alpha sum of weighted taps is 255 * 255 * 255 if they are all opaque,
+            // then result equals plain one. Zero sum is fully transparent pixel.
+            // Other pixels are kept whole for scalar kernel.
+            const __m128i full = _mm_set1_epi32(255 * 255 * 255);
+            __m128i a01 = _mm_unpackhi_epi32(s0, s1); // alpha of pixels 0 and 1 in lanes 2 and 3
+            __m128i a23 = _mm_unpackhi_epi32(s2, s3);
+            __m128i a = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(a01), _mm_castsi128_ps(a23), _MM_SHUFFLE(3, 2, 3, 2)));
+            __m128i opaque = _mm_cmpeq_epi32(a, full);
+            __m128i transparent = _mm_cmpeq_epi32(a, zero);
+            nScalar = ~_mm_movemask_ps(_mm_castsi128_ps(_mm_or_si128(opaque, transparent))) & 0xF;
+            keep = _mm_or_si128(keep, _mm_andnot_si128(opaque, _mm_set1_epi32(-1)));
+        }
+
+        // Sum of weights is 255 * 255 for inner points, i.e. destination is opaque
+        __m128i res = _mm_packus_epi16(
+                _mm_packs_epi32(Div65025(s0), Div65025(s1)), 
+                _mm_packs_epi32(Div65025(s2), Div65025(s3)));
+
+        __m128i dst = _mm_loadu_si128((const __m128i *)pDstPixel);
+        if (AAPIXEL_TRAITS<PIXELSRC>::PREMULTIPLIED)
+        {
+            // Premultiplied source is composited over destination, alpha too
+            res = _mm_packus_epi16(
+                    Over2(_mm_unpacklo_epi8(res, zero), _mm_unpacklo_epi8(dst, zero)),
+                    Over2(_mm_unpackhi_epi8(res, zero), _mm_unpackhi_epi8(dst, zero)));
+        }
+        else
+        {
+            // Keep reserved byte of destination as scalar kernel does
+            res = _mm_or_si128(_mm_andnot_si128(keep, res), _mm_and_si128(keep, dst));
+        }
+        _mm_storeu_si128((__m128i *)pDstPixel, res);
+        return nScalar;
+    }
+
+    // Porter-Duff "over" of 2 premultiplied pixels (8 x 16 bit channels),
+    // result is identical to AAOverChannel
+    static __m128i Over2(__m128i src, __m128i dst)
+    {
+        __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(src, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+        __m128i t = _mm_mullo_epi16(dst, _mm_sub_epi16(_mm_set1_epi16(255), alpha));
+        t = _mm_add_epi16(t, _mm_set1_epi16(128));
+        t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+        return _mm_add_epi16(src, t); // saturated by pack
+    }
+
+    // Weighted sum of 4 taps for 2 pixels (8 x 16 bit channels),
+    // results are 4 x 32 bit sums for pixel 0 and for pixel 1
+    static VOID Sum2(
+            __m128i p1, 
+            __m128i p2, 
+            __m128i p3, 
+            __m128i p4, 
+            __m128i du, 
+            __m128i dv, 
+            __m128i *ps0, 
+            __m128i *ps1)
+    {
+        const __m128i v255 = _mm_set1_epi16(255);
+        __m128i dui = _mm_sub_epi16(v255, du);
+        __m128i dvi = _mm_sub_epi16(v255, dv);
+
+        // Horizontal pass fits 16 bit since p1 * dui + p2 * du <= 255 * 255
+        __m128i t = _mm_add_epi16(_mm_mullo_epi16(p1, dui), _mm_mullo_epi16(p2, du));
+        __m128i b = _mm_add_epi16(_mm_mullo_epi16(p3, dui), _mm_mullo_epi16(p4, du));
+
+        // Vertical pass needs 32 bit
+        __m128i tl = _mm_mullo_epi16(t, dvi), th = _mm_mulhi_epu16(t, dvi);
+        __m128i bl = _mm_mullo_epi16(b, dv),  bh = _mm_mulhi_epu16(b, dv);
+        *ps0 = _mm_add_epi32(_mm_unpacklo_epi16(tl, th), _mm_unpacklo_epi16(bl, bh));
+        *ps1 = _mm_add_epi32(_mm_unpackhi_epi16(tl, th), _mm_unpackhi_epi16(bl, bh));
+    }
+
+    // Exact integer division by 255 * 255 for 0 <= s <= 255 * 255 * 255:
+    // s / 65025 == (s * 16909061) >> 40
+    static __m128i Div65025(__m128i s)
+    {
+        const __m128i m = _mm_set1_epi32(16909061);
+        __m128i q02 = _mm_srli_epi64(_mm_mul_epu32(s, m), 40);
+        __m128i q13 = _mm_srli_epi64(_mm_mul_epu32(_mm_srli_epi64(s, 32), m), 40);
+        return _mm_or_si128(q02, _mm_slli_epi64(q13, 32));
+    }
+};
+
+#endif // AA_SSE2
+
+// AATRANSFORM struct
+// Fixed point stepping of source point over destination rect.
+// Fractional parts of steps are accumulated in remainders (1/AA_FIXED_SCALE units),
+// on overflow source point is corrected by one unit.
+struct AATRANSFORM
+{
+    RECT rDst;                  // destination rect, right and bottom are inclusive
+    INT sxFrom, syFrom;         // start for sx and sy
+    INT sxStep, syStep;         // step for sx and sy per dx
+    INT sxNext, syNext;         // step for sx and sy per dy
+    INT rxStep, ryStep;         // remainder for step per dx
+    INT rxNext, ryNext;         // remainder for step per dy
+    INT rxFrom, ryFrom;         // remainder of from point
+    INT sxStepCorr, syStepCorr; // remainder compensators per dx
+    INT sxNextCorr, syNextCorr; // remainder compensators per dy
+};
+
+// Calculate source point and remainders for the first pixel of row dy.
+// Result is exactly what row by row accumulation gives, so any row
+// can be started independently.
+inline VOID AAGetTransformRowStart(
+        const AATRANSFORM *pTransform,
+        INT dy,
+        INT *psx,
+        INT *psy,
+        INT *prxAcc,
+        INT *pryAcc)
+{
+    ASSERT(pTransform != NULL);
+    ASSERT(dy >= pTransform->rDst.top);
+
+    // Row n gets n steps and n+1 remainder compensations
+    INT n = dy - pTransform->rDst.top;
+    INT rxAcc = pTransform->rxFrom + (n + 1) * pTransform->rxNext;
+    INT ryAcc = pTransform->ryFrom + (n + 1) * pTransform->ryNext;
+
+    *psx = pTransform->sxFrom + n * pTransform->sxNext + (rxAcc >> AA_FIXED_SHIFT) * pTransform->sxNextCorr;
+    *psy = pTransform->syFrom + n * pTransform->syNext + (ryAcc >> AA_FIXED_SHIFT) * pTransform->syNextCorr;
+    *prxAcc = rxAcc & (AA_FIXED_SCALE - 1);
+    *pryAcc = ryAcc & (AA_FIXED_SCALE - 1);
+}
+
+// AAPOINT_STATE struct
+// Source point stepper state along a destination row
+struct AAPOINT_STATE
+{
+    INT sx, sy;                 // source point before remainder compensation
+    INT rxAcc, ryAcc;           // accumulative remainders
+};
+
+// Get source point for current column and move stepper to the next one.
+// Without rotation source Y is constant along a row.
+template <typename KERNEL>
+inline VOID AANextPoint(
+        const AATRANSFORM *pTransform,
+        AAPOINT_STATE *pState,
+        INT *psx,
+        INT *psy)
+{
+    // Remainder compensation
+    pState->rxAcc += pTransform->rxStep;
+    if (pState->rxAcc >= AA_FIXED_SCALE)
+        pState->rxAcc -= AA_FIXED_SCALE, pState->sx += pTransform->sxStepCorr;
+    if (KERNEL::ROTATION)
+    {
+        pState->ryAcc += pTransform->ryStep;
+        if (pState->ryAcc >= AA_FIXED_SCALE)
+            pState->ryAcc -= AA_FIXED_SCALE, pState->sy += pTransform->syStepCorr;
+    }
+
+    *psx = pState->sx;
+    *psy = pState->sy;
+
+    pState->sx += pTransform->sxStep;
+    if (KERNEL::ROTATION)
+        pState->sy += pTransform->syStep;
+}
+
+// Move coordinate s with remainder r by n steps at once
+inline VOID AAAdvanceCoord(
+        INT *ps,
+        INT *pr,
+        INT nStep,
+        INT rStep,
+        INT nCorr,
+        INT n)
+{
+    INT r = *pr + n * rStep;
+    *ps += n * nStep + (r >> AA_FIXED_SHIFT) * nCorr;
+    *pr = r & (AA_FIXED_SCALE - 1);
+}
+
+// Move stepper by n columns at once, same as n calls of AANextPoint
+inline VOID AAAdvancePoint(
+        const AATRANSFORM *pTransform,
+        AAPOINT_STATE *pState,
+        INT n)
+{
+    AAAdvanceCoord(&pState->sx, &pState->rxAcc, 
+        pTransform->sxStep, pTransform->rxStep, pTransform->sxStepCorr, n);
+    AAAdvanceCoord(&pState->sy, &pState->ryAcc, 
+        pTransform->syStep, pTransform->ryStep, pTransform->syStepCorr, n);
+}
+
+// Coordinate of column j for row coordinate s0 with remainder r0
+inline INT AAGetColumnCoord(
+        INT s0,
+        INT r0,
+        INT nStep,
+        INT rStep,
+        INT nCorr,
+        INT j)
+{
+    // Column j gets j+1 remainder compensations but j steps
+    AAAdvanceCoord(&s0, &r0, nStep, rStep, nCorr, j + 1);
+    return s0 - nStep;
+}
+
+// Columns [*pjFrom...*pjTo) of nCount row columns where lo < s(j) < hi.
+// Coordinate s(j) is monotone along a row, so these columns are contiguous
+// and found by binary search.
+inline VOID AAGetAxisSpan(
+        INT s0,
+        INT r0,
+        INT nStep,
+        INT rStep,
+        INT nCorr,
+        INT nCount,
+        INT lo,
+        INT hi,
+        INT *pjFrom,
+        INT *pjTo)
+{
+    ASSERT(nCount > 0);
+
+    BOOL bIncreasing = 
+        AAGetColumnCoord(s0, r0, nStep, rStep, nCorr, nCount - 1) >= 
+        AAGetColumnCoord(s0, r0, nStep, rStep, nCorr, 0);
+
+    // Bounds: s > lo is s >= lo+1 for increasing s, s < hi is s <= hi-1 for decreasing s
+    INT vFrom = bIncreasing ? lo + 1 : hi - 1;
+    INT vTo = bIncreasing ? hi : lo;
+
+    for (INT i=0 ; i<2 ; ++i)
+    {
+        // First column where s(j) reaches v
+        INT v = (i == 0) ? vFrom : vTo;
+        INT jFrom = 0, jTo = nCount;
+        while (jFrom < jTo)
+        {
+            INT j = (jFrom + jTo) / 2;
+            INT s = AAGetColumnCoord(s0, r0, nStep, rStep, nCorr, j);
+            if (bIncreasing ? (s >= v) : (s <= v))
+                jTo = j;
+            else
+                jFrom = j + 1;
+        }
+        if (i == 0)
+            *pjFrom = jFrom;
+        else
+            *pjTo = jFrom;
+    }
+
+    if (*pjTo < *pjFrom)
+        *pjTo = *pjFrom;
+}
+
+// Columns [*pjFrom...*pjTo) of a row started from pState where
+// source point is inside (loX...hiX)(loY...hiY)
+inline VOID AAGetRowSpan(
+        const AATRANSFORM *pTransform,
+        const AAPOINT_STATE *pState,
+        INT nCount,
+        INT loX,
+        INT hiX,
+        INT loY,
+        INT hiY,
+        INT *pjFrom,
+        INT *pjTo)
+{
+    INT jFromX, jToX, jFromY, jToY;
+    AAGetAxisSpan(pState->sx, pState->rxAcc, pTransform->sxStep, pTransform->rxStep, pTransform->sxStepCorr, 
+        nCount, loX, hiX, &jFromX, &jToX);
+    AAGetAxisSpan(pState->sy, pState->ryAcc, pTransform->syStep, pTransform->ryStep, pTransform->syStepCorr, 
+        nCount, loY, hiY, &jFromY, &jToY);
+
+    *pjFrom = (jFromX > jFromY) ? jFromX : jFromY;
+    *pjTo = (jToX < jToY) ? jToX : jToY;
+    if (*pjTo < *pjFrom)
+        *pjTo = *pjFrom;
+}
+
+// Transform nCount columns from stepper position.
+// Edge span checks every point, inner span points need no checks.
+template <typename KERNEL, typename PIXELSRC, typename PIXELDST>
+VOID AATransformSpanTempl(
+        const AATRANSFORM *pTransform,
+        const AATRANSFORM_CONTEXT *pCtx,
+        AAPOINT_STATE *pState,
+        INT nCount,
+        BOOL bInner,
+        PIXELDST *pDstPixel)
+{
+    typedef AABilinearSSE2<PIXELSRC, PIXELDST> SIMD;
+
+    INT sx, sy;
+    INT i = 0;
+
+    if (!bInner)
+    {
+        for ( ; i<nCount ; ++i, ++pDstPixel)
+        {
+            AANextPoint<KERNEL>(pTransform, pState, &sx, &sy);
+            AATransformPixel<KERNEL, PIXELSRC>(pCtx, sx, sy, pDstPixel);
+        }
+    }
+    else if (KERNEL::FILTER != AA_FILTER_BILINEAR)
+    {
+        for ( ; i<nCount ; ++i, ++pDstPixel)
+        {
+            AANextPoint<KERNEL>(pTransform, pState, &sx, &sy);
+            AAChunkPixel<KERNEL, PIXELSRC>(pCtx, sx, sy, pDstPixel);
+        }
+    }
+    else
+    {
+        if (!KERNEL::CLRKEY && pCtx->bSimd)
+        {
+            // Source points are collected by 4 for vectorized kernel
+            for ( ; i+4<=nCount ; i+=4, pDstPixel+=4)
+            {
+                INT asx[4], asy[4];
+                AANextPoint<KERNEL>(pTransform, pState, asx+0, asy+0);
+                AANextPoint<KERNEL>(pTransform, pState, asx+1, asy+1);
+                AANextPoint<KERNEL>(pTransform, pState, asx+2, asy+2);
+                AANextPoint<KERNEL>(pTransform, pState, asx+3, asy+3);
+                SIMD::Blend4(pCtx, asx, asy, pDstPixel);
+            }
+        }
+        else if (KERNEL::KEYMASK && pCtx->bSimd)
+        {
+            // Opaque and transparent parts of key mask go vectorized, edges of key are scalar
+            for ( ; i+4<=nCount ; i+=4, pDstPixel+=4)
+            {
+                INT asx[4], asy[4];
+                AANextPoint<KERNEL>(pTransform, pState, asx+0, asy+0);
+                AANextPoint<KERNEL>(pTransform, pState, asx+1, asy+1);
+                AANextPoint<KERNEL>(pTransform, pState, asx+2, asy+2);
+                AANextPoint<KERNEL>(pTransform, pState, asx+3, asy+3);
+                INT nScalar = SIMD::Blend4Masked(pCtx, asx, asy, pDstPixel);
+                for (INT k=0 ; nScalar != 0 ; ++k, nScalar >>= 1)
+                {
+                    if (nScalar & 1)
+                        AABilinearInnerPixel<KERNEL, PIXELSRC>(pCtx, asx[k], asy[k], pDstPixel + k);
+                }
+            }
+        }
+
+        for ( ; i<nCount ; ++i, ++pDstPixel)
+        {
+            AANextPoint<KERNEL>(pTransform, pState, &sx, &sy);
+            AABilinearInnerPixel<KERNEL, PIXELSRC>(pCtx, sx, sy, pDstPixel);
+        }
+    }
+}
+
+// AAROW_SPANS struct
+// Stepper at the first column and column spans of one destination row
+struct AAROW_SPANS
+{
+    AAPOINT_STATE state;        // stepper at column 0 of the row
+    INT jFrom, jTo;             // columns [jFrom...jTo) touch source
+    INT jInnerFrom, jInnerTo;   // columns [jInnerFrom...jInnerTo) are inner ones
+};
+
+// Calculate stepper and column spans of destination row dy
+template <typename KERNEL>
+inline VOID AAGetRowSpansTempl(
+        const AATRANSFORM *pTransform,
+        const AATRANSFORM_CONTEXT *pCtx,
+        INT dy,
+        INT nCount,
+        AAROW_SPANS *pRow)
+{
+    // Source point is used by kernels inside (lo...hi)
+    const INT loX = -AA_FIXED_SCALE, hiX = pCtx->nSrcWidthScaled;
+    const INT loY = -AA_FIXED_SCALE, hiY = pCtx->nSrcHeightScaled;
+
+    // Pixel bilinear filtering needs edge handling out of [0...width-1)[0...height-1)
+    INT loInnerX = loX, hiInnerX = hiX;
+    INT loInnerY = loY, hiInnerY = hiY;
+    if (KERNEL::FILTER == AA_FILTER_BILINEAR)
+    {
+        loInnerX = -1, hiInnerX = pCtx->nSrcLastAvailIndexX << AA_FIXED_SHIFT;
+        loInnerY = -1, hiInnerY = pCtx->nSrcLastAvailIndexY << AA_FIXED_SHIFT;
+    }
+
+    AAPOINT_STATE &state = pRow->state;
+    AAGetTransformRowStart(pTransform, dy, &state.sx, &state.sy, &state.rxAcc, &state.ryAcc);
+
+    AAGetRowSpan(pTransform, &state, nCount, loX, hiX, loY, hiY, &pRow->jFrom, &pRow->jTo);
+    if (pRow->jFrom >= pRow->jTo)
+    {
+        pRow->jInnerFrom = pRow->jInnerTo = pRow->jTo;
+        return;
+    }
+    AAGetRowSpan(pTransform, &state, nCount, loInnerX, hiInnerX, loInnerY, hiInnerY, &pRow->jInnerFrom, &pRow->jInnerTo);
+    if (pRow->jInnerFrom >= pRow->jInnerTo)
+        pRow->jInnerFrom = pRow->jInnerTo = pRow->jTo;
+    ASSERT(pRow->jFrom <= pRow->jInnerFrom && pRow->jInnerTo <= pRow->jTo);
+}
+
+// Transform columns [jFrom...jTo) of a destination row with known spans.
+// pDstPixel is column 0 of the row.
+template <typename KERNEL, typename PIXELSRC, typename PIXELDST>
+VOID AATransformRowTempl(
+        const AATRANSFORM *pTransform,
+        const AATRANSFORM_CONTEXT *pCtx,
+        const AAROW_SPANS *pRow,
+        INT jFrom,
+        INT jTo,
+        PIXELDST *pDstPixel)
+{
+    // Clip spans by columns
+    if (jFrom < pRow->jFrom)
+        jFrom = pRow->jFrom;
+    if (jTo > pRow->jTo)
+        jTo = pRow->jTo;
+    if (jFrom >= jTo)
+        return;
+
+    INT jInnerFrom = pRow->jInnerFrom, jInnerTo = pRow->jInnerTo;
+    if (jInnerFrom < jFrom)
+        jInnerFrom = jFrom;
+    if (jInnerFrom > jTo)
+        jInnerFrom = jTo;
+    if (jInnerTo < jInnerFrom)
+        jInnerTo = jInnerFrom;
+    if (jInnerTo > jTo)
+        jInnerTo = jTo;
+
+    AAPOINT_STATE state = pRow->state;
+    AAAdvancePoint(pTransform, &state, jFrom);
+    pDstPixel += jFrom;
+
+    AATransformSpanTempl<KERNEL, PIXELSRC>(pTransform, pCtx, &state, jInnerFrom - jFrom, FALSE, pDstPixel);
+    pDstPixel += jInnerFrom - jFrom;
+    AATransformSpanTempl<KERNEL, PIXELSRC>(pTransform, pCtx, &state, jInnerTo - jInnerFrom, TRUE, pDstPixel);
+    pDstPixel += jInnerTo - jInnerFrom;
+    AATransformSpanTempl<KERNEL, PIXELSRC>(pTransform, pCtx, &state, jTo - jInnerTo, FALSE, pDstPixel);
+}
+
+// Transform destination rows [dyFrom...dyTo].
+// Each row is rasterized by exact spans: columns which source point is 
+// out of source are skipped, inner columns go without edge checks.
+template <typename KERNEL, typename PIXELSRC, typename PIXELDST>
+VOID AATransformRowsTempl(
+        const BITMAP *pDstBitmap,
+        const AATRANSFORM *pTransform,
+        const AATRANSFORM_CONTEXT *pCtx,
+        INT dyFrom,
+        INT dyTo)
+{
+    ASSERT(pDstBitmap != NULL);
+    ASSERT(pTransform != NULL);
+    ASSERT(pCtx != NULL);
+
+    const RECT &rDst = pTransform->rDst;
+    INT nCount = rDst.right - rDst.left + 1;
+    if (nCount <= 0)
+        return;
+
+    BYTE *pDst = (BYTE *)pDstBitmap->bmBits + dyFrom * pDstBitmap->bmWidthBytes;
+
+    for (INT dy = dyFrom ; dy <= dyTo ; ++dy, pDst += pDstBitmap->bmWidthBytes)
+    {   
+        AAROW_SPANS row;
+        AAGetRowSpansTempl<KERNEL>(pTransform, pCtx, dy, nCount, &row);
+        AATransformRowTempl<KERNEL, PIXELSRC>(pTransform, pCtx, &row, 0, nCount, (PIXELDST *)pDst + rDst.left);
+    }
+}
+
+//
+// Tiled blit
+//
+
+// Destination tile side for tiled traversal
+const INT AA_TILE_SIZE = 64;
+
+// Source size from which rotated bitmap is traversed by tiles,
+// smaller source stays in cache during row by row traversal
+const INT AA_TILE_MIN_SRC_BYTES = 2 * 1024 * 1024;
+
+// Transform destination rows [dyFrom...dyTo] by AA_TILE_SIZE square tiles.
+// Source point of rotated bitmap goes by diagonal along a row, so rows 
+// touch new source lines on every pixel. Source footprint of a tile is 
+// small and stays in cache. Every tile row starts from exact closed form 
+// stepper, so result is identical to AATransformRowsTempl.
+template <typename KERNEL, typename PIXELSRC, typename PIXELDST>
+VOID AATransformTilesTempl(
+        const BITMAP *pDstBitmap,
+        const AATRANSFORM *pTransform,
+        const AATRANSFORM_CONTEXT *pCtx,
+        INT dyFrom,
+        INT dyTo)
+{
+    ASSERT(pDstBitmap != NULL);
+    ASSERT(pTransform != NULL);
+    ASSERT(pCtx != NULL);
+
+    const RECT &rDst = pTransform->rDst;
+    INT nCount = rDst.right - rDst.left + 1;
+    if (nCount <= 0)
+        return;
+
+    AAROW_SPANS rows[AA_TILE_SIZE];
+
+    for (INT tyFrom = dyFrom ; tyFrom <= dyTo ; tyFrom += AA_TILE_SIZE)
+    {
+        INT nRows = dyTo - tyFrom + 1;
+        if (nRows > AA_TILE_SIZE)
+            nRows = AA_TILE_SIZE;
+
+        // Spans of tile rows and columns touching source by any of them
+        INT jMin = nCount, jMax = 0;
+        for (INT i=0 ; i<nRows ; ++i)
+        {
+            AAGetRowSpansTempl<KERNEL>(pTransform, pCtx, tyFrom + i, nCount, rows + i);
+            if (rows[i].jFrom < rows[i].jTo)
+            {
+                if (jMin > rows[i].jFrom)
+                    jMin = rows[i].jFrom;
+                if (jMax < rows[i].jTo)
+                    jMax = rows[i].jTo;
+            }
+        }
+
+        BYTE *pDst = (BYTE *)pDstBitmap->bmBits + tyFrom * pDstBitmap->bmWidthBytes;
+
+        for (INT txFrom = jMin ; txFrom < jMax ; txFrom += AA_TILE_SIZE)
+        {
+            BYTE *pDstRow = pDst;
+            for (INT i=0 ; i<nRows ; ++i, pDstRow += pDstBitmap->bmWidthBytes)
+            {
+                AATransformRowTempl<KERNEL, PIXELSRC>(pTransform, pCtx, rows + i, 
+                    txFrom, txFrom + AA_TILE_SIZE, (PIXELDST *)pDstRow + rDst.left);
+            }
+        }
+    }
+}
+
+// Transform destination rows [dyFrom...dyTo] by tiles or row by row
+template <typename KERNEL, typename PIXELSRC, typename PIXELDST>
+inline VOID AATransformBandTempl(
+        const BITMAP *pDstBitmap,
+        const AATRANSFORM *pTransform,
+        const AATRANSFORM_CONTEXT *pCtx,
+        INT dyFrom,
+        INT dyTo)
+{
+    if (KERNEL::ROTATION && pCtx->bTiles)
+        AATransformTilesTempl<KERNEL, PIXELSRC, PIXELDST>(pDstBitmap, pTransform, pCtx, dyFrom, dyTo);
+    else
+        AATransformRowsTempl<KERNEL, PIXELSRC, PIXELDST>(pDstBitmap, pTransform, pCtx, dyFrom, dyTo);
+}
+
+//
+// Parallel blit
+//
+
+// Minimal band height worth to be scheduled to a worker
+const INT AA_MIN_BAND_HEIGHT = 16;
+
+// Bands number per worker, more bands balance uneven rows of rotated bitmap
+const INT AA_BANDS_PER_THREAD = 4;
+
+inline INT AAGetProcessorsNumber()
+{
+    SYSTEM_INFO si = { 0 };
+    ::GetSystemInfo(&si);
+    return (si.dwNumberOfProcessors > 0) ? (INT)si.dwNumberOfProcessors : 1;
+}
+
+// AABAND_JOB struct
+// Destination rows split into horizontal bands, workers take bands
+// one by one until all of them are rendered
+template <typename KERNEL, typename PIXELSRC, typename PIXELDST>
+struct AABAND_JOB
+{
+    const BITMAP *pDstBitmap;
+    const AATRANSFORM *pTransform;
+    const AATRANSFORM_CONTEXT *pCtx;
+    INT nBandHeight;
+    LONG nBands;
+    volatile LONG nNextBand;
+
+    VOID Run()
+    {
+        for (;;)
+        {
+            LONG nBand = ::InterlockedIncrement(&nNextBand) - 1;
+            if (nBand >= nBands)
+                break;
+
+            INT dyFrom = pTransform->rDst.top + nBand * nBandHeight;
+            INT dyTo = dyFrom + nBandHeight - 1;
+            if (dyTo > pTransform->rDst.bottom)
+                dyTo = pTransform->rDst.bottom;
+
+            AATransformBandTempl<KERNEL, PIXELSRC, PIXELDST>(pDstBitmap, pTransform, pCtx, dyFrom, dyTo);
+        }
+    }
+
+    static VOID CALLBACK WorkCallback(PTP_CALLBACK_INSTANCE, PVOID pvJob, PTP_WORK)
+    {
+        ((AABAND_JOB *)pvJob)->Run();
+    }
+};
+
+// Transform destination rect by bands on system thread pool.
+// nThreads is workers number including calling thread, 0 means processors number.
+// Result is identical to single threaded AATransformBandTempl.
+template <typename KERNEL, typename PIXELSRC, typename PIXELDST>
+VOID AATransformBandsTempl(
+        const BITMAP *pDstBitmap,
+        const AATRANSFORM *pTransform,
+        const AATRANSFORM_CONTEXT *pCtx,
+        INT nThreads)
+{
+    ASSERT(pTransform != NULL);
+
+    const RECT &rDst = pTransform->rDst;
+    INT nRows = rDst.bottom - rDst.top + 1;
+
+    if (nThreads <= 0)
+        nThreads = AAGetProcessorsNumber();
+
+    if (nThreads > 1 && nRows >= 2 * AA_MIN_BAND_HEIGHT)
+    {
+        INT nBands = nThreads * AA_BANDS_PER_THREAD;
+        if (nBands > nRows / AA_MIN_BAND_HEIGHT)
+            nBands = nRows / AA_MIN_BAND_HEIGHT;
+
+        AABAND_JOB<KERNEL, PIXELSRC, PIXELDST> job;
+        job.pDstBitmap = pDstBitmap;
+        job.pTransform = pTransform;
+        job.pCtx = pCtx;
+        job.nBandHeight = (nRows + nBands - 1) / nBands;
+        if (KERNEL::ROTATION && pCtx->bTiles)
+        {
+            // Bands are whole tile rows
+            job.nBandHeight = (job.nBandHeight + AA_TILE_SIZE - 1) / AA_TILE_SIZE * AA_TILE_SIZE;
+        }
+        job.nBands = (nRows + job.nBandHeight - 1) / job.nBandHeight;
+        job.nNextBand = 0;
+
+        PTP_WORK pWork = ::CreateThreadpoolWork(&AABAND_JOB<KERNEL, PIXELSRC, PIXELDST>::WorkCallback, &job, NULL);
+        if (pWork != NULL)
+        {
+            for (INT i=1 ; i<nThreads ; ++i)
+                ::SubmitThreadpoolWork(pWork);
+
+            // Calling thread takes bands too
+            job.Run();
+
+            ::WaitForThreadpoolWorkCallbacks(pWork, FALSE);
+            ::CloseThreadpoolWork(pWork);
+            return;
+        }
+    }
+
+    AATransformBandTempl<KERNEL, PIXELSRC, PIXELDST>(pDstBitmap, pTransform, pCtx, rDst.top, rDst.bottom);
+}
+
+// Run transformation with kernels specialized for color key and rotation
+template <typename PIXELSRC, typename PIXELDST, AAFILTER nFilter>
+VOID AATransformFilterTempl(
+        const BITMAP *pDstBitmap,
+        const AATRANSFORM *pTransform,
+        const AATRANSFORM_CONTEXT *pCtx,
+        BOOL bRotation,
+        INT nThreads)
+{
+    // Premultiplied source is blended by its alpha, key kernels are not instantiated for it
+    const BOOL KEYED = !AAPIXEL_TRAITS<PIXELSRC>::PREMULTIPLIED;
+    BOOL bClrKey = (pCtx->pClrKey != NULL);
+    ASSERT(KEYED || (!bClrKey && !pCtx->bKeyMask));
+
+    if (pCtx->bKeyMask && bRotation)
+        AATransformBandsTempl<AAKERNEL<nFilter, KEYED, TRUE, KEYED>, PIXELSRC, PIXELDST>(pDstBitmap, pTransform, pCtx, nThreads);
+    else if (pCtx->bKeyMask)
+        AATransformBandsTempl<AAKERNEL<nFilter, KEYED, FALSE, KEYED>, PIXELSRC, PIXELDST>(pDstBitmap, pTransform, pCtx, nThreads);
+    else if (bClrKey && bRotation)
+        AATransformBandsTempl<AAKERNEL<nFilter, KEYED, TRUE>, PIXELSRC, PIXELDST>(pDstBitmap, pTransform, pCtx, nThreads);
+    else if (bClrKey)
+        AATransformBandsTempl<AAKERNEL<nFilter, KEYED, FALSE>, PIXELSRC, PIXELDST>(pDstBitmap, pTransform, pCtx, nThreads);
+    else if (bRotation)
+        AATransformBandsTempl<AAKERNEL<nFilter, FALSE, TRUE>, PIXELSRC, PIXELDST>(pDstBitmap, pTransform, pCtx, nThreads);
+    else
+        AATransformBandsTempl<AAKERNEL<nFilter, FALSE, FALSE>, PIXELSRC, PIXELDST>(pDstBitmap, pTransform, pCtx, nThreads);
+}
+
+// Transform (rotate/scale) bitmap and set onto destination 
+// bitmap in predefined left/top position
+template <typename PIXELSRC, typename PIXELDST>
+VOID AATransformBltTempl(
+        const BITMAP *pDstBitmap, 
+        INT nDstX,
+        INT nDstY,
+        const BITMAP *pSrcBitmap,
+        INT nSrcX,
+        INT nSrcY,
+        INT nSrcWidth,
+        INT nSrcHeight,
+        const XFORM_MATRIX *pMatrix,
+        const COLORREF *pClrKey = NULL,
+        const AASUMMEDAREATABLE *pSumTable = NULL,
+        const AAMIPMAP *pMipmap = NULL,
+        INT nThreads = 1,
+        const AAKEYMASK *pKeyMask = NULL) // pSrcBitmap is mask bitmap then
+{
+    ASSERT(pMatrix != NULL);
+    ASSERT(pDstBitmap != NULL);
+    ASSERT(pDstBitmap->bmBits != NULL);
+    ASSERT(pSrcBitmap != NULL);
+    ASSERT(pSrcBitmap->bmBits != NULL);
+    ASSERT(pSrcBitmap->bmBitsPixel == sizeof(PIXELSRC) * 8);
+    ASSERT(pKeyMask == NULL || (pSrcBitmap == &pKeyMask->bmMask && pClrKey != NULL));
+    ASSERT(pDstBitmap->bmBitsPixel == sizeof(PIXELDST) * 8);
+
+    // Destination bitmap
+    INT nDstBitmapWidth = pDstBitmap->bmWidth;
+    INT nDstBitmapHeight = pDstBitmap->bmHeight;
+
+    // Source bitmap
+    INT nSrcBitmapWidth = pSrcBitmap->bmWidth;
+    INT nSrcBitmapHeight = pSrcBitmap->bmHeight;
+    INT nSrcBitmapWidthBytes = pSrcBitmap->bmWidthBytes;
+
+    // Override matrix for adjust eDx and eDy for matrix
+    // Since bitmap transformed from src to dst then eDx and eDy shoul be:
+    XFORM_MATRIX matrix(*pMatrix);
+    matrix.eDx = nDstX - nSrcX;
+    matrix.eDy = nDstY - nSrcY;
+    pMatrix = &matrix;
+
+    // Calculation destination position
+    RECT rDst = { 0 };
+    RECT rSrc = { nSrcX-1, nSrcY-1, nSrcX+nSrcWidth+1, nSrcY+nSrcHeight+1 };
+    AAGetTransformationBoundBox(&rSrc, pMatrix, &rDst);
+    if (rDst.left < 0)
+        rDst.left = 0;
+    if (rDst.top < 0)
+        rDst.top = 0;
+    if (rDst.right >= nDstBitmapWidth)
+        rDst.right = nDstBitmapWidth - 1;
+    if (rDst.bottom >= nDstBitmapHeight)
+        rDst.bottom = nDstBitmapHeight - 1;
+
+    // Ratio source size to destination size
+    // Scaling/rotation matrix is:
+    // | ( cos x kx) (sin x ky) ... |  i.e. | m00 m01 ... |
+    // | (-sin x kx) (cos x ky) ... |       | m10 m10 ... |
+    // | ...                    ... |       | ...         |
+    // i.e.
+    // kx = sqrt( m00 x m00 + m10 x m10 )
+    // ky = sqrt( m01 x m01 + m11 x m11 )
+    double kx = 1.0 / sqrt( matrix.eM11 * matrix.eM11 + matrix.eM21 * matrix.eM21 ); // src pixel per one dst pixel 
+    double ky = 1.0 / sqrt( matrix.eM12 * matrix.eM12 + matrix.eM22 * matrix.eM22 ); // src pixel per one dst pixel 
+
+    // Averaging points number
+    INT nAvrSrcX = (INT)kx; 
+    INT nAvrSrcY = (INT)ky; 
+    if (kx > nAvrSrcX)
+        nAvrSrcX += 1;
+    if (ky > nAvrSrcY)
+        nAvrSrcY += 1;
+
+    // Transformation is
+    const double &eM11 = pMatrix->eM11;
+    const double &eM12 = pMatrix->eM12;
+    const double &eM21 = pMatrix->eM21;
+    const double &eM22 = pMatrix->eM22;
+    const double &eDx  = pMatrix->eDx;
+    const double &eDy  = pMatrix->eDy;
+
+    // Transformation formula is:
+    // dx = sx * eM11 + sy * eM21 + eDx
+    // dy = sx * eM12 + sy * eM22 + eDy
+    // for case eM21 = eM12 = 0 
+    // dx = sx * eM11 + eDx
+    // dy = sy * eM22 + eDy
+
+    // Revert transformation formula is:
+    // sx = (eM21 * (dy - eDy) - eM22 * (dx - eDx)) / (eM12 * eM21 - eM11 * eM22)
+    // sy = (dx - eDx) / eM21 - sx * eM11 / eM21
+    // for case eM21 = eM12 = 0 
+    // sx = (dx - eDx) / eM11
+    // sy = (dy - eDy) / eM22
+    // Precalculates are:
+    double d  = eM12 * eM21 - eM11 * eM22;
+    double a1 = eM21 / d;
+    double a2 = eM22 / d;
+    double b1 = eDx * a2 - eDy * a1;
+    double e1 = eM11 / eM21;
+    double e2 = eDx / eM21;
+    double a3 = (e1 * a2 + 1.0 / eM21);
+    double a4 = e1 * a1;
+    double b2 = e2 + e1 * b1;
+    // Therefore formula is:
+    // sx = a1 * dy - a2 * dx + b1
+    // sy = a3 * dx - a4 * dy - b2
+    double a5 = eDx / eM11;
+    double a6 = eDy / eM22;
+    double a7 = 1.0 / eM11;
+    double a8 = 1.0 / eM22;
+    // Therefore formula for case without rotation is:
+    // sx = dx * a7 - a5
+    // sy = dy * a8 - a6
+  
+    BOOL bNoRotation = (eM21 >= -1e-6 && eM21 <= 1e-6);
+    ASSERT((eM21 >= -1e-6 && eM21 <= 1e-6) == (eM12 >= -1e-6 && eM12 <= 1e-6));
+
+    BOOL bPixelBilinear = (kx <= AA_CHUNK_FILTER_RATIO && ky <= AA_CHUNK_FILTER_RATIO);
+        // Two cases diffently handled:
+        // 1. Pixel bilinear filtering
+        //    when source is smaller than destination (S < D)
+        // 2. Chuncks bilinear filtering
+        //    when source is bigger than destination (S > D)
+
+    const BYTE *pSrc = (const BYTE *)pSrcBitmap->bmBits;
+
+    // Scaling ratio
+    const INT iSHIFT = AA_FIXED_SHIFT;
+    const INT iSCALE = AA_FIXED_SCALE;
+    const double dSCALE = (double)iSCALE;
+
+    // Pixel kernels context
+    AATRANSFORM_CONTEXT ctx;
+    ctx.pSrcBitmap = pSrcBitmap;
+    ctx.pSrc = pSrc;
+    ctx.nSrcWidthBytes = nSrcBitmapWidthBytes;
+    ctx.nSrcWidthScaled = (nSrcBitmapWidth << iSHIFT);
+    ctx.nSrcHeightScaled = (nSrcBitmapHeight << iSHIFT);
+    ctx.nSrcLastAvailIndexX = nSrcBitmapWidth-1;
+    ctx.nSrcLastAvailIndexY = nSrcBitmapHeight-1;
+    ctx.kx = kx;
+    ctx.ky = ky;
+    ctx.nAvrSrcX = nAvrSrcX;
+    ctx.nAvrSrcY = nAvrSrcY;
+    ctx.nFilter = bPixelBilinear ? AA_FILTER_BILINEAR : AA_FILTER_CHUNKS;
+    ctx.bKeyMask = (pKeyMask != NULL);
+    ctx.pClrKey = pClrKey;
+    ctx.pSumTable = NULL;
+    ctx.pMipmap = NULL;
+    ctx.nMipLevel = 0;
+    ctx.nMipFrac = 0;
+    // Tables hold straight colors without alpha, premultiplied source averages chunks itself
+    const BOOL bTables = !bPixelBilinear && !AAPIXEL_TRAITS<PIXELSRC>::PREMULTIPLIED;
+    if (bTables && AAIsMipmapApplicable(pMipmap, pSrcBitmap, pClrKey))
+    {
+        ctx.nFilter = AA_FILTER_MIPMAP;
+        ctx.pMipmap = pMipmap;
+        AAGetMipmapLevel(pMipmap, kx, ky, &ctx.nMipLevel, &ctx.nMipFrac);
+    }
+    else if (bTables && AAIsSummedAreaTableApplicable(pSumTable, pSrcBitmap, pClrKey))
+    {
+        ctx.nFilter = AA_FILTER_SUMMEDAREA;
+        ctx.pSumTable = pSumTable;
+    }
+
+    // Vectorized kernel handles pixel bilinear filtering of plain source or key mask
+    ctx.bSimd = (bPixelBilinear && (pClrKey == NULL || ctx.bKeyMask) && AABilinearSSE2<PIXELSRC, PIXELDST>::IsSupported());
+
+    // Large source misses cache by row traversal of rotated bitmap
+    ctx.bTiles = !bNoRotation && 
+        ((double)nSrcBitmapWidthBytes * (double)nSrcBitmapHeight >= (double)AA_TILE_MIN_SRC_BYTES);
+
+    INT sxFrom = 0, syFrom = 0; // start for sx and sy per dy
+    INT sxStep = 0, syStep = 0; // step for sx and sy per dx
+    INT sxNext = 0, syNext = 0; // step for sx and sy per dy
+    INT rxStep = 0, ryStep = 0; // remainder for step per dx
+    INT rxNext = 0, ryNext = 0; // remainder for step per dy
+    INT rxFrom = 0, ryFrom = 0; // remainder of from point
+
+    // Remainder compensators
+    INT sxStepCorr = 1, syStepCorr = 1;
+    INT sxNextCorr = 1, syNextCorr = 1;
+
+    if (bNoRotation)
+    {
+        // sx = dx * a7 - a5
+        // sy = dy * a8 - a6
+        double fxFrom = ((double)(rDst.left) * a7 - a5) * dSCALE + 1e-6;
+        double fyFrom = ((double)(rDst.top) * a8 - a6) * dSCALE + 1e-6;
+        double fxStep = a7 * dSCALE;
+        double fyNext = a8 * dSCALE;
+
+        sxFrom = (INT)(fxFrom); 
+        syFrom = (INT)(fyFrom);
+        sxStep = (INT)(fxStep);
+        syStep = 0;
+        syNext = (INT)(fyNext);
+        sxNext = 0;
+        rxStep = (INT)((fxStep - (double)sxStep) * dSCALE);
+        ryNext = (INT)((fyNext - (double)syNext) * dSCALE);
+        rxFrom = (INT)((fxFrom - (double)sxFrom) * dSCALE);
+        ryFrom = (INT)((fyFrom - (double)syFrom) * dSCALE);
+    }
+    else
+    {
+        // sx = a1 * dy - a2 * dx + b1
+        // sy = a3 * dx - a4 * dy - b2
+        double fxFrom = ((a1 * (double)(rDst.top) + b1) - a2 * (double)(rDst.left)) * dSCALE;
+        double fyFrom = (a3 * (double)(rDst.left) - (b2 + a4 * (double)(rDst.top))) * dSCALE;
+        double fxStep = -a2 * dSCALE; // step per one dx 
+        double fxNext = a1 * dSCALE;  // step per one dy
+        double fyStep = a3 * dSCALE;  // step per one dx
+        double fyNext = -a4 * dSCALE; // step per one dy
+
+        sxFrom = (INT)(fxFrom);
         syFrom = (INT)(fyFrom); 
         sxStep = (INT)(fxStep); 
         syStep = (INT)(fyStep); 
@@ -474,169 +2415,697 @@ VOID AATransformBltTempl(
         ryFrom = (INT)((fyFrom - (double)syFrom) * dSCALE);
     }
 
-    if (rxFrom < 0)
-        sxFrom -= 1, rxFrom += iSCALE;
-    if (ryFrom < 0)
-        syFrom -= 1, ryFrom += iSCALE;
-    if (rxStep < 0)
-        rxStep = -rxStep, sxStepCorr = -1;
-    if (ryStep < 0)
-        ryStep = -ryStep, syStepCorr = -1;
-    if (rxNext < 0)
-        rxNext = -rxNext, sxNextCorr = -1;
-    if (ryNext < 0)
-        ryNext = -ryNext, syNextCorr = -1;
+    if (rxFrom < 0)
+        sxFrom -= 1, rxFrom += iSCALE;
+    if (ryFrom < 0)
+        syFrom -= 1, ryFrom += iSCALE;
+    if (rxStep < 0)
+        rxStep = -rxStep, sxStepCorr = -1;
+    if (ryStep < 0)
+        ryStep = -ryStep, syStepCorr = -1;
+    if (rxNext < 0)
+        rxNext = -rxNext, sxNextCorr = -1;
+    if (ryNext < 0)
+        ryNext = -ryNext, syNextCorr = -1;
+
+    // Fixed point stepping
+    AATRANSFORM t;
+    t.rDst = rDst;
+    t.sxFrom = sxFrom, t.syFrom = syFrom;
+    t.sxStep = sxStep, t.syStep = syStep;
+    t.sxNext = sxNext, t.syNext = syNext;
+    t.rxStep = rxStep, t.ryStep = ryStep;
+    t.rxNext = rxNext, t.ryNext = ryNext;
+    t.rxFrom = rxFrom, t.ryFrom = ryFrom;
+    t.sxStepCorr = sxStepCorr, t.syStepCorr = syStepCorr;
+    t.sxNextCorr = sxNextCorr, t.syNextCorr = syNextCorr;
+
+    // Kernels are chosen once per blit, table kernels are not instantiated
+    // for premultiplied source since they leave alpha unset
+    const AAFILTER TABLE_SUMMEDAREA = AAPIXEL_TRAITS<PIXELSRC>::PREMULTIPLIED ? AA_FILTER_CHUNKS : AA_FILTER_SUMMEDAREA;
+    const AAFILTER TABLE_MIPMAP = AAPIXEL_TRAITS<PIXELSRC>::PREMULTIPLIED ? AA_FILTER_CHUNKS : AA_FILTER_MIPMAP;
+    switch (ctx.nFilter)
+    {
+    case AA_FILTER_BILINEAR:
+        AATransformFilterTempl<PIXELSRC, PIXELDST, AA_FILTER_BILINEAR>(pDstBitmap, &t, &ctx, !bNoRotation, nThreads);
+        break;
+    case AA_FILTER_CHUNKS:
+        AATransformFilterTempl<PIXELSRC, PIXELDST, AA_FILTER_CHUNKS>(pDstBitmap, &t, &ctx, !bNoRotation, nThreads);
+        break;
+    case AA_FILTER_SUMMEDAREA:
+        AATransformFilterTempl<PIXELSRC, PIXELDST, TABLE_SUMMEDAREA>(pDstBitmap, &t, &ctx, !bNoRotation, nThreads);
+        break;
+    case AA_FILTER_MIPMAP:
+        AATransformFilterTempl<PIXELSRC, PIXELDST, TABLE_MIPMAP>(pDstBitmap, &t, &ctx, !bNoRotation, nThreads);
+        break;
+    default:
+        ASSERT(FALSE);
+        break;
+    }
+}
+
+//
+// Procedural frame
+//
+
+// AAFRAME struct
+// Frame of nWidth x nHeight pixels, it is drawn as AATransformBlt draws 
+// framed bitmap but bitmap itself is not needed. Outer line of pixels is 
+// clrBorder, the rest is clrFrame. Hole is in frame pixels too, it is left 
+// untouched since source is drawn there later.
+struct AAFRAME
+{
+    INT nWidth;
+    INT nHeight;
+    double dHoleLeft;
+    double dHoleTop;
+    double dHoleRight;
+    double dHoleBottom;
+    COLORREF clrFrame;
+    COLORREF clrBorder;
+};
+
+// Intersect [*pdFrom...*pdTo) with interval of x where dFrom < a + b * x < dTo
+inline VOID AAIntersectLinearInterval(
+        double a, 
+        double b, 
+        double dFrom, 
+        double dTo, 
+        double *pdFrom, 
+        double *pdTo)
+{
+    if (dFrom >= dTo)
+    {
+        *pdTo = *pdFrom; // empty
+        return;
+    }
+    if (b > -1e-12 && b < 1e-12)
+    {
+        if (a <= dFrom || a >= dTo)
+            *pdTo = *pdFrom; // empty
+        return;
+    }
+
+    double x0 = (dFrom - a) / b;
+    double x1 = (dTo - a) / b;
+    if (x0 > x1)
+    {
+        double x = x0;
+        x0 = x1;
+        x1 = x;
+    }
+    if (*pdFrom < x0)
+        *pdFrom = x0;
+    if (*pdTo > x1)
+        *pdTo = x1;
+}
 
-    // Accumulative remainder
-    INT rxNextAcc = rxFrom, ryNextAcc = ryFrom;
+// Blend frame color of frame point u, v into destination.
+// dUScale and dVScale are destination pixels per frame pixel across u and v lines.
+template <typename PIXELDST>
+inline VOID AAFramePixel(
+        const AAFRAME *pFrame,
+        double u,
+        double v,
+        double dUScale,
+        double dVScale,
+        PIXELDST *pDstPixel)
+{
+    // Distance to frame edge in destination pixels, as for bitmap 
+    // pixels [0...width-1] are opaque and edge fades out in one pixel
+    double d = u * dUScale;
+    double d1 = (pFrame->nWidth - 1 - u) * dUScale;
+    if (d > d1)
+        d = d1;
+    d1 = v * dVScale;
+    if (d > d1)
+        d = d1;
+    d1 = (pFrame->nHeight - 1 - v) * dVScale;
+    if (d > d1)
+        d = d1;
+    if (d <= -1.0)
+        return;
+
+    // Border fades into frame inside its one pixel line
+    INT nFrame = (d >= 1.0) ? 255 : (d <= 0.0) ? 0 : (INT)(d * 255.0 + 0.5);
+    INT nBorder = 255 - nFrame;
+    INT nRed   = AADiv255(GetRValue(pFrame->clrBorder) * nBorder + GetRValue(pFrame->clrFrame) * nFrame);
+    INT nGreen = AADiv255(GetGValue(pFrame->clrBorder) * nBorder + GetGValue(pFrame->clrFrame) * nFrame);
+    INT nBlue  = AADiv255(GetBValue(pFrame->clrBorder) * nBorder + GetBValue(pFrame->clrFrame) * nFrame);
+
+    INT nAlpha = (d >= 0.0) ? 255 : (INT)((1.0 + d) * 255.0 + 0.5);
+    if (nAlpha == 255)
+    {
+        pDstPixel->Red   = (BYTE)nRed;
+        pDstPixel->Green = (BYTE)nGreen;
+        pDstPixel->Blue  = (BYTE)nBlue;
+    }
+    else
+    {
+        INT nOneMinusAlpha = 255 - nAlpha;
+        pDstPixel->Red   = (BYTE)AADiv255(pDstPixel->Red   * nOneMinusAlpha + nRed   * nAlpha);
+        pDstPixel->Green = (BYTE)AADiv255(pDstPixel->Green * nOneMinusAlpha + nGreen * nAlpha);
+        pDstPixel->Blue  = (BYTE)AADiv255(pDstPixel->Blue  * nOneMinusAlpha + nBlue  * nAlpha);
+    }
+}
 
-    for (INT dy = rDst.top ; dy <= rDst.bottom ; ++dy, pDst += nDstBitmapWidthBytes)
-    {   
-        // Remainder compensation
-        rxNextAcc += rxNext; 
-        ryNextAcc += ryNext;
-        if (rxNextAcc >= iSCALE)
-            rxNextAcc -= iSCALE, sxFrom += sxNextCorr;
-        if (ryNextAcc >= iSCALE)
-            ryNextAcc -= iSCALE, syFrom += syNextCorr;
+// Draw frame transformed by matrix (frame pixels to destination ones,
+// eDx and eDy are included). Only frame pixels are visited: row spans 
+// of frame and its hole are solved from the reverted transformation.
+template <typename PIXELDST>
+VOID AAFrameBltTempl(
+        const BITMAP *pDstBitmap,
+        const AAFRAME *pFrame,
+        const XFORM_MATRIX *pMatrix)
+{
+    ASSERT(pDstBitmap != NULL);
+    ASSERT(pDstBitmap->bmBits != NULL);
+    ASSERT(pDstBitmap->bmBitsPixel == sizeof(PIXELDST) * 8);
+    ASSERT(pFrame != NULL);
+    ASSERT(pMatrix != NULL);
 
-        INT sx = sxFrom, sy = syFrom;
+    const double &eM11 = pMatrix->eM11;
+    const double &eM12 = pMatrix->eM12;
+    const double &eM21 = pMatrix->eM21;
+    const double &eM22 = pMatrix->eM22;
+    const double &eDx  = pMatrix->eDx;
+    const double &eDy  = pMatrix->eDy;
 
-        // Accumulative remainder
-        INT rxStepAcc = rxNextAcc, ryStepAcc = ryNextAcc;
+    double d = eM11 * eM22 - eM12 * eM21;
+    if (d > -1e-12 && d < 1e-12)
+        return;
 
-        PIXELDST *pDstPixel = (PIXELDST *)pDst + rDst.left;
+    // Revert transformation formula is:
+    // u = (dx - eDx) * iM11 + (dy - eDy) * iM21
+    // v = (dx - eDx) * iM12 + (dy - eDy) * iM22
+    double iM11 =  eM22 / d;
+    double iM21 = -eM21 / d;
+    double iM12 = -eM12 / d;
+    double iM22 =  eM11 / d;
+
+    // Destination pixels per frame pixel across u and v lines
+    double dUScale = 1.0 / sqrt(iM11 * iM11 + iM21 * iM21);
+    double dVScale = 1.0 / sqrt(iM12 * iM12 + iM22 * iM22);
+
+    // Frame with its fading edge
+    double dWidth = (double)pFrame->nWidth;
+    double dHeight = (double)pFrame->nHeight;
+    RECT rFrame = { -2, -2, pFrame->nWidth + 1, pFrame->nHeight + 1 };
+    RECT rDst;
+    AAGetTransformationBoundBox(&rFrame, pMatrix, &rDst);
+    if (rDst.left < 0)
+        rDst.left = 0;
+    if (rDst.top < 0)
+        rDst.top = 0;
+    if (rDst.right > pDstBitmap->bmWidth - 1)
+        rDst.right = pDstBitmap->bmWidth - 1;
+    if (rDst.bottom > pDstBitmap->bmHeight - 1)
+        rDst.bottom = pDstBitmap->bmHeight - 1;
 
-        for (INT dx = rDst.left ; dx <= rDst.right ; ++dx, ++pDstPixel)
+    for (INT y=rDst.top ; y<=rDst.bottom ; ++y)
+    {
+        // u = a + b * x and v = c + e * x along the row
+        double a = (0.0 - eDx) * iM11 + ((double)y - eDy) * iM21;
+        double b = iM11;
+        double c = (0.0 - eDx) * iM12 + ((double)y - eDy) * iM22;
+        double e = iM12;
+
+        double xFrom = (double)rDst.left, xTo = (double)rDst.right + 1.0;
+        AAIntersectLinearInterval(a, b, -1.0 / dUScale, dWidth - 1.0 + 1.0 / dUScale, &xFrom, &xTo);
+        AAIntersectLinearInterval(c, e, -1.0 / dVScale, dHeight - 1.0 + 1.0 / dVScale, &xFrom, &xTo);
+        if (xFrom >= xTo)
+            continue;
+
+        double xHoleFrom = xFrom, xHoleTo = xTo;
+        AAIntersectLinearInterval(a, b, pFrame->dHoleLeft, pFrame->dHoleRight, &xHoleFrom, &xHoleTo);
+        AAIntersectLinearInterval(c, e, pFrame->dHoleTop, pFrame->dHoleBottom, &xHoleFrom, &xHoleTo);
+
+        // Columns [jFrom...jTo) touch frame, [jHoleFrom...jHoleTo) are inside hole
+        INT jFrom = (INT)floor(xFrom);
+        INT jTo = (INT)ceil(xTo);
+        INT jHoleFrom = (INT)ceil(xHoleFrom);
+        INT jHoleTo = (INT)floor(xHoleTo);
+        if (jFrom < rDst.left)
+            jFrom = rDst.left;
+        if (jTo > rDst.right + 1)
+            jTo = rDst.right + 1;
+        if (jHoleFrom >= jHoleTo)
+            jHoleFrom = jHoleTo = jTo;
+
+        PIXELDST *pRow = (PIXELDST *)((BYTE *)pDstBitmap->bmBits + y * pDstBitmap->bmWidthBytes);
+        for (INT j=jFrom ; j<jTo ; ++j)
         {
-            // Remainder compensation
-            rxStepAcc += rxStep;
-            ryStepAcc += ryStep;
-            if (rxStepAcc >= iSCALE)
-                rxStepAcc -= iSCALE, sx += sxStepCorr;
-            if (ryStepAcc >= iSCALE)
-                ryStepAcc -= iSCALE, sy += syStepCorr;
-
-            if (sx > -iSCALE && sy > -iSCALE && sx < nSrcBitmapWidthScaled && sy < nSrcBitmapHeightScaled)
+            if (j == jHoleFrom)
             {
-                INT x = sx >> iSHIFT; // source point X
-                INT y = sy >> iSHIFT; // source point Y
+                j = jHoleTo - 1;
+                continue;
+            }
+            AAFramePixel(pFrame, a + b * j, c + e * j, dUScale, dVScale, pRow + j);
+        }
+    }
+}
+
+//
+// Separable resampling
+//
+
+// Filters of axis-aligned resampling
+enum AARESAMPLE
+{
+    AA_RESAMPLE_BOX,        // box, source pixels covered by destination pixel are averaged
+    AA_RESAMPLE_TRIANGLE,   // triangle (tent), linear interpolation
+    AA_RESAMPLE_LANCZOS3    // windowed sinc of 3 lobes, sharpest
+};
+
+// Fixed point of resampling weights, weights of destination pixel sum to AA_RESAMPLE_ONE
+const INT AA_RESAMPLE_SHIFT = 14;
+const INT AA_RESAMPLE_ONE = (1 << AA_RESAMPLE_SHIFT);
+
+// AARESAMPLE_TABLE struct
+// Weights of source pixels along one axis. Destination pixel i is sum of 
+// source pixels pFrom[i]...pFrom[i]+pCount[i]-1 with weights pWeights[i*nTaps]...
+struct AARESAMPLE_TABLE
+{
+    INT nSize;      // destination pixels number
+    INT nTaps;      // weights stored per destination pixel
+    INT *pFrom;     // first source pixel
+    INT *pCount;    // source pixels number
+    INT *pWeights;  // fixed point weights, negative for Lanczos lobes
+};
+
+// Filter radius in source pixels at scale 1:1
+inline double AAGetResampleSupport(
+        AARESAMPLE nResample)
+{
+    switch (nResample)
+    {
+    case AA_RESAMPLE_BOX:
+        return 0.5;
+    case AA_RESAMPLE_TRIANGLE:
+        return 1.0;
+    case AA_RESAMPLE_LANCZOS3:
+        return 3.0;
+    default:
+        ASSERT(FALSE);
+        return 1.0;
+    }
+}
 
-                ASSERT(x >= -1 && x < nSrcBitmapWidth);
-                ASSERT(y >= -1 && y < nSrcBitmapHeight);
+// Filter value at distance x from destination pixel center
+inline double AAGetResampleWeight(
+        AARESAMPLE nResample,
+        double x)
+{
+    const double dPI = 3.14159265358979323846;
+
+    switch (nResample)
+    {
+    case AA_RESAMPLE_BOX:
+        // Half open, touching pixels are not counted twice
+        return (x >= -0.5 && x < 0.5) ? 1.0 : 0.0;
+    case AA_RESAMPLE_TRIANGLE:
+        if (x < 0.0)
+            x = -x;
+        return (x < 1.0) ? 1.0 - x : 0.0;
+    case AA_RESAMPLE_LANCZOS3:
+        if (x < 0.0)
+            x = -x;
+        if (x >= 3.0)
+            return 0.0;
+        if (x < 1e-8)
+            return 1.0;
+        x *= dPI;
+        return 3.0 * sin(x) * sin(x / 3.0) / (x * x);
+    default:
+        ASSERT(FALSE);
+        return 0.0;
+    }
+}
+
+inline VOID AADeleteResampleTable(
+        AARESAMPLE_TABLE *pTable)
+{
+    ASSERT(pTable != NULL);
+
+    free(pTable->pFrom);
+    free(pTable->pCount);
+    free(pTable->pWeights);
+    memset(pTable, 0, sizeof(AARESAMPLE_TABLE));
+}
+
+// Create weights of nDstSize pixels resampled from source pixels nSrcFrom...nSrcFrom+nSrcSize-1.
+// Filter is widened by downscaling ratio, so every source pixel contributes.
+// Window is cut by source edges and renormalized, edge pixels are not darkened.
+// Table must be released by AADeleteResampleTable.
+inline BOOL AACreateResampleTable(
+        INT nSrcFrom,
+        INT nSrcSize,
+        INT nDstSize,
+        AARESAMPLE nResample,
+        AARESAMPLE_TABLE *pTable)
+{
+    ASSERT(nSrcSize > 0 && nDstSize > 0);
+    ASSERT(pTable != NULL);
+
+    double dScale = (double)nSrcSize / (double)nDstSize; // src pixel per one dst pixel
+    double dFilterScale = (dScale > 1.0) ? dScale : 1.0;
+    double dSupport = AAGetResampleSupport(nResample) * dFilterScale;
+
+    pTable->nSize = nDstSize;
+    pTable->nTaps = (INT)ceil(dSupport) * 2 + 1;
+    pTable->pFrom = (INT *)malloc(nDstSize * sizeof(INT));
+    pTable->pCount = (INT *)malloc(nDstSize * sizeof(INT));
+    pTable->pWeights = (INT *)malloc((size_t)nDstSize * (size_t)pTable->nTaps * sizeof(INT));
+    double *pdWeights = (double *)malloc(pTable->nTaps * sizeof(double));
+    if (pTable->pFrom == NULL || pTable->pCount == NULL || pTable->pWeights == NULL || pdWeights == NULL)
+    {
+        free(pdWeights);
+        AADeleteResampleTable(pTable);
+        return FALSE;
+    }
+
+    for (INT i=0 ; i<nDstSize ; ++i)
+    {
+        double dCenter = ((double)i + 0.5) * dScale;
+        INT nMin = (INT)floor(dCenter - dSupport + 0.5);
+        INT nMax = (INT)floor(dCenter + dSupport + 0.5);
+        if (nMin < 0)
+            nMin = 0;
+        if (nMax > nSrcSize)
+            nMax = nSrcSize;
+        ASSERT(nMax - nMin <= pTable->nTaps);
+
+        double dSum = 0.0;
+        for (INT j=nMin ; j<nMax ; ++j)
+        {
+            pdWeights[j-nMin] = AAGetResampleWeight(nResample, ((double)j - dCenter + 0.5) / dFilterScale);
+            dSum += pdWeights[j-nMin];
+        }
+
+        // Zero weights of window ends are dropped
+        INT nFirst = 0, nCount = nMax - nMin;
+        while (nCount > 0 && pdWeights[nFirst] == 0.0)
+            ++nFirst, --nCount;
+        while (nCount > 0 && pdWeights[nFirst+nCount-1] == 0.0)
+            --nCount;
+
+        INT *pWeights = pTable->pWeights + (size_t)i * pTable->nTaps;
+        if (nCount == 0 || dSum == 0.0)
+        {
+            // Nearest source pixel
+            INT nNearest = (INT)dCenter;
+            pTable->pFrom[i] = nSrcFrom + ((nNearest < nSrcSize) ? nNearest : nSrcSize - 1);
+            pTable->pCount[i] = 1;
+            pWeights[0] = AA_RESAMPLE_ONE;
+            continue;
+        }
+
+        // Rounding error goes to the largest weight, so flat color stays exact
+        INT nTotal = 0, nLargest = 0;
+        for (INT j=0 ; j<nCount ; ++j)
+        {
+            double dWeight = pdWeights[nFirst+j] / dSum * (double)AA_RESAMPLE_ONE;
+            pWeights[j] = (INT)floor(dWeight + 0.5);
+            nTotal += pWeights[j];
+            if (pWeights[j] > pWeights[nLargest])
+                nLargest = j;
+        }
+        pWeights[nLargest] += AA_RESAMPLE_ONE - nTotal;
+
+        pTable->pFrom[i] = nSrcFrom + nMin + nFirst;
+        pTable->pCount[i] = nCount;
+    }
+
+    free(pdWeights);
+    return TRUE;
+}
+
+// Fixed point channel sum to color component
+inline BYTE AAClampResampled(
+        INT nValue)
+{
+    nValue = (nValue + (AA_RESAMPLE_ONE >> 1)) >> AA_RESAMPLE_SHIFT;
+    return (BYTE)( (nValue < 0) ? 0 : ((nValue > 255) ? 255 : nValue) );
+}
+
+// AARESAMPLE_JOB struct
+// Horizontal pass resamples source rows into 32bpp intermediate bitmap of
+// destination width, vertical pass resamples its columns into destination.
+// Both passes are split into bands of rows, workers take bands one by one.
+template <typename PIXELSRC, typename PIXELDST>
+struct AARESAMPLE_JOB
+{
+    const BITMAP *pDstBitmap;
+    const BITMAP *pSrcBitmap;
+    const BITMAP *pTmpBitmap;
+    const AARESAMPLE_TABLE *pTableX;
+    const AARESAMPLE_TABLE *pTableY;
+    INT nDstX;          // destination of table pixel 0
+    INT nDstY;
+    INT nDstHeight;
+    INT dxFrom;         // visible destination columns, dxFrom is column 0 of intermediate
+    INT dxTo;
+    INT dyFrom;         // visible destination rows
+    INT dyTo;
+    INT syFrom;         // source rows of intermediate, syFrom is its row 0
+    INT syTo;
+    BOOL bInvertYSrc;
+    BOOL bVertical;     // pass of bands
+    INT nBandHeight;
+    LONG nBands;
+    volatile LONG nNextBand;
+
+    // Source rows syBandFrom...syBandTo-1 to intermediate
+    VOID ResampleRows(INT syBandFrom, INT syBandTo) const
+    {
+        const BYTE *pSrc = (const BYTE *)pSrcBitmap->bmBits;
+        BYTE *pTmp = (BYTE *)pTmpBitmap->bmBits;
+
+        for (INT sy=syBandFrom ; sy<syBandTo ; ++sy)
+        {
+            const PIXELSRC *pSrcRow = (const PIXELSRC *)(pSrc + (size_t)sy * pSrcBitmap->bmWidthBytes);
+            RGB32 *pTmpPixel = (RGB32 *)(pTmp + (size_t)(sy - syFrom) * pTmpBitmap->bmWidthBytes);
+
+            for (INT dx=dxFrom ; dx<dxTo ; ++dx, ++pTmpPixel)
+            {
+                INT i = dx - nDstX;
+                const PIXELSRC *pSrcPixel = pSrcRow + pTableX->pFrom[i];
+                const INT *pWeights = pTableX->pWeights + (size_t)i * pTableX->nTaps;
+                INT nCount = pTableX->pCount[i];
 
-                if (bPixelBilinear)
+                INT nRed = 0, nGreen = 0, nBlue = 0;
+                for (INT k=0 ; k<nCount ; ++k, ++pSrcPixel)
                 {
-                    // Blending nearest pixels
-                    // Destination point placed inside 0 area
-
-                    INT du  = (sx % iSCALE) >> (iSHIFT - 8); 
-                    INT dv  = (sy % iSCALE) >> (iSHIFT - 8);
-                    if (du < 0)
-                        du += iSCALE;
-                    if (dv < 0)
-                        dv += iSCALE;
-                    INT dui = 255 - du;
-                    INT dvi = 255 - dv;
-
-                    INT a = dui * dvi; // blending coefficient for pixel 1    a b
-                    INT b = du  * dvi; // blending coefficient for pixel 2    c d
-                    INT c = dui * dv;  // blending coefficient for pixel 3
-                    INT d = du  * dv;  // blending coefficient for pixel 4
-
-                    // Source pixels 1, 2, 3 and 4
-                    const PIXELSRC *p1 = (const PIXELSRC *)(pSrc + y * nSrcBitmapWidthBytes) + x; // row 0
-                    const PIXELSRC *p3 = (const PIXELSRC *)((BYTE *)p1 + nSrcBitmapWidthBytes);   // row 1
-                    if (y == -1)
-                        p1 = p3, a = 0, b = 0;
-                    else if (y == nSrcLastAvailIndexY)
-                        p3 = p1, c = 0, d = 0;
-                    const PIXELSRC *p2 = p1 + 1; // col 0
-                    const PIXELSRC *p4 = p3 + 1; // col 1
-                    if (x == -1)
-                        p1 = p2, p3 = p4, a = 0, c = 0;
-                    else if (x == nSrcLastAvailIndexX)
-                        p2 = p1, p4 = p3, b = 0, d = 0;
-
-                    if (pClrKey != NULL)
-                    {
-                        COLORREF clrKey = *pClrKey;
-                        if (*p1 == clrKey)
-                            a = 0;
-                        if (*p2 == clrKey)
-                            b = 0;
-                        if (*p3 == clrKey)
-                            c = 0;
-                        if (*p4 == clrKey)
-                            d = 0;
-                    }
-
-                    INT ratio = a + b + c + d;
-
-                    // Calculation transparency
-                    // 0 fully transparent, 255 fully opaque
-                    INT bAlpha = (INT)( ratio / 255 );
-
-                    if (bAlpha > 0)
-                    {
-                        BYTE Red   = (BYTE)( ( p1->Red   * a + p2->Red   * b + p3->Red   * c + p4->Red   * d ) / ratio );
-                        BYTE Green = (BYTE)( ( p1->Green * a + p2->Green * b + p3->Green * c + p4->Green * d ) / ratio );
-                        BYTE Blue  = (BYTE)( ( p1->Blue  * a + p2->Blue  * b + p3->Blue  * c + p4->Blue  * d ) / ratio );
-
-                        if (bAlpha == 255)
-                        {
-                            pDstPixel->Red = Red;
-                            pDstPixel->Green = Green;
-                            pDstPixel->Blue = Blue;
-                        } 
-                        else 
-                        {
-                            ASSERT(bAlpha > 0 && bAlpha < 255);
-                            INT bOneMinusAlpha = 255 - bAlpha;
-                            pDstPixel->Red   = (BYTE)( (pDstPixel->Red   * bOneMinusAlpha + Red   * bAlpha) >> 8 );
-                            pDstPixel->Green = (BYTE)( (pDstPixel->Green * bOneMinusAlpha + Green * bAlpha) >> 8 );
-                            pDstPixel->Blue  = (BYTE)( (pDstPixel->Blue  * bOneMinusAlpha + Blue  * bAlpha) >> 8 );
-                        }
-                    }
+                    nRed   += pSrcPixel->Red   * pWeights[k];
+                    nGreen += pSrcPixel->Green * pWeights[k];
+                    nBlue  += pSrcPixel->Blue  * pWeights[k];
                 }
-                else 
+
+                pTmpPixel->Red   = AAClampResampled(nRed);
+                pTmpPixel->Green = AAClampResampled(nGreen);
+                pTmpPixel->Blue  = AAClampResampled(nBlue);
+            }
+        }
+    }
+
+    // Intermediate columns to destination rows dyBandFrom...dyBandTo-1
+    VOID ResampleColumns(INT dyBandFrom, INT dyBandTo) const
+    {
+        const BYTE *pTmp = (const BYTE *)pTmpBitmap->bmBits;
+        BYTE *pDst = (BYTE *)pDstBitmap->bmBits;
+        INT nTmpWidthBytes = pTmpBitmap->bmWidthBytes;
+
+        for (INT dy=dyBandFrom ; dy<dyBandTo ; ++dy)
+        {
+            INT i = bInvertYSrc ? nDstY + nDstHeight - 1 - dy : dy - nDstY;
+            const BYTE *pTmpRow = pTmp + (size_t)(pTableY->pFrom[i] - syFrom) * nTmpWidthBytes;
+            const INT *pWeights = pTableY->pWeights + (size_t)i * pTableY->nTaps;
+            INT nCount = pTableY->pCount[i];
+            PIXELDST *pDstPixel = (PIXELDST *)(pDst + (size_t)dy * pDstBitmap->bmWidthBytes) + dxFrom;
+
+            for (INT dx=dxFrom ; dx<dxTo ; ++dx, ++pDstPixel)
+            {
+                const BYTE *pTmpPixel = pTmpRow + (dx - dxFrom) * sizeof(RGB32);
+
+                INT nRed = 0, nGreen = 0, nBlue = 0;
+                for (INT k=0 ; k<nCount ; ++k, pTmpPixel += nTmpWidthBytes)
                 {
-                    // Blending nearest chunks
-                    // Destination point placed inside in areas intersection
-
-                    INT dui = (INT)( (double)((sx % iSCALE) >> (iSHIFT - 8)) / kx );
-                    INT dvi = (INT)( (double)((sy % iSCALE) >> (iSHIFT - 8)) / ky ); 
-                    INT du  = 255 - dui;
-                    INT dv  = 255 - dvi;
-
-                    // Averaged source color of chunk 1, 2, 3 and 4
-                    PIXELSRC p[4]; 
-                    PIXELSRC *p1 = p, *p2 = p+1, *p3 = p+2, *p4 = p+3;
-
-                    // Calculation average chunks color and 
-                    // weight of chunks for dest pixel color blending
-                    INT na = AAGetAverageColor<PIXELSRC>(pSrcBitmap, x, y, -nAvrSrcX, -nAvrSrcY, p+0, pClrKey, pDstPixel);
-                    INT nb = AAGetAverageColor<PIXELSRC>(pSrcBitmap, x, y,  nAvrSrcX, -nAvrSrcY, p+1, pClrKey, pDstPixel);
-                    INT nc = AAGetAverageColor<PIXELSRC>(pSrcBitmap, x, y, -nAvrSrcX,  nAvrSrcY, p+2, pClrKey, pDstPixel);
-                    INT nd = AAGetAverageColor<PIXELSRC>(pSrcBitmap, x, y,  nAvrSrcX,  nAvrSrcY, p+3, pClrKey, pDstPixel);
-            
-                    double a = na * dui * dvi; // blending coefficient for chunk 0     a b
-                    double b = nb * du  * dvi; // blending coefficient for chunk 1     c d
-                    double c = nc * dui * dv;  // blending coefficient for chunk 2
-                    double d = nd * du  * dv;  // blending coefficient for chunk 3
-                    double ratio = a + b + c + d;
-
-                    pDstPixel->Red   = (BYTE)( ( p1->Red   * a + p2->Red   * b + p3->Red   * c + p4->Red   * d ) / ratio );
-                    pDstPixel->Green = (BYTE)( ( p1->Green * a + p2->Green * b + p3->Green * c + p4->Green * d ) / ratio );
-                    pDstPixel->Blue  = (BYTE)( ( p1->Blue  * a + p2->Blue  * b + p3->Blue  * c + p4->Blue  * d ) / ratio );
+                    nRed   += ((const RGB32 *)pTmpPixel)->Red   * pWeights[k];
+                    nGreen += ((const RGB32 *)pTmpPixel)->Green * pWeights[k];
+                    nBlue  += ((const RGB32 *)pTmpPixel)->Blue  * pWeights[k];
                 }
+
+                pDstPixel->Red   = AAClampResampled(nRed);
+                pDstPixel->Green = AAClampResampled(nGreen);
+                pDstPixel->Blue  = AAClampResampled(nBlue);
             }
+        }
+    }
+
+    VOID RunBand(LONG nBand) const
+    {
+        INT nFrom = (bVertical ? dyFrom : syFrom) + nBand * nBandHeight;
+        INT nTo = nFrom + nBandHeight;
+        if (bVertical)
+            ResampleColumns(nFrom, (nTo < dyTo) ? nTo : dyTo);
+        else
+            ResampleRows(nFrom, (nTo < syTo) ? nTo : syTo);
+    }
+
+    VOID Run()
+    {
+        for (;;)
+        {
+            LONG nBand = ::InterlockedIncrement(&nNextBand) - 1;
+            if (nBand >= nBands)
+                break;
+            RunBand(nBand);
+        }
+    }
 
-            sx += sxStep, sy += syStep;
+    // Split pass rows into bands for nThreads workers
+    VOID SetPass(BOOL bVerticalPass, INT nThreads)
+    {
+        bVertical = bVerticalPass;
+        INT nRows = bVertical ? dyTo - dyFrom : syTo - syFrom;
+        INT nPassBands = 1;
+        if (nThreads > 1 && nRows >= 2 * AA_MIN_BAND_HEIGHT)
+        {
+            nPassBands = nThreads * AA_BANDS_PER_THREAD;
+            if (nPassBands > nRows / AA_MIN_BAND_HEIGHT)
+                nPassBands = nRows / AA_MIN_BAND_HEIGHT;
         }
+        nBandHeight = (nRows + nPassBands - 1) / nPassBands;
+        nBands = (nRows + nBandHeight - 1) / nBandHeight;
+        nNextBand = 0;
+    }
+
+    static VOID CALLBACK WorkCallback(PTP_CALLBACK_INSTANCE, PVOID pvJob, PTP_WORK)
+    {
+        ((AARESAMPLE_JOB *)pvJob)->Run();
+    }
+};
+
+// Resample source rect to destination rect by separable two-pass filter.
+// Per pixel work is O(2k) of filter taps k instead of O(k * k) of 2D kernels.
+// nThreads is workers number including calling thread, 0 means processors number.
+// Returns FALSE if memory for weights or intermediate bitmap is not allocated.
+template <typename PIXELSRC, typename PIXELDST>
+BOOL AAResampleBltTempl(
+        const BITMAP *pDstBitmap,
+        INT nDstX,
+        INT nDstY,
+        INT nDstWidth,
+        INT nDstHeight,
+        const BITMAP *pSrcBitmap,
+        INT nSrcX,
+        INT nSrcY,
+        INT nSrcWidth,
+        INT nSrcHeight,
+        AARESAMPLE nResample,
+        BOOL bInvertYSrc,
+        INT nThreads)
+{
+    ASSERT(pDstBitmap != NULL);
+    ASSERT(pDstBitmap->bmBits != NULL);
+    ASSERT(pSrcBitmap != NULL);
+    ASSERT(pSrcBitmap->bmBits != NULL);
+    ASSERT(pSrcBitmap->bmBitsPixel == sizeof(PIXELSRC) * 8);
+    ASSERT(pDstBitmap->bmBitsPixel == sizeof(PIXELDST) * 8);
+    ASSERT(nSrcX >= 0 && nSrcY >= 0);
+    ASSERT(nSrcX + nSrcWidth <= pSrcBitmap->bmWidth && nSrcY + nSrcHeight <= pSrcBitmap->bmHeight);
+
+    if (nDstWidth <= 0 || nDstHeight <= 0 || nSrcWidth <= 0 || nSrcHeight <= 0)
+        return TRUE;
+
+    AARESAMPLE_JOB<PIXELSRC, PIXELDST> job;
+    job.pDstBitmap = pDstBitmap;
+    job.pSrcBitmap = pSrcBitmap;
+    job.nDstX = nDstX;
+    job.nDstY = nDstY;
+    job.nDstHeight = nDstHeight;
+    job.bInvertYSrc = bInvertYSrc;
+
+    // Visible destination
+    job.dxFrom = (nDstX > 0) ? nDstX : 0;
+    job.dyFrom = (nDstY > 0) ? nDstY : 0;
+    job.dxTo = (nDstX + nDstWidth < pDstBitmap->bmWidth) ? nDstX + nDstWidth : pDstBitmap->bmWidth;
+    job.dyTo = (nDstY + nDstHeight < pDstBitmap->bmHeight) ? nDstY + nDstHeight : pDstBitmap->bmHeight;
+    if (job.dxFrom >= job.dxTo || job.dyFrom >= job.dyTo)
+        return TRUE;
+
+    AARESAMPLE_TABLE tableX = { 0 }, tableY = { 0 };
+    if (!AACreateResampleTable(nSrcX, nSrcWidth, nDstWidth, nResample, &tableX))
+        return FALSE;
+    if (!AACreateResampleTable(nSrcY, nSrcHeight, nDstHeight, nResample, &tableY))
+    {
+        AADeleteResampleTable(&tableX);
+        return FALSE;
+    }
+    job.pTableX = &tableX;
+    job.pTableY = &tableY;
+
+    // Source rows needed by visible destination rows
+    job.syFrom = nSrcY + nSrcHeight;
+    job.syTo = nSrcY;
+    for (INT dy=job.dyFrom ; dy<job.dyTo ; ++dy)
+    {
+        INT i = bInvertYSrc ? nDstY + nDstHeight - 1 - dy : dy - nDstY;
+        if (tableY.pFrom[i] < job.syFrom)
+            job.syFrom = tableY.pFrom[i];
+        if (tableY.pFrom[i] + tableY.pCount[i] > job.syTo)
+            job.syTo = tableY.pFrom[i] + tableY.pCount[i];
+    }
+
+    BITMAP bmpTmp = { 0 };
+    bmpTmp.bmWidth = job.dxTo - job.dxFrom;
+    bmpTmp.bmHeight = job.syTo - job.syFrom;
+    bmpTmp.bmWidthBytes = bmpTmp.bmWidth * sizeof(RGB32);
+    bmpTmp.bmPlanes = 1;
+    bmpTmp.bmBitsPixel = 32;
+    bmpTmp.bmBits = malloc((size_t)bmpTmp.bmWidthBytes * (size_t)bmpTmp.bmHeight);
+    if (bmpTmp.bmBits == NULL)
+    {
+        AADeleteResampleTable(&tableX);
+        AADeleteResampleTable(&tableY);
+        return FALSE;
+    }
+    job.pTmpBitmap = &bmpTmp;
+
+    if (nThreads <= 0)
+        nThreads = AAGetProcessorsNumber();
+
+    PTP_WORK pWork = NULL;
+    if (nThreads > 1)
+        pWork = ::CreateThreadpoolWork(&AARESAMPLE_JOB<PIXELSRC, PIXELDST>::WorkCallback, &job, NULL);
+
+    // Horizontal pass is finished before vertical one starts
+    for (INT iPass=0 ; iPass<2 ; ++iPass)
+    {
+        job.SetPass(iPass == 1, (pWork != NULL) ? nThreads : 1);
+        if (pWork != NULL && job.nBands > 1)
+        {
+            for (INT i=1 ; i<nThreads ; ++i)
+                ::SubmitThreadpoolWork(pWork);
 
-        sxFrom += sxNext, syFrom += syNext;
+            // Calling thread takes bands too
+            job.Run();
+
+            ::WaitForThreadpoolWorkCallbacks(pWork, FALSE);
+        }
+        else
+        {
+            job.Run();
+        }
     }
+
+    if (pWork != NULL)
+        ::CloseThreadpoolWork(pWork);
+
+    free(bmpTmp.bmBits);
+    AADeleteResampleTable(&tableX);
+    AADeleteResampleTable(&tableY);
+    return TRUE;
 }
 
 //
@@ -653,7 +3122,11 @@ inline VOID AATransformBlt(
         INT nSrcWidth,
         INT nSrcHeight,
         const XFORM_MATRIX *pMatrix,
-        const COLORREF *pClrKey = NULL)
+        const COLORREF *pClrKey = NULL,
+        const AASUMMEDAREATABLE *pSumTable = NULL,
+        const AAMIPMAP *pMipmap = NULL,
+        INT nThreads = 1,
+        const AAKEYMASK *pKeyMask = NULL)
 {
     ASSERT(pMatrix != NULL);
     ASSERT(pDstBitmap != NULL);
@@ -666,17 +3139,23 @@ inline VOID AATransformBlt(
     typedef PIXELFORMAT<24> PF24;
     typedef PIXELFORMAT<32> PF32;
 
+    // Color keyed source is drawn from its 32bpp key mask
+    if (AAIsKeyMaskApplicable(pKeyMask, pSrcBitmap, pClrKey))
+        pSrcBitmap = &pKeyMask->bmMask;
+    else
+        pKeyMask = NULL;
+
     if (pSrcBitmap->bmBitsPixel == pDstBitmap->bmBitsPixel)
     {
         switch(pSrcBitmap->bmBitsPixel)
         {
         case 24:
             AATransformBltTempl<PF24, PF24>(
-                    pDstBitmap, nDstX, nDstY, pSrcBitmap, nSrcX, nSrcY, nSrcWidth, nSrcHeight, pMatrix, pClrKey);
+                    pDstBitmap, nDstX, nDstY, pSrcBitmap, nSrcX, nSrcY, nSrcWidth, nSrcHeight, pMatrix, pClrKey, pSumTable, pMipmap, nThreads, pKeyMask);
             break;
         case 32:
             AATransformBltTempl<PF32, PF32>(
-                    pDstBitmap, nDstX, nDstY, pSrcBitmap, nSrcX, nSrcY, nSrcWidth, nSrcHeight, pMatrix, pClrKey);
+                    pDstBitmap, nDstX, nDstY, pSrcBitmap, nSrcX, nSrcY, nSrcWidth, nSrcHeight, pMatrix, pClrKey, pSumTable, pMipmap, nThreads, pKeyMask);
             break;
         default:
             ASSERT(FALSE);
@@ -687,7 +3166,7 @@ inline VOID AATransformBlt(
     {
         if (pSrcBitmap->bmBitsPixel == 32)
             AATransformBltTempl<PF32, PF24>(
-                    pDstBitmap, nDstX, nDstY, pSrcBitmap, nSrcX, nSrcY, nSrcWidth, nSrcHeight, pMatrix, pClrKey);
+                    pDstBitmap, nDstX, nDstY, pSrcBitmap, nSrcX, nSrcY, nSrcWidth, nSrcHeight, pMatrix, pClrKey, pSumTable, pMipmap, nThreads, pKeyMask);
         else
             ASSERT(FALSE);
     }
@@ -695,12 +3174,167 @@ inline VOID AATransformBlt(
     {
         if (pSrcBitmap->bmBitsPixel == 24)
             AATransformBltTempl<PF24, PF32>(
-                    pDstBitmap, nDstX, nDstY, pSrcBitmap, nSrcX, nSrcY, nSrcWidth, nSrcHeight, pMatrix, pClrKey);
+                    pDstBitmap, nDstX, nDstY, pSrcBitmap, nSrcX, nSrcY, nSrcWidth, nSrcHeight, pMatrix, pClrKey, pSumTable, pMipmap, nThreads, pKeyMask);
         else
             ASSERT(FALSE);
     }
 }
 
+// Same as AATransformBlt but destination is split into bands 
+// rendered on nThreads workers, 0 means processors number.
+// Result is identical to AATransformBlt.
+inline VOID AATransformBltParallel(
+        const BITMAP *pDstBitmap, 
+        INT nDstX,
+        INT nDstY,
+        const BITMAP *pSrcBitmap,
+        INT nSrcX,
+        INT nSrcY,
+        INT nSrcWidth,
+        INT nSrcHeight,
+        const XFORM_MATRIX *pMatrix,
+        INT nThreads = 0,
+        const COLORREF *pClrKey = NULL,
+        const AASUMMEDAREATABLE *pSumTable = NULL,
+        const AAMIPMAP *pMipmap = NULL,
+        const AAKEYMASK *pKeyMask = NULL)
+{
+    AATransformBlt(
+        pDstBitmap, 
+        nDstX, 
+        nDstY, 
+        pSrcBitmap, 
+        nSrcX, 
+        nSrcY, 
+        nSrcWidth, 
+        nSrcHeight, 
+        pMatrix, 
+        pClrKey,
+        pSumTable,
+        pMipmap,
+        nThreads,
+        pKeyMask);
+}
+
+// Transform premultiplied alpha 32bpp source (see AAPremultiplyBitmap) and
+// composite it over destination by Porter-Duff "over". 32bpp destination is
+// premultiplied too and gets composited alpha, 24bpp destination is opaque.
+inline VOID AATransformAlphaBlt(
+        const BITMAP *pDstBitmap, 
+        INT nDstX,
+        INT nDstY,
+        const BITMAP *pSrcBitmap,
+        INT nSrcX,
+        INT nSrcY,
+        INT nSrcWidth,
+        INT nSrcHeight,
+        const XFORM_MATRIX *pMatrix,
+        INT nThreads = 1)
+{
+    ASSERT(pMatrix != NULL);
+    ASSERT(pDstBitmap != NULL);
+    ASSERT(pDstBitmap->bmBits != NULL);
+    ASSERT(pSrcBitmap != NULL);
+    ASSERT(pSrcBitmap->bmBits != NULL);
+    ASSERT(pSrcBitmap->bmBitsPixel == 32);
+    ASSERT(pDstBitmap->bmBitsPixel == 24 || pDstBitmap->bmBitsPixel == 32);
+
+    typedef PIXELFORMAT<24> PF24;
+    typedef PIXELFORMAT<32> PF32;
+
+    if (pDstBitmap->bmBitsPixel == 32)
+        AATransformBltTempl<PARGB32, PF32>(
+                pDstBitmap, nDstX, nDstY, pSrcBitmap, nSrcX, nSrcY, nSrcWidth, nSrcHeight, pMatrix, NULL, NULL, NULL, nThreads);
+    else
+        AATransformBltTempl<PARGB32, PF24>(
+                pDstBitmap, nDstX, nDstY, pSrcBitmap, nSrcX, nSrcY, nSrcWidth, nSrcHeight, pMatrix, NULL, NULL, NULL, nThreads);
+}
+
+// Convert 32bpp bitmap with straight alpha in reserved byte to premultiplied one
+inline VOID AAPremultiplyBitmap(const BITMAP *pBitmap)
+{
+    ASSERT(pBitmap != NULL);
+    ASSERT(pBitmap->bmBits != NULL);
+    ASSERT(pBitmap->bmBitsPixel == 32);
+
+    for (INT y=0 ; y<pBitmap->bmHeight ; ++y)
+    {
+        RGB32 *p = (RGB32 *)((BYTE *)pBitmap->bmBits + y * pBitmap->bmWidthBytes);
+        RGB32 *pTo = p + pBitmap->bmWidth;
+        for ( ; p<pTo ; ++p)
+        {
+            INT nAlpha = p->Reserved;
+            if (nAlpha == 255)
+                continue;
+            p->Red   = (BYTE)AADiv255(p->Red   * nAlpha);
+            p->Green = (BYTE)AADiv255(p->Green * nAlpha);
+            p->Blue  = (BYTE)AADiv255(p->Blue  * nAlpha);
+        }
+    }
+}
+
+// Draw procedural frame transformed by pMatrix, where eDx and eDy are 
+// destination position of frame pixel 0, 0. See AAFRAME.
+inline VOID AAFrameBlt(
+        const BITMAP *pDstBitmap, 
+        const AAFRAME *pFrame,
+        const XFORM_MATRIX *pMatrix)
+{
+    ASSERT(pDstBitmap != NULL);
+    ASSERT(pDstBitmap->bmBitsPixel == 24 || pDstBitmap->bmBitsPixel == 32);
+
+    if (pDstBitmap->bmBitsPixel == 24)
+        AAFrameBltTempl<PIXELFORMAT<24> >(pDstBitmap, pFrame, pMatrix);
+    else
+        AAFrameBltTempl<PIXELFORMAT<32> >(pDstBitmap, pFrame, pMatrix);
+}
+
+// Resample source rect to destination rect by separable filter.
+// Returns FALSE if there is not enough memory.
+inline BOOL AAResampleBlt(
+        const BITMAP *pDstBitmap, 
+        INT nDstX, 
+        INT nDstY, 
+        INT nDstWidth, 
+        INT nDstHeight, 
+        const BITMAP *pSrcBitmap,
+        INT nSrcX,
+        INT nSrcY,
+        INT nSrcWidth,
+        INT nSrcHeight,
+        AARESAMPLE nResample = AA_RESAMPLE_TRIANGLE,
+        BOOL bInvertYSrc = FALSE,
+        INT nThreads = 1)
+{
+    ASSERT(pDstBitmap != NULL);
+    ASSERT(pDstBitmap->bmBits != NULL);
+    ASSERT(pSrcBitmap != NULL);
+    ASSERT(pSrcBitmap->bmBits != NULL);
+    ASSERT(pSrcBitmap->bmBitsPixel == 24 || pSrcBitmap->bmBitsPixel == 32);
+    ASSERT(pDstBitmap->bmBitsPixel == 24 || pDstBitmap->bmBitsPixel == 32);
+
+    typedef PIXELFORMAT<24> PF24;
+    typedef PIXELFORMAT<32> PF32;
+
+    if (pSrcBitmap->bmBitsPixel == 24 && pDstBitmap->bmBitsPixel == 24)
+        return AAResampleBltTempl<PF24, PF24>(
+                pDstBitmap, nDstX, nDstY, nDstWidth, nDstHeight, pSrcBitmap, nSrcX, nSrcY, nSrcWidth, nSrcHeight, nResample, bInvertYSrc, nThreads);
+    else if (pSrcBitmap->bmBitsPixel == 32 && pDstBitmap->bmBitsPixel == 32)
+        return AAResampleBltTempl<PF32, PF32>(
+                pDstBitmap, nDstX, nDstY, nDstWidth, nDstHeight, pSrcBitmap, nSrcX, nSrcY, nSrcWidth, nSrcHeight, nResample, bInvertYSrc, nThreads);
+    else if (pSrcBitmap->bmBitsPixel == 32)
+        return AAResampleBltTempl<PF32, PF24>(
+                pDstBitmap, nDstX, nDstY, nDstWidth, nDstHeight, pSrcBitmap, nSrcX, nSrcY, nSrcWidth, nSrcHeight, nResample, bInvertYSrc, nThreads);
+    else
+        return AAResampleBltTempl<PF24, PF32>(
+                pDstBitmap, nDstX, nDstY, nDstWidth, nDstHeight, pSrcBitmap, nSrcX, nSrcY, nSrcWidth, nSrcHeight, nResample, bInvertYSrc, nThreads);
+}
+
+// Scale whole source bitmap into destination rect.
+// Plain scaling goes through separable resampler with nResample filter,
+// color keyed source is drawn by transformation kernels which skip key pixels.
+// Supplied summed area table or mipmap selects transformation kernels too,
+// mipmap is not applied to color keyed source.
 inline VOID AAStretchBlt(
         const BITMAP *pDstBitmap, 
         INT nDstX, 
@@ -709,11 +3343,24 @@ inline VOID AAStretchBlt(
         INT nDstHeight, 
         const BITMAP *pSrcBitmap,
         const COLORREF *pClrKey = NULL,
-        BOOL bInvertYSrc = FALSE)
+        BOOL bInvertYSrc = FALSE,
+        const AASUMMEDAREATABLE *pSumTable = NULL,
+        const AAMIPMAP *pMipmap = NULL,
+        INT nThreads = 1,
+        AARESAMPLE nResample = AA_RESAMPLE_TRIANGLE,
+        const AAKEYMASK *pKeyMask = NULL)
 {
     ASSERT(pSrcBitmap != NULL);
     ASSERT(pDstBitmap != NULL);
 
+    if (pClrKey == NULL && pSumTable == NULL && pMipmap == NULL && 
+        AAResampleBlt(pDstBitmap, nDstX, nDstY, nDstWidth, nDstHeight, 
+                      pSrcBitmap, 0, 0, pSrcBitmap->bmWidth, pSrcBitmap->bmHeight, 
+                      nResample, bInvertYSrc, nThreads))
+    {
+        return;
+    }
+
     XFORM_MATRIX matrix;
     matrix.eM11 = (double)nDstWidth / (double)pSrcBitmap->bmWidth;
     matrix.eM22 = (double)nDstHeight / (double)pSrcBitmap->bmHeight;
@@ -738,7 +3385,11 @@ inline VOID AAStretchBlt(
         pSrcBitmap->bmWidth, 
         pSrcBitmap->bmHeight, 
         &matrix, 
-        pClrKey);
+        pClrKey,
+        pSumTable,
+        pMipmap,
+        nThreads,
+        pKeyMask);
 }
 
 
@@ -1,27 +1,52 @@
 #include "stdafx.h"
 #include "appwnd.h"
 #include "imghelp.h"
+#include "prefetch.h"
+#include "prevcache.h"
+#include "playlist.h"
+#include "framesched.h"
+#include "framebuf.h"
+#include <process.h>
 
 //
 // CAppWindow class
 //
 
-CAppWindow::CAppWindow(list<wstring>& imagesList)
-    : m_nTimer(-1)
+CAppWindow::CAppWindow(
+        const CPlaylist& playlist,
+        CFileIndex* pFileIndex,
+        BOOL bShuffle /* = FALSE */,
+        DWORD dwShuffleSeed /* = 0 */,
+        DWORD dwDwellMsec /* = 5000 */,
+        UINT nFramesPerSecond /* = 60 */,
+        UINT nPrefetchDepth /* = 4 */,
+        LONG nPrefetchMaxBytes /* = 128 << 20 */,
+        ULONGLONG nPreviewCacheMaxBytes /* = 256 << 20 */)
+    : m_playlist(playlist)
+    , m_pFileIndex(pFileIndex)
+    , m_bShuffle(bShuffle)
+    , m_dwShuffleSeed(dwShuffleSeed)
+    , m_dwDwellMsec(dwDwellMsec)
+    , m_dwImageTime(0)
+    , m_bImageShown(FALSE)
+    , m_nPrefetchDepth(nPrefetchDepth)
+    , m_nPrefetchMaxBytes(nPrefetchMaxBytes)
+    , m_nPreviewCacheMaxBytes(nPreviewCacheMaxBytes)
+    , m_nTimer(-1)
     , m_hDC(NULL)
     , m_hBmp(NULL)
     , m_hOldBmp(NULL)
-    , m_hScreenDC(NULL)
-    , m_hScreenOldBmp(NULL)
-    , m_hScreenBmp(NULL)
-    , m_bUpdate(TRUE)
+    , m_nFramesPerSecond(nFramesPerSecond)
+    , m_hRenderThread(NULL)
+    , m_hStopEvent(NULL)
 {
-    m_imagesList.swap(imagesList);
-    m_iterator = m_imagesList.begin(); 
+    m_sizeFrame.cx = 0;
+    m_sizeFrame.cy = 0;
 }
 
 CAppWindow::~CAppWindow()
 {
+    StopRender();
 }
 
 LRESULT CAppWindow::OnCreate(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL &bHandled)
@@ -30,12 +55,40 @@ LRESULT CAppWindow::OnCreate(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL &bHan
     // UINT32 nElapseMsec = 10;
     // m_nTimer = SetTimer(nID, nElapseMsec);
 
+    RECT rect;
+    GetClientRect(&rect);
+    m_sizeFrame.cx = rect.right;
+    m_sizeFrame.cy = rect.bottom;
+
+    // frames are drawn by render thread from now on
+    try
+    {
+        m_frames.reset( new CFrameBuffers() ); // exception
+    }
+    catch (...)
+    {
+        return -1;
+    }
+
+    m_hStopEvent = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+    if ( !m_frames->Create(m_sizeFrame.cx, m_sizeFrame.cy) || m_hStopEvent == NULL )
+        return -1;
+
+    m_hRenderThread = (HANDLE)_beginthreadex(NULL, 0, RenderThreadProc, this, 0, NULL);
+    if ( m_hRenderThread == NULL )
+        return -1;
+
     bHandled = FALSE;
     return 0;
 }
 
 LRESULT CAppWindow::OnDestroy(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL &bHandled)
 {
+    // render thread and workers are stopped before window and GDI+ go away
+    StopRender();
+    m_prefetcher.reset();
+    m_previewCache.reset();
+
     ::SelectObject(m_hDC, m_hOldBmp);
     m_hOldBmp = NULL;
     ::DeleteDC(m_hDC); 
@@ -43,35 +96,24 @@ LRESULT CAppWindow::OnDestroy(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL &bHa
     ::DeleteObject(m_hBmp);
     m_hBmp = NULL;
 
-    ::SelectObject(m_hScreenDC, m_hScreenOldBmp);
-    m_hScreenOldBmp = NULL;
-    ::DeleteDC(m_hScreenDC); 
-    m_hScreenDC = NULL;
-    ::DeleteObject(m_hScreenBmp);
-    m_hScreenBmp = NULL;
-    
+    m_frames.reset();
+
     // KillTimer(m_nTimer);
     // m_nTimer = -1;
 
+    ::PostQuitMessage(0);
+
     bHandled = FALSE;
     return 0;
 }
 
 LRESULT CAppWindow::OnPaint(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL &bHandled)
 {
-    if ( m_bUpdate )
-    {
-        UpdateView();
-        m_bUpdate = FALSE;
-    }
-
     PAINTSTRUCT ps;
     HDC hDC = BeginPaint(&ps);
-    
-    RECT rect;
-    GetClientRect(&rect);
 
-    BitBlt(hDC, 0, 0, rect.right, rect.bottom, m_hDC, 0, 0, SRCCOPY);
+    // render thread invalidates only what is changed
+    Present(hDC, ps.rcPaint);
 
     EndPaint(&ps);
 
@@ -88,12 +130,24 @@ LRESULT CAppWindow::OnKeyDown(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL &bHa
 
 LRESULT CAppWindow::OnTimer(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL &bHandled)
 {
-    UpdateView();
     Invalidate(FALSE);
     bHandled = TRUE;
     return 0;
 }
 
+wstring CAppWindow::GetAppDataFile(LPCWSTR wszName)
+{
+    WCHAR wszPath[MAX_PATH] = { 0 };
+    if ( FAILED(::SHGetFolderPathW(NULL, CSIDL_LOCAL_APPDATA | CSIDL_FLAG_CREATE, NULL, SHGFP_TYPE_CURRENT, wszPath)) )
+        return wstring();
+
+    wstring path(wszPath);
+    path += L"\\AlbumMk";
+    ::CreateDirectoryW(path.c_str(), NULL);
+
+    return path + L"\\" + wszName;
+}
+
 VOID CAppWindow::Repaint()
 {
     RECT rect;
@@ -101,20 +155,107 @@ VOID CAppWindow::Repaint()
 
     HDC hDC = GetDC();
 
-    BitBlt(hDC, 0, 0, rect.right, rect.bottom, m_hDC, 0, 0, SRCCOPY);
+    Present(hDC, rect);
 
     ReleaseDC(hDC);
 }
 
-VOID CAppWindow::UpdateView()
+// CAppWindow::Present
+
+void CAppWindow::Present(HDC hDC, const RECT& rect) throw()
 {
-    if ( m_iterator == m_imagesList.end() )
-        m_iterator = m_imagesList.begin();
-    if ( m_iterator == m_imagesList.end() )
+    // frame is taken without waiting for render thread
+    if ( m_frames.get() == NULL )
         return;
 
-    RECT rect;
-    GetClientRect(&rect);
+    BitBlt(hDC, rect.left, rect.top, rect.right - rect.left, rect.bottom - rect.top, 
+           m_frames->AcquireFront(), rect.left, rect.top, SRCCOPY);
+}
+
+// CAppWindow::RenderThreadProc
+
+unsigned __stdcall CAppWindow::RenderThreadProc(void* pParam)
+{
+    // image is decoded here if prefetcher has no workers
+    const HRESULT hr = ::CoInitializeEx(NULL, COINIT_MULTITHREADED);
+
+    ((CAppWindow*)pParam)->Render();
+
+    if ( SUCCEEDED(hr) )
+        ::CoUninitialize();
+    return 0;
+}
+
+// CAppWindow::Render
+
+void CAppWindow::Render() throw()
+{
+    CFrameScheduler scheduler(m_nFramesPerSecond);
+
+    while ( scheduler.Wait(m_hStopEvent) )
+    {
+        // frame is skipped if memory runs out
+        BOOL bChanged = FALSE;
+        RECT rectDamage = { 0 };
+        try
+        {
+            bChanged = UpdateView(&rectDamage); // exception
+        }
+        catch (...)
+        {
+        }
+
+        // view is kept by render thread, changed part of it is handed to window
+        if ( bChanged && !::IsRectEmpty(&rectDamage) )
+        {
+            m_frames->Update(m_hDC, rectDamage);
+            m_frames->Publish();
+            ::InvalidateRect(m_hWnd, &rectDamage, FALSE);
+        }
+
+        scheduler.EndFrame();
+    }
+}
+
+// CAppWindow::StopRender
+
+void CAppWindow::StopRender() throw()
+{
+    if ( m_hRenderThread != NULL )
+    {
+        ::SetEvent(m_hStopEvent);
+        ::WaitForSingleObject(m_hRenderThread, INFINITE);
+        ::CloseHandle(m_hRenderThread);
+        m_hRenderThread = NULL;
+    }
+
+    if ( m_hStopEvent != NULL )
+    {
+        ::CloseHandle(m_hStopEvent);
+        m_hStopEvent = NULL;
+    }
+}
+
+BOOL CAppWindow::UpdateView(RECT* prcDamage)
+{
+    ASSERT(prcDamage != NULL);
+    ::SetRectEmpty(prcDamage);
+
+    // nothing is shown until first image is found, window is closed if there is none
+    const BOOL bComplete = m_playlist.IsComplete();
+    const UINT nCount = m_playlist.GetCount();
+    if ( nCount == 0 )
+    {
+        if ( bComplete )
+            PostMessage(WM_CLOSE);
+        return FALSE;
+    }
+
+    // image stays for dwell time, frames meanwhile change nothing
+    if ( m_bImageShown && ::GetTickCount() - m_dwImageTime < m_dwDwellMsec )
+        return FALSE;
+
+    const RECT rect = { 0, 0, m_sizeFrame.cx, m_sizeFrame.cy };
 
     if ( m_hBmp == NULL )
     {
@@ -129,57 +270,53 @@ VOID CAppWindow::UpdateView()
         m_hOldBmp = ::SelectObject(m_hDC, m_hBmp);
     }
 
-    if ( m_hScreenBmp == NULL )
-    {
-        auto_ptr<Bitmap> m_image( new Bitmap(rect.right, rect.bottom, PixelFormat32bppARGB) );
-        m_image->GetHBITMAP(Color::Black, &m_hScreenBmp);
-        m_image.reset();
-
-        BITMAP bmp = { 0 };
-        ::GetObject(m_hScreenBmp, sizeof(bmp), &bmp);
-
-        m_hScreenDC = CreateCompatibleDC(NULL);
-        m_hScreenOldBmp = ::SelectObject(m_hScreenDC, m_hScreenBmp);
-    }
+    const Rect rectView(10, 10, rect.right - 20, rect.bottom - 20);
 
-    LPCWSTR wszName = (m_iterator++)->c_str();
-    auto_ptr<Image> image( new Image(wszName) ); // exception
-    CImagesScatter::DrawScatterImage(
-        m_hBmp,
-        Rect(10, 10, rect.right - 20, rect.bottom - 20), // client area to draw
-        image.get(), // image to draw
-        80.0, // max angle
-        30, // max offset
-        10, // frame thick
-        Color::WhiteSmoke // frame color
-        ); 
-
-    return;
-
-    if ( m_animation.get() == NULL )
+    // images are decoded and scaled to view ahead on worker threads
+    if ( m_prefetcher.get() == NULL )
     {
-        LPCWSTR wszName = m_iterator->c_str();
+        // slideshow runs without previews file if it cannot be opened
+        const wstring cacheFile = GetAppDataFile(L"previews.pack");
+        if ( m_nPreviewCacheMaxBytes > 0 && !cacheFile.empty() )
+        {
+            m_previewCache.reset( new CPreviewCache() ); // exception
+            if ( !m_previewCache->Open(cacheFile.c_str(), m_nPreviewCacheMaxBytes) )
+                m_previewCache.reset();
+        }
+
+        m_prefetcher.reset( new CImagePrefetcher(&m_playlist, Size(rectView.Width, rectView.Height), 
+            Color::WhiteSmoke, m_previewCache.get(), m_pFileIndex, m_bShuffle, m_dwShuffleSeed, 
+            m_nPrefetchDepth, m_nPrefetchMaxBytes) ); // exception
+    }
 
-        auto_ptr<Image> image( new Image(wszName) ); // exception
+    // view is kept until next image is ready
+    HBITMAP hImageBitmap = NULL;
+    BITMAP bmpImage = { 0 };
+    if ( !m_prefetcher->Pop(&hImageBitmap, &bmpImage) || hImageBitmap == NULL )
+        return FALSE;
 
-        m_animation = CImagesScatter::CreateScatterImageAnimation(
-            Rect(10, 10, rect.right - 20, rect.bottom - 20), // client area to draw
-            image.get(), // image to draw
+    try
+    {
+        CImagesScatter::DrawScatterImage(
+            m_hBmp,
+            rectView, // client area to draw
+            &bmpImage, // image to draw
             80.0, // max angle
             30, // max offset
             10, // frame thick
-            Color::WhiteSmoke // frame color
-            ); 
-
-        ++m_iterator;
+            Color::WhiteSmoke, // frame color
+            prcDamage // pixels changed
+            ); // exception
     }
-
-    BitBlt(m_hDC, 0, 0, rect.right, rect.bottom, m_hScreenDC, 0, 0, SRCCOPY);
-
-    if ( !m_animation->NextAnimation(m_hBmp) )
+    catch (...)
     {
-        m_animation.reset();
-
-        BitBlt(m_hScreenDC, 0, 0, rect.right, rect.bottom, m_hDC, 0, 0, SRCCOPY);
+        ::DeleteObject(hImageBitmap);
+        throw;
     }
+
+    ::DeleteObject(hImageBitmap);
+
+    m_dwImageTime = ::GetTickCount();
+    m_bImageShown = TRUE;
+    return TRUE;
 }
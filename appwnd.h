@@ -1,17 +1,33 @@
 #pragma once
 
 // forward declaration
-class CImageScatterAnimation;
+class CImagePrefetcher;
+class CPreviewCache;
+class CPlaylist;
+class CFileIndex;
+class CFrameBuffers;
 
 //
 // CAppWindow class
+// Images are composed by render thread, window thread only shows latest
+// finished frame, so messages never wait for drawing.
 //
 
 class CAppWindow
     : public CWindowImpl<CAppWindow, CWindow, CWinTraitsOR<0,0,CNullTraits> >
 {
 public:
-    CAppWindow(list<wstring>& imagesList);
+    CAppWindow(
+        const CPlaylist& playlist,          // is filled while slideshow runs
+        CFileIndex* pFileIndex,             // receives image sizes, can be NULL
+        BOOL bShuffle = FALSE,              // images are shown in random order
+        DWORD dwShuffleSeed = 0,            // same seed gives same order
+        DWORD dwDwellMsec = 5000,           // time each image is shown for
+        UINT nFramesPerSecond = 60,         // rate of render thread
+        UINT nPrefetchDepth = 4,            // images decoded ahead of view
+        LONG nPrefetchMaxBytes = 128 << 20, // pixel bytes held by decoded images
+        ULONGLONG nPreviewCacheMaxBytes = 256 << 20 // size of previews file, 0 disables it
+        );
     ~CAppWindow();
 
     BEGIN_MSG_MAP(CAppWnd)
@@ -22,9 +38,12 @@ public:
     MESSAGE_HANDLER(WM_TIMER, OnTimer)
     END_MSG_MAP();
 
-    VOID UpdateView();
+    // Shows latest frame of render thread
     VOID Repaint();
 
+    // File in local application data folder, empty if folder is not found
+    static wstring GetAppDataFile(LPCWSTR wszName);
+
 private:
     LRESULT OnCreate(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL &bHandled);
     LRESULT OnDestroy(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL &bHandled);
@@ -32,18 +51,37 @@ private:
     LRESULT OnKeyDown(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL &bHandled);
     LRESULT OnTimer(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL &bHandled);
 
+    static unsigned __stdcall RenderThreadProc(void* pParam);
+    void Render() throw();
+    void StopRender() throw();
+    void Present(HDC hDC, const RECT& rect) throw();
+
+    // Draws next image when dwell time is over, TRUE if view is changed in
+    // prcDamage, render thread only
+    BOOL UpdateView(RECT* prcDamage);
+
 private:
-    list<wstring> m_imagesList;
-    list<wstring>::const_iterator m_iterator;
-    auto_ptr<CImageScatterAnimation> m_animation;
+    const CPlaylist& m_playlist;
+    CFileIndex* m_pFileIndex;
+    BOOL m_bShuffle;
+    DWORD m_dwShuffleSeed;
+    DWORD m_dwDwellMsec;
+    DWORD m_dwImageTime;            // tick count when image was drawn
+    BOOL m_bImageShown;
+    auto_ptr<CPreviewCache> m_previewCache;
+    auto_ptr<CImagePrefetcher> m_prefetcher;
+    UINT m_nPrefetchDepth;
+    LONG m_nPrefetchMaxBytes;
+    ULONGLONG m_nPreviewCacheMaxBytes;
     UINT_PTR m_nTimer;
-    BOOL m_bUpdate;
+
+    UINT m_nFramesPerSecond;
+    HANDLE m_hRenderThread;
+    HANDLE m_hStopEvent;
+    auto_ptr<CFrameBuffers> m_frames;
+    SIZE m_sizeFrame;
 
     HDC m_hDC;
     HGDIOBJ m_hOldBmp;
     HBITMAP m_hBmp;
-
-    HDC m_hScreenDC;
-    HGDIOBJ m_hScreenOldBmp;
-    HBITMAP m_hScreenBmp;
 };
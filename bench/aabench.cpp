@@ -0,0 +1,690 @@
+//
+// Benchmark of advbitmap.h kernels on synthetic bitmaps.
+// It needs no GDI, so it runs headless on Windows and Linux.
+//
+// Build:
+//   Linux:   g++ -O2 -I.. aabench.cpp -o aabench -lpthread
+//   Windows: cl /O2 /EHsc /I.. aabench.cpp
+//
+// Usage:
+//   aabench [-quick] [-filter <text>] [-threads <n>]
+//           [-save <file>] [-compare <file>] [-tolerance <percent>]
+//
+//   -quick      sizes up to full HD and fewer angles
+//   -filter     run cases which name contains text
+//   -threads    blit workers, 0 means processors number (default 1)
+//   -save       write results as baseline
+//   -compare    compare results with baseline, exit code is 1 on regression
+//   -tolerance  allowed ns/pixel growth against baseline (default 10%)
+//
+// Case names are <kernel>/<source>-<destination>/<angle>/<bpp src>-<bpp dst>/<key>,
+// key is nokey, key (compared per pixel) or keymask (AAKEYMASK of source),
+// over cases composite 32bpp source as premultiplied by AATransformAlphaBlt,
+// stretch cases of other than default resampling filter end with /<filter>.
+// Pixel is destination pixel for blits, source pixel for averaging
+// and one call for matrix multiplication.
+//
+
+#include "aatypes.h"
+#include "advbitmap.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <map>
+
+#ifdef _WIN32
+#include <intrin.h>
+#elif defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#include <time.h>
+#else
+#include <time.h>
+#endif
+
+using namespace std;
+
+//
+// Timing
+//
+
+// Wall clock time in seconds
+static double GetTime()
+{
+#ifdef _WIN32
+    static LARGE_INTEGER liFreq = { 0 };
+    if (liFreq.QuadPart == 0)
+        ::QueryPerformanceFrequency(&liFreq);
+    LARGE_INTEGER liNow;
+    ::QueryPerformanceCounter(&liNow);
+    return (double)liNow.QuadPart / (double)liFreq.QuadPart;
+#else
+    struct timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+// CPU time stamp counter, 0 if it is not available
+static ULONGLONG GetCycles()
+{
+#if defined(_WIN32) || defined(__i386__) || defined(__x86_64__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Minimal measured time of one case
+const double BENCH_MIN_TIME = 0.25;
+
+// Minimal runs number of one case
+const INT BENCH_MIN_RUNS = 2;
+
+// Runs case until BENCH_MIN_TIME is spent, the best run is taken
+class CBenchCase
+{
+public:
+    virtual ~CBenchCase() {}
+    virtual VOID Run() = 0;
+
+    VOID Measure(double *pdSeconds, double *pdCycles)
+    {
+        double dTotal = 0;
+        double dBest = 0;
+        double dBestCycles = 0;
+        for (INT i=0 ; i<BENCH_MIN_RUNS || dTotal<BENCH_MIN_TIME ; ++i)
+        {
+            ULONGLONG nCycles = GetCycles();
+            double dStart = GetTime();
+            Run();
+            double dTime = GetTime() - dStart;
+            nCycles = GetCycles() - nCycles;
+
+            dTotal += dTime;
+            if (i == 0 || dTime < dBest)
+                dBest = dTime, dBestCycles = (double)nCycles;
+        }
+        *pdSeconds = dBest;
+        *pdCycles = dBestCycles;
+    }
+};
+
+//
+// Synthetic bitmaps
+//
+
+// Color key of synthetic source
+const COLORREF BENCH_CLR_KEY = RGB(255, 0, 255);
+
+class CSyntheticBitmap
+{
+public:
+    CSyntheticBitmap(INT nWidth, INT nHeight, INT nBitsPixel)
+    {
+        m_bmp.bmType = 0;
+        m_bmp.bmWidth = nWidth;
+        m_bmp.bmHeight = nHeight;
+        m_bmp.bmWidthBytes = ((nWidth * nBitsPixel + 31) / 32) * 4;
+        m_bmp.bmPlanes = 1;
+        m_bmp.bmBitsPixel = (WORD)nBitsPixel;
+        m_bits.resize((size_t)m_bmp.bmWidthBytes * nHeight);
+        m_bmp.bmBits = &m_bits[0];
+    }
+
+    // Gradients with noise, 8x8 blocks of color key are spread over
+    VOID FillPattern()
+    {
+        UINT nSeed = 12345;
+        INT nPixelBytes = m_bmp.bmBitsPixel / 8;
+        for (INT y=0 ; y<m_bmp.bmHeight ; ++y)
+        {
+            BYTE *p = &m_bits[(size_t)y * m_bmp.bmWidthBytes];
+            for (INT x=0 ; x<m_bmp.bmWidth ; ++x, p += nPixelBytes)
+            {
+                nSeed = nSeed * 1103515245 + 12345;
+                BYTE nNoise = (BYTE)((nSeed >> 16) & 0x1F);
+                if (((x / 8) + (y / 8)) % 5 == 0)
+                {
+                    p[0] = GetBValue(BENCH_CLR_KEY);
+                    p[1] = GetGValue(BENCH_CLR_KEY);
+                    p[2] = GetRValue(BENCH_CLR_KEY);
+                }
+                else
+                {
+                    p[0] = (BYTE)(x * 255 / m_bmp.bmWidth) ^ nNoise;
+                    p[1] = (BYTE)(1 + (y * 254 / m_bmp.bmHeight));
+                    p[2] = (BYTE)((x + y) & 0xFF) ^ nNoise;
+                }
+                if (nPixelBytes == 4)
+                    p[3] = 0;
+            }
+        }
+    }
+
+    const BITMAP *GetBitmap() const
+    {
+        return &m_bmp;
+    }
+
+private:
+    CSyntheticBitmap(const CSyntheticBitmap &);
+    CSyntheticBitmap &operator=(const CSyntheticBitmap &);
+
+    BITMAP m_bmp;
+    vector<BYTE> m_bits;
+};
+
+struct BENCH_SIZE
+{
+    const char *pszName;
+    INT nWidth;
+    INT nHeight;
+};
+
+const BENCH_SIZE g_sizes[] =
+{
+    { "thumb", 160, 120 },
+    { "fhd", 1920, 1080 },
+    { "4k", 3840, 2160 },
+    { "8k", 7680, 4320 }
+};
+
+const INT g_sizesCount = sizeof(g_sizes) / sizeof(g_sizes[0]);
+
+// Quick sweep takes sizes up to this one
+const INT BENCH_QUICK_SIZES = 2;
+
+struct BENCH_FORMAT
+{
+    INT nSrcBits;
+    INT nDstBits;
+};
+
+const BENCH_FORMAT g_formats[] =
+{
+    { 24, 24 },
+    { 32, 32 },
+    { 24, 32 },
+    { 32, 24 }
+};
+
+const INT g_formatsCount = sizeof(g_formats) / sizeof(g_formats[0]);
+
+struct BENCH_RESAMPLE
+{
+    AARESAMPLE nResample;
+    const char *pszSuffix; // empty for default filter of AAStretchBlt
+};
+
+const BENCH_RESAMPLE g_resamples[] =
+{
+    { AA_RESAMPLE_TRIANGLE, "" },
+    { AA_RESAMPLE_BOX, "/box" },
+    { AA_RESAMPLE_LANCZOS3, "/lanczos3" }
+};
+
+const INT g_resamplesCount = sizeof(g_resamples) / sizeof(g_resamples[0]);
+
+//
+// Cases
+//
+
+class CTransformBltCase : public CBenchCase
+{
+public:
+    const BITMAP *pDstBitmap;
+    const BITMAP *pSrcBitmap;
+    XFORM_MATRIX matrix;
+    INT nDstX;
+    INT nDstY;
+    const COLORREF *pClrKey;
+    const AAKEYMASK *pKeyMask;
+    BOOL bOver;
+    INT nThreads;
+
+    VOID Run()
+    {
+        if (bOver)
+            AATransformAlphaBlt(pDstBitmap, nDstX, nDstY, pSrcBitmap, 0, 0,
+                pSrcBitmap->bmWidth, pSrcBitmap->bmHeight, &matrix, nThreads);
+        else
+            AATransformBlt(pDstBitmap, nDstX, nDstY, pSrcBitmap, 0, 0,
+                pSrcBitmap->bmWidth, pSrcBitmap->bmHeight, &matrix, pClrKey, NULL, NULL, nThreads, pKeyMask);
+    }
+};
+
+class CStretchBltCase : public CBenchCase
+{
+public:
+    const BITMAP *pDstBitmap;
+    const BITMAP *pSrcBitmap;
+    const COLORREF *pClrKey;
+    INT nThreads;
+    AARESAMPLE nResample;
+
+    VOID Run()
+    {
+        AAStretchBlt(pDstBitmap, 0, 0, pDstBitmap->bmWidth, pDstBitmap->bmHeight,
+            pSrcBitmap, pClrKey, FALSE, NULL, NULL, nThreads, nResample);
+    }
+};
+
+template <typename PIXELSRC>
+class CAverageColorCase : public CBenchCase
+{
+public:
+    const BITMAP *pSrcBitmap;
+    INT nChunk;
+    const COLORREF *pClrKey;
+    UINT nChecksum;
+
+    VOID Run()
+    {
+        PIXELFORMAT<32> avr, sub;
+        memset(&avr, 0, sizeof(avr));
+        memset(&sub, 0, sizeof(sub));
+        for (INT y=0 ; y+nChunk<=pSrcBitmap->bmHeight ; y+=nChunk)
+        {
+            for (INT x=0 ; x+nChunk<=pSrcBitmap->bmWidth ; x+=nChunk)
+            {
+                AAGetAverageColor<PIXELSRC>(pSrcBitmap, x, y, nChunk, nChunk, &avr, pClrKey, &sub);
+                nChecksum += avr.Blue + avr.Green + avr.Red;
+            }
+        }
+    }
+};
+
+// Calls number of one MultMatrix run
+const INT BENCH_MULT_CALLS = 1000000;
+
+class CMultMatrixCase : public CBenchCase
+{
+public:
+    XFORM_MATRIX m;
+    double dChecksum;
+
+    VOID Run()
+    {
+        XFORM_MATRIX a = { 1, 0, 0, 1, 0, 0 };
+        for (INT i=0 ; i<BENCH_MULT_CALLS ; ++i)
+        {
+            XFORM_MATRIX r;
+            MultMatrix(&r, &a, &m);
+            a = r;
+        }
+        dChecksum += a.eM11 + a.eDx;
+    }
+};
+
+//
+// Results
+//
+
+struct BENCH_RESULT
+{
+    string name;
+    double dMpixPerSec;
+    double dNsPerPixel;
+    double dCyclesPerPixel;
+};
+
+class CBenchRunner
+{
+public:
+    CBenchRunner()
+        : m_pszFilter(NULL)
+        , m_dTolerance(10.0)
+        , m_nRegressions(0)
+    {
+    }
+
+    const char *m_pszFilter;
+    double m_dTolerance;
+    map<string, double> m_baseline; // ns per pixel
+    vector<BENCH_RESULT> m_results;
+    INT m_nRegressions;
+
+    BOOL IsSelected(const string &name) const
+    {
+        return (m_pszFilter == NULL || name.find(m_pszFilter) != string::npos);
+    }
+
+    VOID Run(const string &name, CBenchCase *pCase, double dPixels)
+    {
+        double dSeconds, dCycles;
+        pCase->Measure(&dSeconds, &dCycles);
+
+        BENCH_RESULT r;
+        r.name = name;
+        r.dMpixPerSec = (dSeconds > 0) ? dPixels / dSeconds * 1e-6 : 0;
+        r.dNsPerPixel = dSeconds * 1e9 / dPixels;
+        r.dCyclesPerPixel = dCycles / dPixels;
+        m_results.push_back(r);
+
+        printf("%-44s %9.1f Mpix/s %9.2f ns/pix %9.1f cyc/pix",
+            name.c_str(), r.dMpixPerSec, r.dNsPerPixel, r.dCyclesPerPixel);
+
+        if (!m_baseline.empty())
+        {
+            map<string, double>::const_iterator it = m_baseline.find(name);
+            if (it == m_baseline.end())
+            {
+                printf("  new");
+            }
+            else
+            {
+                double dDelta = (r.dNsPerPixel - it->second) / it->second * 100.0;
+                printf("  %+6.1f%%", dDelta);
+                if (dDelta > m_dTolerance)
+                {
+                    printf(" REGRESSION");
+                    ++m_nRegressions;
+                }
+            }
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    BOOL LoadBaseline(const char *pszFile)
+    {
+        FILE *pFile = fopen(pszFile, "r");
+        if (pFile == NULL)
+            return FALSE;
+
+        char szLine[512];
+        while (fgets(szLine, sizeof(szLine), pFile) != NULL)
+        {
+            char szName[256];
+            double dMpix, dNs, dCycles;
+            if (szLine[0] != '#' && sscanf(szLine, "%255s %lf %lf %lf", szName, &dMpix, &dNs, &dCycles) == 4)
+                m_baseline[szName] = dNs;
+        }
+        fclose(pFile);
+        return TRUE;
+    }
+
+    BOOL SaveResults(const char *pszFile) const
+    {
+        FILE *pFile = fopen(pszFile, "w");
+        if (pFile == NULL)
+            return FALSE;
+
+        fprintf(pFile, "# name Mpix/s ns/pix cyc/pix\n");
+        for (size_t i=0 ; i<m_results.size() ; ++i)
+        {
+            const BENCH_RESULT &r = m_results[i];
+            fprintf(pFile, "%s %.3f %.4f %.3f\n", r.name.c_str(), r.dMpixPerSec, r.dNsPerPixel, r.dCyclesPerPixel);
+        }
+        fclose(pFile);
+        return TRUE;
+    }
+};
+
+//
+// Sweeps
+//
+
+static string FormatName(const char *pszFormat, ...)
+{
+    char szName[256];
+    va_list args;
+    va_start(args, pszFormat);
+    vsnprintf(szName, sizeof(szName), pszFormat, args);
+    va_end(args);
+    return szName;
+}
+
+static VOID RunBltSweep(CBenchRunner *pRunner, BOOL bQuick, INT nThreads)
+{
+    const INT anglesFull[] = { 0, 20, 40, 60, 80 };
+    const INT anglesQuick[] = { 0, 40, 80 };
+    const INT *pAngles = bQuick ? anglesQuick : anglesFull;
+    INT nAngles = bQuick ? 3 : 5;
+    INT nSizes = bQuick ? BENCH_QUICK_SIZES : g_sizesCount;
+
+    COLORREF clrKey = BENCH_CLR_KEY;
+
+    for (INT iSrc=0 ; iSrc<nSizes ; ++iSrc)
+    {
+        const BENCH_SIZE &src = g_sizes[iSrc];
+
+        // Sources of both formats and their key masks are shared by all cases of a size
+        CSyntheticBitmap *pSrc[2] = { NULL, NULL };
+        AAKEYMASK masks[2];
+        memset(masks, 0, sizeof(masks));
+
+        for (INT iDst=0 ; iDst<nSizes ; ++iDst)
+        {
+            const BENCH_SIZE &dst = g_sizes[iDst];
+
+            for (INT iFormat=0 ; iFormat<g_formatsCount ; ++iFormat)
+            {
+                const BENCH_FORMAT &format = g_formats[iFormat];
+                CSyntheticBitmap *pDst = NULL;
+
+                // Color key is compared per pixel (key) or taken from key mask (keymask),
+                // over is premultiplied alpha compositing
+                const char *keys[] = { "nokey", "key", "keymask", "over" };
+                for (INT iKey=0 ; iKey<4 ; ++iKey)
+                {
+                    // Stretch source to whole destination, plain source is 
+                    // resampled by every separable filter, triangle is default
+                    for (INT iResample=0 ; iResample<g_resamplesCount ; ++iResample)
+                    {
+                        const BENCH_RESAMPLE &resample = g_resamples[iResample];
+                        if ((iKey && resample.nResample != AA_RESAMPLE_TRIANGLE) || iKey >= 2)
+                            continue;
+
+                        string name = FormatName("stretch/%s-%s/a0/%d-%d/%s%s",
+                            src.pszName, dst.pszName, format.nSrcBits, format.nDstBits, keys[iKey], resample.pszSuffix);
+                        if (!pRunner->IsSelected(name))
+                            continue;
+
+                        CSyntheticBitmap *&pSrcFormat = pSrc[format.nSrcBits == 32];
+                        if (pSrcFormat == NULL)
+                        {
+                            pSrcFormat = new CSyntheticBitmap(src.nWidth, src.nHeight, format.nSrcBits);
+                            pSrcFormat->FillPattern();
+                        }
+                        if (pDst == NULL)
+                            pDst = new CSyntheticBitmap(dst.nWidth, dst.nHeight, format.nDstBits);
+
+                        CStretchBltCase stretch;
+                        stretch.pDstBitmap = pDst->GetBitmap();
+                        stretch.pSrcBitmap = pSrcFormat->GetBitmap();
+                        stretch.pClrKey = iKey ? &clrKey : NULL;
+                        stretch.nThreads = nThreads;
+                        stretch.nResample = resample.nResample;
+                        pRunner->Run(name, &stretch, (double)dst.nWidth * dst.nHeight);
+                    }
+
+                    // Rotate source and fit it into destination
+                    for (INT iAngle=0 ; iAngle<nAngles && (iKey != 3 || format.nSrcBits == 32) ; ++iAngle)
+                    {
+                        string name = FormatName("blt/%s-%s/a%d/%d-%d/%s",
+                            src.pszName, dst.pszName, pAngles[iAngle], format.nSrcBits, format.nDstBits, keys[iKey]);
+                        if (!pRunner->IsSelected(name))
+                            continue;
+
+                        CSyntheticBitmap *&pSrcFormat = pSrc[format.nSrcBits == 32];
+                        if (pSrcFormat == NULL)
+                        {
+                            pSrcFormat = new CSyntheticBitmap(src.nWidth, src.nHeight, format.nSrcBits);
+                            pSrcFormat->FillPattern();
+                        }
+                        if (pDst == NULL)
+                            pDst = new CSyntheticBitmap(dst.nWidth, dst.nHeight, format.nDstBits);
+
+                        AAKEYMASK &mask = masks[format.nSrcBits == 32];
+                        if (iKey == 2 && mask.bmMask.bmBits == NULL)
+                            AACreateKeyMask(pSrcFormat->GetBitmap(), clrKey, &mask);
+
+                        double dAngle = pAngles[iAngle] * 3.14159265358979 / 180.0;
+                        double dCos = cos(dAngle), dSin = sin(dAngle);
+                        double dBoundWidth = src.nWidth * dCos + src.nHeight * dSin;
+                        double dBoundHeight = src.nWidth * dSin + src.nHeight * dCos;
+                        double k = 0.999 * min((double)dst.nWidth / dBoundWidth, (double)dst.nHeight / dBoundHeight);
+
+                        CTransformBltCase blt;
+                        blt.pDstBitmap = pDst->GetBitmap();
+                        blt.pSrcBitmap = pSrcFormat->GetBitmap();
+                        blt.matrix.eM11 = dCos * k;
+                        blt.matrix.eM12 = dSin * k;
+                        blt.matrix.eM21 = -dSin * k;
+                        blt.matrix.eM22 = dCos * k;
+                        blt.matrix.eDx = 0;
+                        blt.matrix.eDy = 0;
+                        blt.nDstX = (INT)ceil(src.nHeight * dSin * k);
+                        blt.nDstY = 0;
+                        blt.pClrKey = (iKey == 1 || iKey == 2) ? &clrKey : NULL;
+                        blt.pKeyMask = (iKey == 2) ? &mask : NULL;
+                        blt.bOver = (iKey == 3);
+                        blt.nThreads = nThreads;
+
+                        // Pixels covered by transformed source
+                        pRunner->Run(name, &blt, (double)src.nWidth * src.nHeight * k * k);
+                    }
+                }
+
+                delete pDst;
+            }
+        }
+
+        delete pSrc[0];
+        delete pSrc[1];
+        AADeleteKeyMask(&masks[0]);
+        AADeleteKeyMask(&masks[1]);
+    }
+}
+
+static VOID RunAverageSweep(CBenchRunner *pRunner)
+{
+    const INT chunks[] = { 2, 4, 8, 16, 32 };
+    const INT nChunks = sizeof(chunks) / sizeof(chunks[0]);
+    const BENCH_SIZE &src = g_sizes[1];
+    COLORREF clrKey = BENCH_CLR_KEY;
+
+    for (INT nBits=24 ; nBits<=32 ; nBits+=8)
+    {
+        CSyntheticBitmap bmp(src.nWidth, src.nHeight, nBits);
+        bmp.FillPattern();
+
+        for (INT iChunk=0 ; iChunk<nChunks ; ++iChunk)
+        {
+            for (INT iKey=0 ; iKey<2 ; ++iKey)
+            {
+                string name = FormatName("average/%s/c%d/%d/%s",
+                    src.pszName, chunks[iChunk], nBits, iKey ? "key" : "nokey");
+                if (!pRunner->IsSelected(name))
+                    continue;
+
+                INT nChunk = chunks[iChunk];
+                double dPixels = (double)(src.nWidth / nChunk) * (src.nHeight / nChunk) * nChunk * nChunk;
+
+                if (nBits == 24)
+                {
+                    CAverageColorCase< PIXELFORMAT<24> > avr;
+                    avr.pSrcBitmap = bmp.GetBitmap();
+                    avr.nChunk = nChunk;
+                    avr.pClrKey = iKey ? &clrKey : NULL;
+                    avr.nChecksum = 0;
+                    pRunner->Run(name, &avr, dPixels);
+                }
+                else
+                {
+                    CAverageColorCase< PIXELFORMAT<32> > avr;
+                    avr.pSrcBitmap = bmp.GetBitmap();
+                    avr.nChunk = nChunk;
+                    avr.pClrKey = iKey ? &clrKey : NULL;
+                    avr.nChecksum = 0;
+                    pRunner->Run(name, &avr, dPixels);
+                }
+            }
+        }
+    }
+}
+
+static VOID RunMultMatrixSweep(CBenchRunner *pRunner)
+{
+    string name = "multmatrix";
+    if (!pRunner->IsSelected(name))
+        return;
+
+    // Rotation by 1 degree with small scale and shift keeps values finite
+    CMultMatrixCase mult;
+    double dAngle = 3.14159265358979 / 180.0;
+    mult.m.eM11 = cos(dAngle);
+    mult.m.eM12 = sin(dAngle);
+    mult.m.eM21 = -sin(dAngle);
+    mult.m.eM22 = cos(dAngle);
+    mult.m.eDx = 0.5;
+    mult.m.eDy = -0.5;
+    mult.dChecksum = 0;
+    pRunner->Run(name, &mult, (double)BENCH_MULT_CALLS);
+}
+
+int main(int argc, char *argv[])
+{
+    CBenchRunner runner;
+    BOOL bQuick = FALSE;
+    INT nThreads = 1;
+    const char *pszSave = NULL;
+    const char *pszCompare = NULL;
+
+    for (INT i=1 ; i<argc ; ++i)
+    {
+        string arg = argv[i];
+        BOOL bHasValue = (i + 1 < argc);
+        if (arg == "-quick")
+            bQuick = TRUE;
+        else if (arg == "-filter" && bHasValue)
+            runner.m_pszFilter = argv[++i];
+        else if (arg == "-threads" && bHasValue)
+            nThreads = atoi(argv[++i]);
+        else if (arg == "-save" && bHasValue)
+            pszSave = argv[++i];
+        else if (arg == "-compare" && bHasValue)
+            pszCompare = argv[++i];
+        else if (arg == "-tolerance" && bHasValue)
+            runner.m_dTolerance = atof(argv[++i]);
+        else
+        {
+            fprintf(stderr,
+                "Usage: aabench [-quick] [-filter <text>] [-threads <n>]\n"
+                "               [-save <file>] [-compare <file>] [-tolerance <percent>]\n");
+            return 2;
+        }
+    }
+
+    if (pszCompare != NULL && !runner.LoadBaseline(pszCompare))
+    {
+        fprintf(stderr, "Cannot read baseline %s\n", pszCompare);
+        return 2;
+    }
+
+    RunMultMatrixSweep(&runner);
+    RunAverageSweep(&runner);
+    RunBltSweep(&runner, bQuick, nThreads);
+
+    if (pszSave != NULL && !runner.SaveResults(pszSave))
+    {
+        fprintf(stderr, "Cannot write baseline %s\n", pszSave);
+        return 2;
+    }
+
+    if (pszCompare != NULL)
+    {
+        printf("%d regression(s) over %.1f%%\n", runner.m_nRegressions, runner.m_dTolerance);
+        if (runner.m_nRegressions > 0)
+            return 1;
+    }
+
+    return 0;
+}
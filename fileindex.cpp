@@ -0,0 +1,427 @@
+#include "stdafx.h"
+#include "fileindex.h"
+
+static const DWORD INDEX_MAGIC = 0x58444946;    // "FIDX"
+static const DWORD INDEX_VERSION = 1;
+static const DWORD MAX_NAME_LENGTH = 32767;
+
+//
+// Helpers
+//
+
+inline DWORD GetChecksum(const BYTE* pData, size_t nSize) throw()
+{
+    // FNV-1a
+    DWORD dwHash = 2166136261U;
+    for ( size_t i = 0; i < nSize; ++i )
+        dwHash = (dwHash ^ pData[i]) * 16777619U;
+    return dwHash;
+}
+
+inline BOOL ReadData(const BYTE*& pData, const BYTE* pEnd, void* pValue, size_t nSize) throw()
+{
+    if ( (size_t)(pEnd - pData) < nSize )
+        return FALSE;
+
+    memcpy(pValue, pData, nSize);
+    pData += nSize;
+    return TRUE;
+}
+
+inline BOOL ReadString(const BYTE*& pData, const BYTE* pEnd, wstring* pValue) throw(...) // exception
+{
+    DWORD nLength = 0;
+    if ( !ReadData(pData, pEnd, &nLength, sizeof(nLength)) || nLength > MAX_NAME_LENGTH ||
+         (size_t)(pEnd - pData) < nLength * sizeof(WCHAR) )
+    {
+        return FALSE;
+    }
+
+    pValue->assign((LPCWSTR)pData, nLength); // exception
+    pData += nLength * sizeof(WCHAR);
+    return TRUE;
+}
+
+inline void WriteData(vector<BYTE>* pData, const void* pValue, size_t nSize) throw(...) // exception
+{
+    pData->insert(pData->end(), (const BYTE*)pValue, (const BYTE*)pValue + nSize); // exception
+}
+
+inline void WriteString(vector<BYTE>* pData, const wstring& value) throw(...) // exception
+{
+    const DWORD nLength = (DWORD)value.size();
+    WriteData(pData, &nLength, sizeof(nLength)); // exception
+    WriteData(pData, value.c_str(), nLength * sizeof(WCHAR)); // exception
+}
+
+//
+// CFileIndex class
+//
+
+CFileIndex::CFileIndex()
+{
+}
+
+CFileIndex::~CFileIndex()
+{
+}
+
+// CFileIndex::Load
+
+BOOL CFileIndex::Load(LPCWSTR wszFile) throw()
+{
+    CComCritSecLock<CComAutoCriticalSection> lock(m_cs);
+
+    m_directories.clear();
+
+    HANDLE hFile = ::CreateFileW(wszFile, GENERIC_READ, FILE_SHARE_READ, NULL, 
+                                 OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if ( hFile == INVALID_HANDLE_VALUE )
+        return FALSE;
+
+    LARGE_INTEGER nFileSize;
+    BYTE* pFileData = NULL;
+    DWORD nRead = 0;
+    BOOL bOk = ::GetFileSizeEx(hFile, &nFileSize) && 
+               nFileSize.QuadPart >= sizeof(DWORD) * 4 && nFileSize.QuadPart <= MAXDWORD;
+    if ( bOk )
+    {
+        pFileData = (BYTE*)malloc((size_t)nFileSize.QuadPart);
+        bOk = ( pFileData != NULL && ::ReadFile(hFile, pFileData, nFileSize.LowPart, &nRead, NULL) && 
+                nRead == nFileSize.LowPart );
+    }
+
+    ::CloseHandle(hFile);
+
+    try
+    {
+        // index is whole if checksum of all data before it matches
+        DWORD dwChecksum = 0;
+        const BYTE* pEnd = bOk ? pFileData + nRead - sizeof(DWORD) : pFileData;
+        if ( bOk )
+        {
+            memcpy(&dwChecksum, pEnd, sizeof(dwChecksum));
+            bOk = ( GetChecksum(pFileData, pEnd - pFileData) == dwChecksum );
+        }
+
+        const BYTE* pData = pFileData;
+        DWORD dwMagic = 0, dwVersion = 0, nDirectories = 0;
+        bOk = bOk && ReadData(pData, pEnd, &dwMagic, sizeof(dwMagic)) && dwMagic == INDEX_MAGIC &&
+              ReadData(pData, pEnd, &dwVersion, sizeof(dwVersion)) && dwVersion == INDEX_VERSION &&
+              ReadData(pData, pEnd, &nDirectories, sizeof(nDirectories));
+
+        for ( DWORD i = 0; bOk && i < nDirectories; ++i )
+        {
+            wstring path;
+            _Directory directory;
+            bOk = ReadDirectory(pData, pEnd, &path, &directory); // exception
+            if ( bOk )
+            {
+                _Directory& entry = m_directories[path]; // exception
+                entry.ftLastWrite = directory.ftLastWrite;
+                entry.files.swap(directory.files);
+                entry.directories.swap(directory.directories);
+                entry.bVisited = FALSE;
+
+                // files are kept sorted, index may be written in listing order
+                sort(entry.files.begin(), entry.files.end(), &IsFileLess);
+            }
+        }
+    }
+    catch (...)
+    {
+        bOk = FALSE;
+    }
+
+    free(pFileData);
+
+    if ( !bOk )
+        m_directories.clear();
+
+    return bOk;
+}
+
+// CFileIndex::Save
+
+BOOL CFileIndex::Save(LPCWSTR wszFile, LPCWSTR wszRoot, BOOL bRootScanned) const throw()
+{
+    CComCritSecLock<CComAutoCriticalSection> lock(m_cs);
+
+    const size_t nRootLength = wcslen(wszRoot);
+    vector<BYTE> data;
+    try
+    {
+        // directories which are gone are not visited by complete scan
+        vector<_DirectoryMap::const_iterator> directories;
+        directories.reserve(m_directories.size()); // exception
+        for ( _DirectoryMap::const_iterator i = m_directories.begin(); i != m_directories.end(); ++i )
+        {
+            const BOOL bUnderRoot = ( _wcsnicmp(i->first.c_str(), wszRoot, nRootLength) == 0 );
+            if ( i->second.bVisited || !bRootScanned || !bUnderRoot )
+                directories.push_back(i);
+        }
+
+        const DWORD header[] = { INDEX_MAGIC, INDEX_VERSION, (DWORD)directories.size() };
+        WriteData(&data, header, sizeof(header)); // exception
+
+        for ( size_t i = 0; i < directories.size(); ++i )
+            WriteDirectory(directories[i]->first, directories[i]->second, &data); // exception
+
+        const DWORD dwChecksum = GetChecksum(&data[0], data.size());
+        WriteData(&data, &dwChecksum, sizeof(dwChecksum)); // exception
+    }
+    catch (...)
+    {
+        return FALSE;
+    }
+
+    if ( data.size() > MAXDWORD )
+        return FALSE;
+
+    // index is replaced as whole, crash leaves either old or new one
+    const wstring tempFile = wstring(wszFile) + L".tmp";
+    HANDLE hFile = ::CreateFileW(tempFile.c_str(), GENERIC_WRITE, 0, NULL, 
+                                 CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if ( hFile == INVALID_HANDLE_VALUE )
+        return FALSE;
+
+    DWORD nWritten = 0;
+    const BOOL bOk = ::WriteFile(hFile, &data[0], (DWORD)data.size(), &nWritten, NULL) && 
+                     nWritten == data.size();
+    ::CloseHandle(hFile);
+
+    if ( !bOk || !::MoveFileExW(tempFile.c_str(), wszFile, MOVEFILE_REPLACE_EXISTING) )
+    {
+        ::DeleteFileW(tempFile.c_str());
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+// CFileIndex::GetDirectory
+
+BOOL CFileIndex::GetDirectory(
+                    const wstring& path,
+                    const FILETIME& ftLastWrite,
+                    vector<WCHAR>* pFileNames,
+                    list<wstring>* pDirectories
+                    ) throw(...) // exception
+{
+    CComCritSecLock<CComAutoCriticalSection> lock(m_cs);
+
+    _DirectoryMap::iterator i = m_directories.find(path);
+    if ( i == m_directories.end() || ::CompareFileTime(&i->second.ftLastWrite, &ftLastWrite) != 0 )
+        return FALSE;
+
+    _Directory& directory = i->second;
+    for ( size_t j = 0; j < directory.files.size(); ++j )
+    {
+        const wstring& name = directory.files[j].name;
+        pFileNames->insert(pFileNames->end(), name.c_str(), name.c_str() + name.size() + 1); // exception
+    }
+    for ( size_t j = 0; j < directory.directories.size(); ++j )
+        pDirectories->push_back(path + directory.directories[j] + L"\\"); // exception
+
+    directory.bVisited = TRUE;
+    return TRUE;
+}
+
+// CFileIndex::SetDirectory
+
+void CFileIndex::SetDirectory(
+                    const wstring& path,
+                    const FILETIME& ftLastWrite,
+                    const vector<WIN32_FIND_DATAW>& entries
+                    ) throw(...) // exception
+{
+    _Directory directory;
+    directory.ftLastWrite = ftLastWrite;
+    directory.bVisited = TRUE;
+
+    for ( size_t i = 0; i < entries.size(); ++i )
+    {
+        const WIN32_FIND_DATAW& wfd = entries[i];
+        if ( wfd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY )
+        {
+            directory.directories.push_back(wfd.cFileName); // exception
+            continue;
+        }
+
+        _File file;
+        file.name = wfd.cFileName; // exception
+        file.nSize = ((ULONGLONG)wfd.nFileSizeHigh << 32) | wfd.nFileSizeLow;
+        file.ftLastWrite = wfd.ftLastWriteTime;
+        file.nWidth = 0;
+        file.nHeight = 0;
+        directory.files.push_back(file); // exception
+    }
+
+    // sorted outside of lock, so old files are merged in one pass
+    sort(directory.files.begin(), directory.files.end(), &IsFileLess);
+
+    CComCritSecLock<CComAutoCriticalSection> lock(m_cs);
+
+    // size of unchanged image is kept
+    _Directory& old = m_directories[path]; // exception
+    vector<_File>::const_iterator j = old.files.begin();
+    for ( size_t i = 0; i < directory.files.size(); ++i )
+    {
+        _File& file = directory.files[i];
+        while ( j != old.files.end() && IsFileLess(*j, file) )
+            ++j;
+
+        if ( j != old.files.end() && j->name == file.name && j->nSize == file.nSize && 
+             ::CompareFileTime(&j->ftLastWrite, &file.ftLastWrite) == 0 )
+        {
+            file.nWidth = j->nWidth;
+            file.nHeight = j->nHeight;
+        }
+    }
+
+    old.ftLastWrite = directory.ftLastWrite;
+    old.files.swap(directory.files);
+    old.directories.swap(directory.directories);
+    old.bVisited = TRUE;
+}
+
+// CFileIndex::SetImageSize
+
+void CFileIndex::SetImageSize(const wstring& path, const SIZE& sizeImage) throw()
+{
+    const size_t nNameStart = path.find_last_of(L'\\') + 1;
+
+    try
+    {
+        _File key;
+        key.name = path.substr(nNameStart); // exception
+        const wstring directory = path.substr(0, nNameStart); // exception
+
+        CComCritSecLock<CComAutoCriticalSection> lock(m_cs);
+
+        _DirectoryMap::iterator i = m_directories.find(directory);
+        if ( i == m_directories.end() )
+            return;
+
+        vector<_File>& files = i->second.files;
+        vector<_File>::iterator j = lower_bound(files.begin(), files.end(), key, &IsFileLess);
+        if ( j != files.end() && j->name == key.name )
+        {
+            j->nWidth = sizeImage.cx;
+            j->nHeight = sizeImage.cy;
+        }
+    }
+    catch (...)
+    {
+    }
+}
+
+// CFileIndex::IsFileLess
+
+bool CFileIndex::IsFileLess(const _File& file1, const _File& file2) throw()
+{
+    // exact compare, same as name match
+    return file1.name < file2.name;
+}
+
+// CFileIndex::GetDirectoryTime
+
+BOOL CFileIndex::GetDirectoryTime(const wstring& path, FILETIME* pftLastWrite) throw()
+{
+    // directory is queried without trailing backslash, unless it is drive root
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    BOOL bOk = FALSE;
+    try
+    {
+        wstring name = path.empty() ? L"." : path; // exception
+        if ( name.size() > 1 && name[name.size() - 1] == L'\\' && name[name.size() - 2] != L':' )
+            name.resize(name.size() - 1);
+
+        bOk = ::GetFileAttributesExW(name.c_str(), GetFileExInfoStandard, &data);
+    }
+    catch (...)
+    {
+    }
+
+    if ( bOk )
+        *pftLastWrite = data.ftLastWriteTime;
+    return bOk;
+}
+
+// CFileIndex::ReadDirectory
+
+BOOL CFileIndex::ReadDirectory(
+                    const BYTE*& pData,
+                    const BYTE* pEnd,
+                    wstring* pPath,
+                    _Directory* pDirectory
+                    ) throw(...) // exception
+{
+    DWORD nFiles = 0, nDirectories = 0;
+    if ( !ReadString(pData, pEnd, pPath) || // exception
+         !ReadData(pData, pEnd, &pDirectory->ftLastWrite, sizeof(FILETIME)) ||
+         !ReadData(pData, pEnd, &nFiles, sizeof(nFiles)) ||
+         !ReadData(pData, pEnd, &nDirectories, sizeof(nDirectories)) )
+    {
+        return FALSE;
+    }
+
+    // counts are checked against data left before anything is allocated
+    const size_t nLeft = pEnd - pData;
+    if ( nFiles > nLeft / sizeof(DWORD) || nDirectories > nLeft / sizeof(DWORD) )
+        return FALSE;
+
+    pDirectory->files.resize(nFiles); // exception
+    for ( DWORD i = 0; i < nFiles; ++i )
+    {
+        _File& file = pDirectory->files[i];
+        if ( !ReadString(pData, pEnd, &file.name) || // exception
+             !ReadData(pData, pEnd, &file.nSize, sizeof(file.nSize)) ||
+             !ReadData(pData, pEnd, &file.ftLastWrite, sizeof(file.ftLastWrite)) ||
+             !ReadData(pData, pEnd, &file.nWidth, sizeof(file.nWidth)) ||
+             !ReadData(pData, pEnd, &file.nHeight, sizeof(file.nHeight)) )
+        {
+            return FALSE;
+        }
+    }
+
+    pDirectory->directories.resize(nDirectories); // exception
+    for ( DWORD i = 0; i < nDirectories; ++i )
+    {
+        if ( !ReadString(pData, pEnd, &pDirectory->directories[i]) ) // exception
+            return FALSE;
+    }
+
+    pDirectory->bVisited = FALSE;
+    return TRUE;
+}
+
+// CFileIndex::WriteDirectory
+
+void CFileIndex::WriteDirectory(
+                    const wstring& path,
+                    const _Directory& directory,
+                    vector<BYTE>* pData
+                    ) throw(...) // exception
+{
+    const DWORD nFiles = (DWORD)directory.files.size();
+    const DWORD nDirectories = (DWORD)directory.directories.size();
+
+    WriteString(pData, path); // exception
+    WriteData(pData, &directory.ftLastWrite, sizeof(FILETIME)); // exception
+    WriteData(pData, &nFiles, sizeof(nFiles)); // exception
+    WriteData(pData, &nDirectories, sizeof(nDirectories)); // exception
+
+    for ( DWORD i = 0; i < nFiles; ++i )
+    {
+        const _File& file = directory.files[i];
+        WriteString(pData, file.name); // exception
+        WriteData(pData, &file.nSize, sizeof(file.nSize)); // exception
+        WriteData(pData, &file.ftLastWrite, sizeof(file.ftLastWrite)); // exception
+        WriteData(pData, &file.nWidth, sizeof(file.nWidth)); // exception
+        WriteData(pData, &file.nHeight, sizeof(file.nHeight)); // exception
+    }
+
+    for ( DWORD i = 0; i < nDirectories; ++i )
+        WriteString(pData, directory.directories[i]); // exception
+}
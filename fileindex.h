@@ -0,0 +1,72 @@
+#pragma once
+
+//
+// CFileIndex class
+// Image files of scanned directories kept between runs. Directory whose last
+// write time is unchanged has same entries, so scanner takes them from index
+// instead of listing it again. Last write time of directory does not change
+// when file is rewritten in place, so file size and time can be stale,
+// preview cache checks them itself. Methods are thread safe.
+//
+
+class CFileIndex
+{
+public:
+    CFileIndex();
+    ~CFileIndex();
+
+    // Index of other version or damaged one is ignored, FALSE then
+    BOOL Load(LPCWSTR wszFile) throw();
+
+    // Directories of wszRoot not visited since Load are dropped if bRootScanned
+    BOOL Save(LPCWSTR wszFile, LPCWSTR wszRoot, BOOL bRootScanned) const throw();
+
+    // Entries of directory if its last write time matches. File names are
+    // appended one after another, each ends with NUL, directory paths are appended.
+    BOOL GetDirectory(
+            const wstring& path,            // ends with backslash
+            const FILETIME& ftLastWrite,
+            vector<WCHAR>* pFileNames,
+            list<wstring>* pDirectories
+            ) throw(...); // exception
+
+    // Entries are image files and subdirectories of listing
+    void SetDirectory(
+            const wstring& path,
+            const FILETIME& ftLastWrite,
+            const vector<WIN32_FIND_DATAW>& entries
+            ) throw(...); // exception
+
+    // Image size is learned when image is decoded
+    void SetImageSize(const wstring& path, const SIZE& sizeImage) throw();
+
+    static BOOL GetDirectoryTime(const wstring& path, FILETIME* pftLastWrite) throw();
+
+private:
+    struct _File
+    {
+        wstring name;
+        ULONGLONG nSize;
+        FILETIME ftLastWrite;
+        LONG nWidth;                // 0 if image is not decoded yet
+        LONG nHeight;
+    };
+
+    struct _Directory
+    {
+        FILETIME ftLastWrite;
+        vector<_File> files;        // sorted by name
+        vector<wstring> directories;
+        BOOL bVisited;
+    };
+
+    typedef map<wstring, _Directory> _DirectoryMap;
+
+    static BOOL ReadDirectory(const BYTE*& pData, const BYTE* pEnd, wstring* pPath, _Directory* pDirectory) throw(...); // exception
+    static void WriteDirectory(const wstring& path, const _Directory& directory, vector<BYTE>* pData) throw(...); // exception
+    static bool IsFileLess(const _File& file1, const _File& file2) throw();
+
+private:
+    mutable CComAutoCriticalSection m_cs;
+    _DirectoryMap m_directories;
+};
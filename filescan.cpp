@@ -0,0 +1,351 @@
+#include "stdafx.h"
+#include "filescan.h"
+#include "playlist.h"
+#include "fileindex.h"
+#include <process.h>
+
+//
+// CImageFileScanner class
+//
+
+CImageFileScanner::CImageFileScanner(const LPCWSTR* pExtensions, UINT nExtensions) throw(...) // exception
+    : m_extensions(pExtensions, pExtensions + nExtensions) // exception
+    , m_pPlaylist(NULL)
+    , m_pIndex(NULL)
+    , m_nPending(0)
+    , m_bCancelled(FALSE)
+    , m_bFinished(FALSE)
+    , m_hScanThread(NULL)
+    , m_nThreads(0)
+{
+    m_hQueueSemaphore = ::CreateSemaphoreW(NULL, 0, LONG_MAX, NULL);
+    m_hDoneEvent = ::CreateEventW(NULL, TRUE, FALSE, NULL);
+}
+
+CImageFileScanner::~CImageFileScanner()
+{
+    Stop();
+
+    if ( m_hQueueSemaphore != NULL )
+        ::CloseHandle(m_hQueueSemaphore);
+    if ( m_hDoneEvent != NULL )
+        ::CloseHandle(m_hDoneEvent);
+}
+
+// CImageFileScanner::Scan
+
+void CImageFileScanner::Scan(
+                    LPCWSTR wszRoot,
+                    CPlaylist* pPlaylist,
+                    CFileIndex* pIndex /* = NULL */,
+                    UINT nThreads /* = 4 */
+                    ) throw(...) // exception
+{
+    Stop();
+    Reset();
+
+    Run(wszRoot, pPlaylist, pIndex, nThreads); // exception
+}
+
+// CImageFileScanner::Start
+
+BOOL CImageFileScanner::Start(
+                    LPCWSTR wszRoot,
+                    CPlaylist* pPlaylist,
+                    CFileIndex* pIndex /* = NULL */,
+                    UINT nThreads /* = 4 */
+                    ) throw(...) // exception
+{
+    Stop();
+    Reset();
+
+    m_root = wszRoot; // exception
+    m_pPlaylist = pPlaylist;
+    m_pIndex = pIndex;
+    m_nThreads = nThreads;
+
+    // scan is reset before thread starts, so Stop is never missed
+    m_hScanThread = (HANDLE)_beginthreadex(NULL, 0, ScanThreadProc, this, 0, NULL);
+    return ( m_hScanThread != NULL );
+}
+
+// CImageFileScanner::Stop
+
+void CImageFileScanner::Stop() throw()
+{
+    if ( m_hScanThread == NULL )
+        return;
+
+    // workers leave on done event, listing in progress checks flag
+    ::InterlockedExchange(&m_bCancelled, TRUE);
+    if ( m_hDoneEvent != NULL )
+        ::SetEvent(m_hDoneEvent);
+
+    ::WaitForSingleObject(m_hScanThread, INFINITE);
+    ::CloseHandle(m_hScanThread);
+    m_hScanThread = NULL;
+}
+
+// CImageFileScanner::IsFinished
+
+BOOL CImageFileScanner::IsFinished() const throw()
+{
+    return m_bFinished;
+}
+
+// CImageFileScanner::ScanThreadProc
+
+unsigned __stdcall CImageFileScanner::ScanThreadProc(void* pParam)
+{
+    CImageFileScanner* pScanner = (CImageFileScanner*)pParam;
+
+    // playlist is completed anyway, slideshow shows what is found
+    try
+    {
+        pScanner->Run(pScanner->m_root.c_str(), pScanner->m_pPlaylist, pScanner->m_pIndex,
+                      pScanner->m_nThreads); // exception
+    }
+    catch (...)
+    {
+    }
+
+    return 0;
+}
+
+// CImageFileScanner::Reset
+
+void CImageFileScanner::Reset() throw()
+{
+    m_directories.clear();
+    m_nPending = 0;
+    m_bCancelled = FALSE;
+    m_bFinished = FALSE;
+
+    // directories dropped by stopped scan are still counted
+    if ( m_hQueueSemaphore != NULL )
+    {
+        while ( ::WaitForSingleObject(m_hQueueSemaphore, 0) == WAIT_OBJECT_0 )
+            ;
+    }
+
+    if ( m_hDoneEvent != NULL )
+        ::ResetEvent(m_hDoneEvent);
+}
+
+// CImageFileScanner::Run
+
+void CImageFileScanner::Run(
+                    LPCWSTR wszRoot,
+                    CPlaylist* pPlaylist,
+                    CFileIndex* pIndex,
+                    UINT nThreads
+                    ) throw(...) // exception
+{
+    m_pPlaylist = pPlaylist;
+    m_pIndex = pIndex;
+
+    try
+    {
+        PushDirectory(wszRoot); // exception
+
+        if ( m_hQueueSemaphore != NULL && m_hDoneEvent != NULL )
+        {
+            // calling thread is one of workers
+            PTP_WORK pWork = NULL;
+            if ( nThreads > 1 )
+                pWork = ::CreateThreadpoolWork(&WorkCallback, this, NULL);
+
+            if ( pWork != NULL )
+            {
+                for ( UINT i = 1; i < nThreads; ++i )
+                    ::SubmitThreadpoolWork(pWork);
+            }
+
+            Work();
+
+            if ( pWork != NULL )
+            {
+                ::WaitForThreadpoolWorkCallbacks(pWork, FALSE);
+                ::CloseThreadpoolWork(pWork);
+            }
+        }
+        else
+        {
+            // no workers, tree is listed by calling thread
+            while ( !m_directories.empty() && !m_bCancelled )
+            {
+                wstring path;
+                path.swap(m_directories.front());
+                m_directories.pop_front();
+
+                ScanDirectory(path); // exception
+            }
+        }
+    }
+    catch (...)
+    {
+        pPlaylist->SetComplete();
+        throw;
+    }
+
+    m_bFinished = !m_bCancelled;
+    pPlaylist->SetComplete();
+}
+
+// CImageFileScanner::WorkCallback
+
+VOID CALLBACK CImageFileScanner::WorkCallback(PTP_CALLBACK_INSTANCE, PVOID pvScanner, PTP_WORK)
+{
+    ((CImageFileScanner*)pvScanner)->Work();
+}
+
+// CImageFileScanner::Work
+
+void CImageFileScanner::Work() throw()
+{
+    HANDLE handles[] = { m_hDoneEvent, m_hQueueSemaphore };
+
+    while ( ::WaitForMultipleObjects(2, handles, FALSE, INFINITE) == WAIT_OBJECT_0 + 1 )
+    {
+        wstring path;
+        {
+            CComCritSecLock<CComAutoCriticalSection> lock(m_cs);
+            path.swap(m_directories.front());
+            m_directories.pop_front();
+        }
+
+        // directory is skipped if memory runs out
+        try
+        {
+            ScanDirectory(path); // exception
+        }
+        catch (...)
+        {
+        }
+
+        // subdirectories are queued before their parent is done
+        if ( ::InterlockedDecrement(&m_nPending) == 0 )
+            ::SetEvent(m_hDoneEvent);
+    }
+}
+
+// CImageFileScanner::ScanDirectory
+
+void CImageFileScanner::ScanDirectory(const wstring& path) throw(...) // exception
+{
+    // names are packed one after another, directory costs few allocations
+    vector<WCHAR> names;
+
+    // directory is not listed if its entries are same as in index
+    FILETIME ftLastWrite = { 0 };
+    const BOOL bIndex = ( m_pIndex != NULL && CFileIndex::GetDirectoryTime(path, &ftLastWrite) );
+    if ( bIndex )
+    {
+        list<wstring> directories;
+        if ( m_pIndex->GetDirectory(path, ftLastWrite, &names, &directories) ) // exception
+        {
+            for ( list<wstring>::const_iterator i = directories.begin(); i != directories.end(); ++i )
+                PushDirectory(*i); // exception
+
+            AppendFiles(path, names); // exception
+            return;
+        }
+    }
+
+    // one listing serves all extensions and subdirectories
+    WIN32_FIND_DATAW wfd = { 0 };
+    HANDLE hFind = ::FindFirstFileW((path + L"*").c_str(), &wfd); // exception
+    if ( hFind == INVALID_HANDLE_VALUE )
+        return;
+
+    vector<WIN32_FIND_DATAW> entries; // for index
+    try
+    {
+        do
+        {
+            if ( wfd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY )
+            {
+                if ( wcscmp(wfd.cFileName, L".") != 0 && wcscmp(wfd.cFileName, L"..") != 0 )
+                {
+                    PushDirectory(path + wfd.cFileName + L"\\"); // exception
+                    if ( bIndex )
+                        entries.push_back(wfd); // exception
+                }
+            }
+            else if ( IsImageFile(wfd.cFileName) )
+            {
+                names.insert(names.end(), wfd.cFileName, wfd.cFileName + wcslen(wfd.cFileName) + 1); // exception
+                if ( bIndex )
+                    entries.push_back(wfd); // exception
+            }
+        }
+        while ( !m_bCancelled && ::FindNextFileW(hFind, &wfd) );
+    }
+    catch (...)
+    {
+        ::FindClose(hFind);
+        throw;
+    }
+
+    ::FindClose(hFind);
+
+    // time is taken before listing, so change made meanwhile is listed next run
+    if ( bIndex && !m_bCancelled )
+        m_pIndex->SetDirectory(path, ftLastWrite, entries); // exception
+
+    AppendFiles(path, names); // exception
+}
+
+// CImageFileScanner::PushDirectory
+
+void CImageFileScanner::PushDirectory(const wstring& path) throw(...) // exception
+{
+    CComCritSecLock<CComAutoCriticalSection> lock(m_cs);
+
+    m_directories.push_back(path); // exception
+    ::InterlockedIncrement(&m_nPending);
+
+    if ( m_hQueueSemaphore != NULL )
+        ::ReleaseSemaphore(m_hQueueSemaphore, 1, NULL);
+}
+
+// CImageFileScanner::AppendFiles
+
+void CImageFileScanner::AppendFiles(const wstring& path, const vector<WCHAR>& names) throw(...) // exception
+{
+    vector<LPCWSTR> files;
+    for ( size_t i = 0; i < names.size(); i += wcslen(&names[i]) + 1 )
+        files.push_back(&names[i]); // exception
+
+    if ( files.empty() )
+        return;
+
+    // directory is shown in order whatever worker lists it
+    sort(files.begin(), files.end(), &IsNameLess);
+    m_pPlaylist->Append(path, &files[0], (UINT)files.size()); // exception
+}
+
+// CImageFileScanner::IsImageFile
+
+BOOL CImageFileScanner::IsImageFile(LPCWSTR wszName) const throw()
+{
+    LPCWSTR wszExtension = wcsrchr(wszName, L'.');
+    if ( wszExtension == NULL )
+        return FALSE;
+
+    ++wszExtension;
+    for ( size_t i = 0; i < m_extensions.size(); ++i )
+    {
+        if ( _wcsicmp(wszExtension, m_extensions[i].c_str()) == 0 )
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+// CImageFileScanner::IsNameLess
+
+bool CImageFileScanner::IsNameLess(LPCWSTR wszName1, LPCWSTR wszName2) throw()
+{
+    return _wcsicmp(wszName1, wszName2) < 0;
+}
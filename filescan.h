@@ -0,0 +1,76 @@
+#pragma once
+
+// forward declaration
+class CPlaylist;
+class CFileIndex;
+
+//
+// CImageFileScanner class
+// Finds image files of directory tree. Each directory is listed once for all
+// extensions, subdirectories are listed in parallel by thread pool workers.
+// Files of each directory go to playlist as soon as it is listed.
+// Directories unchanged since index was saved are taken from it.
+//
+
+class CImageFileScanner
+{
+public:
+    // Extensions are given without dot, e.g. L"jpg", case is ignored
+    CImageFileScanner(const LPCWSTR* pExtensions, UINT nExtensions) throw(...); // exception
+    ~CImageFileScanner();
+
+    // Files of directory are appended sorted by name, wszRoot ends with backslash.
+    // Playlist is completed when tree is listed or scan is stopped.
+    // nThreads is workers number including calling thread, listing waits
+    // for disk or network mostly, so it is not bound to processors number.
+    void Scan(
+            LPCWSTR wszRoot,
+            CPlaylist* pPlaylist,
+            CFileIndex* pIndex = NULL,
+            UINT nThreads = 4
+            ) throw(...); // exception
+
+    // Same as Scan on background thread, FALSE if thread is not started
+    BOOL Start(
+            LPCWSTR wszRoot,
+            CPlaylist* pPlaylist,
+            CFileIndex* pIndex = NULL,
+            UINT nThreads = 4
+            ) throw(...); // exception
+
+    // Cancels scan and waits for it, directories not listed yet are dropped
+    void Stop() throw();
+
+    // Whole tree is listed, scan is not stopped
+    BOOL IsFinished() const throw();
+
+private:
+    static unsigned __stdcall ScanThreadProc(void* pParam);
+    void Reset() throw();
+    void Run(LPCWSTR wszRoot, CPlaylist* pPlaylist, CFileIndex* pIndex, UINT nThreads) throw(...); // exception
+    static VOID CALLBACK WorkCallback(PTP_CALLBACK_INSTANCE, PVOID pvScanner, PTP_WORK);
+    void Work() throw();
+    void ScanDirectory(const wstring& path) throw(...); // exception
+    void PushDirectory(const wstring& path) throw(...); // exception
+    void AppendFiles(const wstring& path, const vector<WCHAR>& names) throw(...); // exception
+    BOOL IsImageFile(LPCWSTR wszName) const throw();
+    static bool IsNameLess(LPCWSTR wszName1, LPCWSTR wszName2) throw();
+
+private:
+    vector<wstring> m_extensions;
+    CPlaylist* m_pPlaylist;
+    CFileIndex* m_pIndex;
+
+    CComAutoCriticalSection m_cs;
+    list<wstring> m_directories;    // queued to be listed
+    volatile LONG m_nPending;       // directories queued or being listed
+    volatile LONG m_bCancelled;
+    volatile LONG m_bFinished;
+    HANDLE m_hQueueSemaphore;       // count of queued directories
+    HANDLE m_hDoneEvent;            // set when all directories are listed or scan is stopped
+
+    // background scan
+    HANDLE m_hScanThread;
+    wstring m_root;
+    UINT m_nThreads;
+};
@@ -0,0 +1,120 @@
+#include "stdafx.h"
+#include "framebuf.h"
+
+//
+// CFrameBuffers class
+//
+
+CFrameBuffers::CFrameBuffers()
+    : m_nBack(0)
+    , m_nFront(1)
+    , m_nReady(2)
+{
+    ::ZeroMemory(m_hDCs, sizeof(m_hDCs));
+    ::ZeroMemory(m_hBmps, sizeof(m_hBmps));
+    ::ZeroMemory(m_hOldBmps, sizeof(m_hOldBmps));
+    ::ZeroMemory(m_rectStale, sizeof(m_rectStale));
+}
+
+CFrameBuffers::~CFrameBuffers()
+{
+    Destroy();
+}
+
+// CFrameBuffers::Create
+
+BOOL CFrameBuffers::Create(int nWidth, int nHeight, Color clrBackground /* = Color::Black */) throw()
+{
+    Destroy();
+
+    // buffers are made by GDI+ like view bitmap
+    for ( UINT i = 0; i < BUFFERS; ++i )
+    {
+        Bitmap image(max(nWidth, 1), max(nHeight, 1), PixelFormat32bppARGB);
+        if ( image.GetLastStatus() != Ok || image.GetHBITMAP(clrBackground, &m_hBmps[i]) != Ok )
+        {
+            Destroy();
+            return FALSE;
+        }
+
+        m_hDCs[i] = ::CreateCompatibleDC(NULL);
+        if ( m_hDCs[i] == NULL )
+        {
+            Destroy();
+            return FALSE;
+        }
+
+        m_hOldBmps[i] = ::SelectObject(m_hDCs[i], m_hBmps[i]);
+    }
+
+    // buffers are same as view of background color
+    ::ZeroMemory(m_rectStale, sizeof(m_rectStale));
+
+    m_nBack = 0;
+    m_nFront = 1;
+    m_nReady = 2;
+    return TRUE;
+}
+
+// CFrameBuffers::Destroy
+
+void CFrameBuffers::Destroy() throw()
+{
+    for ( UINT i = 0; i < BUFFERS; ++i )
+    {
+        if ( m_hDCs[i] != NULL )
+        {
+            ::SelectObject(m_hDCs[i], m_hOldBmps[i]);
+            ::DeleteDC(m_hDCs[i]);
+        }
+        if ( m_hBmps[i] != NULL )
+            ::DeleteObject(m_hBmps[i]);
+    }
+
+    ::ZeroMemory(m_hDCs, sizeof(m_hDCs));
+    ::ZeroMemory(m_hBmps, sizeof(m_hBmps));
+    ::ZeroMemory(m_hOldBmps, sizeof(m_hOldBmps));
+}
+
+// CFrameBuffers::Update
+
+void CFrameBuffers::Update(HDC hViewDC, const RECT& rectDamage) throw()
+{
+    // buffers held by UI or waiting for it miss damage too, it is copied when they are back
+    for ( UINT i = 0; i < BUFFERS; ++i )
+        ::UnionRect(&m_rectStale[i], &m_rectStale[i], &rectDamage);
+
+    const RECT& rect = m_rectStale[m_nBack];
+    if ( !::IsRectEmpty(&rect) )
+    {
+        ::BitBlt(m_hDCs[m_nBack], rect.left, rect.top, rect.right - rect.left, rect.bottom - rect.top, 
+                 hViewDC, rect.left, rect.top, SRCCOPY);
+    }
+
+    ::SetRectEmpty(&m_rectStale[m_nBack]);
+}
+
+// CFrameBuffers::Publish
+
+void CFrameBuffers::Publish() throw()
+{
+    // GDI batch is drawn before buffer is given away
+    ::GdiFlush();
+
+    // frame not taken by UI is dropped, its buffer is drawn again
+    const LONG nReady = ::InterlockedExchange(&m_nReady, m_nBack | FRESH);
+    m_nBack = nReady & INDEX_MASK;
+}
+
+// CFrameBuffers::AcquireFront
+
+HDC CFrameBuffers::AcquireFront() throw()
+{
+    if ( m_nReady & FRESH )
+    {
+        const LONG nReady = ::InterlockedExchange(&m_nReady, m_nFront);
+        m_nFront = nReady & INDEX_MASK;
+    }
+
+    return m_hDCs[m_nFront];
+}
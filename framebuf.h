@@ -0,0 +1,46 @@
+#pragma once
+
+//
+// CFrameBuffers class
+// Triple buffer of frames drawn by render thread and shown by UI thread.
+// Render thread draws back buffer and publishes it, UI thread takes latest
+// published frame. Buffers are passed by interlocked exchange of one index,
+// neither side ever waits for the other. Each buffer keeps area it missed
+// since it was drawn, only that area is copied to it from view.
+//
+
+class CFrameBuffers
+{
+public:
+    CFrameBuffers();
+    ~CFrameBuffers();
+
+    BOOL Create(int nWidth, int nHeight, Color clrBackground = Color::Black) throw();
+    void Destroy() throw();
+
+    // Render thread: view is changed in rectDamage, it is copied to back buffer
+    void Update(HDC hViewDC, const RECT& rectDamage) throw();
+
+    // Render thread: back buffer becomes latest frame
+    void Publish() throw();
+
+    // UI thread: latest published frame, previous one while no new is published
+    HDC AcquireFront() throw();
+
+private:
+    enum
+    {
+        BUFFERS = 3,
+        INDEX_MASK = 3,
+        FRESH = 4                       // ready buffer is not taken yet
+    };
+
+    HDC m_hDCs[BUFFERS];
+    HBITMAP m_hBmps[BUFFERS];
+    HGDIOBJ m_hOldBmps[BUFFERS];
+    RECT m_rectStale[BUFFERS];          // render thread only
+
+    LONG m_nBack;                       // render thread only
+    LONG m_nFront;                      // UI thread only
+    volatile LONG m_nReady;             // index and FRESH flag
+};
@@ -0,0 +1,130 @@
+#include "stdafx.h"
+#include "framesched.h"
+
+//
+// CFrameScheduler class
+//
+
+CFrameScheduler::CFrameScheduler(UINT nFramesPerSecond /* = 60 */) throw()
+    : m_hTimer(NULL)
+    , m_bTimePeriod(FALSE)
+    , m_nFramesPerSecond(max(min(nFramesPerSecond, 1000U), 1U))
+    , m_nFrequency(0)
+    , m_nPeriod(0)
+    , m_nStart(0)
+    , m_nTick(0)
+    , m_nFrameStart(0)
+    , m_nFrames(0)
+    , m_nMissed(0)
+{
+    LARGE_INTEGER nFrequency = { 0 };
+    ::QueryPerformanceFrequency(&nFrequency);
+    m_nFrequency = max(nFrequency.QuadPart, 1LL);
+    m_nPeriod = m_nFrequency / m_nFramesPerSecond;
+
+    LARGE_INTEGER nNow;
+    ::QueryPerformanceCounter(&nNow);
+    m_nStart = nNow.QuadPart;
+
+    // default timer resolution is 15.6 ms, longer than frame
+    m_bTimePeriod = ( ::timeBeginPeriod(1) == TIMERR_NOERROR );
+
+    // timer is set for each deadline, it fires once
+    m_hTimer = ::CreateWaitableTimer(NULL, FALSE, NULL);
+}
+
+CFrameScheduler::~CFrameScheduler()
+{
+    if ( m_hTimer != NULL )
+    {
+        ::CancelWaitableTimer(m_hTimer);
+        ::CloseHandle(m_hTimer);
+    }
+
+    if ( m_bTimePeriod )
+        ::timeEndPeriod(1);
+}
+
+// CFrameScheduler::GetDeadline
+
+LONGLONG CFrameScheduler::GetDeadline(ULONGLONG nTick) const throw()
+{
+    // product does not overflow for years of frames
+    return m_nStart + (LONGLONG)(nTick * m_nFrequency / m_nFramesPerSecond);
+}
+
+// CFrameScheduler::Wait
+
+BOOL CFrameScheduler::Wait(HANDLE hCancelEvent) throw()
+{
+    LARGE_INTEGER nNow;
+    ::QueryPerformanceCounter(&nNow);
+
+    // deadlines passed while frame was drawn are skipped
+    ULONGLONG nTick = m_nTick + 1;
+    if ( GetDeadline(nTick) <= nNow.QuadPart )
+        nTick = (ULONGLONG)(nNow.QuadPart - m_nStart) * m_nFramesPerSecond / m_nFrequency + 1;
+
+    const LONGLONG nRemaining = GetDeadline(nTick) - nNow.QuadPart;
+
+    // timer takes 100 ns units, relative time is negative
+    LARGE_INTEGER nDueTime;
+    nDueTime.QuadPart = -max(nRemaining * 10000000 / m_nFrequency, 1LL);
+
+    // without timer frames are paced by wait timeout
+    DWORD dwWait = WAIT_FAILED;
+    if ( m_hTimer != NULL && ::SetWaitableTimer(m_hTimer, &nDueTime, 0, NULL, NULL, FALSE) )
+    {
+        HANDLE handles[] = { hCancelEvent, m_hTimer };
+        dwWait = ::WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+        if ( dwWait != WAIT_OBJECT_0 + 1 )
+            return FALSE;
+    }
+    else
+    {
+        const DWORD dwRemainingMsec = (DWORD)((nRemaining * 1000 + m_nFrequency - 1) / m_nFrequency);
+        dwWait = ::WaitForSingleObject(hCancelEvent, dwRemainingMsec);
+        if ( dwWait != WAIT_TIMEOUT )
+            return FALSE;
+    }
+
+    m_nTick = nTick;
+
+    ::QueryPerformanceCounter(&nNow);
+    m_nFrameStart = nNow.QuadPart;
+    return TRUE;
+}
+
+// CFrameScheduler::EndFrame
+
+void CFrameScheduler::EndFrame() throw()
+{
+    LARGE_INTEGER nNow;
+    ::QueryPerformanceCounter(&nNow);
+    ++m_nFrames;
+
+    // frame is due to be shown before next deadline
+    const LONGLONG nElapsed = nNow.QuadPart - m_nFrameStart;
+    if ( m_nPeriod > 0 && nElapsed > m_nPeriod )
+    {
+        const UINT nMissed = (UINT)(nElapsed / m_nPeriod);
+        m_nMissed += nMissed;
+
+        ATLTRACE(L"Frame %u took %u ms, %u deadlines missed, %u in total\n", 
+                 m_nFrames, (UINT)(nElapsed * 1000 / m_nFrequency), nMissed, m_nMissed);
+    }
+}
+
+// CFrameScheduler::GetFrameCount
+
+UINT CFrameScheduler::GetFrameCount() const throw()
+{
+    return m_nFrames;
+}
+
+// CFrameScheduler::GetMissedCount
+
+UINT CFrameScheduler::GetMissedCount() const throw()
+{
+    return m_nMissed;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+//
+// CFrameScheduler class
+// Paces frames of render thread by waitable timer. Thread sleeps between
+// frames, so idle slideshow takes no CPU.
+// Deadlines are accumulated from performance counter, so rate is exact
+// even if period is not whole milliseconds. Timer resolution is raised
+// to 1 ms while scheduler exists.
+// Frame which takes longer than period misses deadlines, they are counted
+// and skipped, not caught up.
+//
+
+class CFrameScheduler
+{
+public:
+    CFrameScheduler(UINT nFramesPerSecond = 60) throw();
+    ~CFrameScheduler();
+
+    // Waits for next frame, FALSE if hCancelEvent is set first
+    BOOL Wait(HANDLE hCancelEvent) throw();
+
+    // Frame is drawn, it is checked against its deadline
+    void EndFrame() throw();
+
+    UINT GetFrameCount() const throw();
+    UINT GetMissedCount() const throw();
+
+private:
+    // Performance counter value of deadline nTick
+    LONGLONG GetDeadline(ULONGLONG nTick) const throw();
+
+private:
+    HANDLE m_hTimer;
+    BOOL m_bTimePeriod;             // timeBeginPeriod succeeded
+    UINT m_nFramesPerSecond;
+    LONGLONG m_nFrequency;          // performance counter ticks per second
+    LONGLONG m_nPeriod;             // performance counter ticks
+    LONGLONG m_nStart;              // deadlines are counted from it
+    ULONGLONG m_nTick;              // deadline of current frame
+    LONGLONG m_nFrameStart;
+    UINT m_nFrames;
+    UINT m_nMissed;
+};
@@ -0,0 +1,403 @@
+#include "imageio.h"
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <vector>
+
+using namespace std;
+
+//
+// Helpers
+//
+
+// Largest side of decoded image, guards against broken headers
+static const LONG MAX_IMAGE_SIDE = 65535;
+
+inline DWORD ReadLE16(const BYTE* p) throw()
+{
+    return (DWORD)p[0] | ((DWORD)p[1] << 8);
+}
+
+inline DWORD ReadLE32(const BYTE* p) throw()
+{
+    return (DWORD)p[0] | ((DWORD)p[1] << 8) | ((DWORD)p[2] << 16) | ((DWORD)p[3] << 24);
+}
+
+inline void WriteLE16(BYTE* p, DWORD dwValue) throw()
+{
+    p[0] = (BYTE)dwValue;
+    p[1] = (BYTE)(dwValue >> 8);
+}
+
+inline void WriteLE32(BYTE* p, DWORD dwValue) throw()
+{
+    p[0] = (BYTE)dwValue;
+    p[1] = (BYTE)(dwValue >> 8);
+    p[2] = (BYTE)(dwValue >> 16);
+    p[3] = (BYTE)(dwValue >> 24);
+}
+
+// Sample of 0...nMaxVal range to 0...255
+inline BYTE ScalePpmSample(BYTE nSample, LONG nMaxVal) throw()
+{
+    return (nSample >= nMaxVal) ? 255 : (BYTE)(nSample * 255 / nMaxVal);
+}
+
+static vector<CImageIO::PFNDECODER>& GetDecoders()
+{
+    static vector<CImageIO::PFNDECODER> decoders;
+    return decoders;
+}
+
+// Reads PPM header token, comments are skipped
+static bool ReadPpmNumber(const BYTE* pData, size_t nSize, size_t* pnPos, LONG* pnValue) throw()
+{
+    size_t nPos = *pnPos;
+    for ( ;; )
+    {
+        while ( nPos < nSize && isspace(pData[nPos]) )
+            ++nPos;
+        if ( nPos < nSize && pData[nPos] == '#' )
+        {
+            while ( nPos < nSize && pData[nPos] != '\n' )
+                ++nPos;
+            continue;
+        }
+        break;
+    }
+
+    LONG nValue = 0;
+    size_t nDigits = 0;
+    while ( nPos < nSize && isdigit(pData[nPos]) && nDigits < 9 )
+    {
+        nValue = nValue * 10 + (pData[nPos] - '0');
+        ++nPos, ++nDigits;
+    }
+    if ( nDigits == 0 )
+        return false;
+
+    *pnPos = nPos;
+    *pnValue = nValue;
+    return true;
+}
+
+//
+// CImageIO class
+//
+
+// CImageIO::RegisterDecoder
+
+void CImageIO::RegisterDecoder(PFNDECODER pfnDecoder) // exception
+{
+    ASSERT(pfnDecoder != NULL);
+    GetDecoders().push_back(pfnDecoder); // exception
+}
+
+// CImageIO::Decode
+
+bool CImageIO::Decode(
+                const BYTE* pData,
+                size_t nSize,
+                CSurface* pSurface
+                ) // exception
+{
+    ASSERT(pData != NULL || nSize == 0);
+    ASSERT(pSurface != NULL);
+
+    const vector<PFNDECODER>& decoders = GetDecoders();
+    for ( size_t i = 0; i < decoders.size(); ++i )
+    {
+        if ( decoders[i](pData, nSize, pSurface) )
+            return true;
+    }
+
+    return DecodeBmp(pData, nSize, pSurface) || DecodePpm(pData, nSize, pSurface); // exception
+}
+
+// CImageIO::Load
+
+bool CImageIO::Load(
+                const char* szFile,
+                CSurface* pSurface
+                ) // exception
+{
+    FILE* pFile = fopen(szFile, "rb");
+    if ( pFile == NULL )
+        return false;
+
+    vector<BYTE> data;
+    BYTE buffer[64 * 1024];
+    size_t nRead;
+    while ( (nRead = fread(buffer, 1, sizeof(buffer), pFile)) > 0 )
+    {
+        try
+        {
+            data.insert(data.end(), buffer, buffer + nRead); // exception
+        }
+        catch ( ... )
+        {
+            fclose(pFile);
+            throw;
+        }
+    }
+    fclose(pFile);
+
+    if ( data.empty() )
+        return false;
+
+    return Decode(&data[0], data.size(), pSurface); // exception
+}
+
+// CImageIO::Save
+
+bool CImageIO::Save(
+                const char* szFile,
+                const CSurface& surface
+                ) throw()
+{
+    const char* szExt = strrchr(szFile, '.');
+    if ( szExt != NULL && (strcmp(szExt, ".ppm") == 0 || strcmp(szExt, ".pnm") == 0 ||
+                           strcmp(szExt, ".PPM") == 0 || strcmp(szExt, ".PNM") == 0) )
+    {
+        return SavePpm(szFile, surface);
+    }
+    return SaveBmp(szFile, surface);
+}
+
+// CImageIO::SaveBmp
+// 24bpp bottom-up BI_RGB bitmap
+
+bool CImageIO::SaveBmp(
+                const char* szFile,
+                const CSurface& surface
+                ) throw()
+{
+    ASSERT(!surface.IsEmpty());
+
+    const UINT nWidth = surface.GetWidth();
+    const UINT nHeight = surface.GetHeight();
+    const DWORD dwStride = (nWidth * 3 + 3) & ~3u;
+    const DWORD dwHeadersSize = 14 + 40;
+
+    BYTE headers[14 + 40] = { 0 };
+    headers[0] = 'B';
+    headers[1] = 'M';
+    WriteLE32(headers + 2, dwHeadersSize + dwStride * nHeight);
+    WriteLE32(headers + 10, dwHeadersSize);
+    WriteLE32(headers + 14, 40);
+    WriteLE32(headers + 18, nWidth);
+    WriteLE32(headers + 22, nHeight);
+    WriteLE16(headers + 26, 1);
+    WriteLE16(headers + 28, 24);
+    WriteLE32(headers + 34, dwStride * nHeight);
+
+    FILE* pFile = fopen(szFile, "wb");
+    if ( pFile == NULL )
+        return false;
+
+    bool bResult = (fwrite(headers, 1, sizeof(headers), pFile) == sizeof(headers));
+
+    vector<BYTE> row;
+    try
+    {
+        row.resize(dwStride, 0); // exception
+    }
+    catch ( ... )
+    {
+        bResult = false;
+    }
+
+    for ( UINT y = nHeight; bResult && y-- > 0; )
+    {
+        const BYTE* pSrc = surface.GetRow(y);
+        for ( UINT x = 0; x < nWidth; ++x, pSrc += 4 )
+        {
+            row[x * 3 + 0] = pSrc[0];
+            row[x * 3 + 1] = pSrc[1];
+            row[x * 3 + 2] = pSrc[2];
+        }
+        bResult = (fwrite(&row[0], 1, dwStride, pFile) == dwStride);
+    }
+
+    return (fclose(pFile) == 0) && bResult;
+}
+
+// CImageIO::SavePpm
+// Binary P6 pixmap
+
+bool CImageIO::SavePpm(
+                const char* szFile,
+                const CSurface& surface
+                ) throw()
+{
+    ASSERT(!surface.IsEmpty());
+
+    const UINT nWidth = surface.GetWidth();
+    const UINT nHeight = surface.GetHeight();
+
+    FILE* pFile = fopen(szFile, "wb");
+    if ( pFile == NULL )
+        return false;
+
+    bool bResult = (fprintf(pFile, "P6\n%u %u\n255\n", nWidth, nHeight) > 0);
+
+    vector<BYTE> row;
+    try
+    {
+        row.resize(nWidth * 3 + 1); // exception
+    }
+    catch ( ... )
+    {
+        bResult = false;
+    }
+
+    for ( UINT y = 0; bResult && y < nHeight; ++y )
+    {
+        const BYTE* pSrc = surface.GetRow(y);
+        for ( UINT x = 0; x < nWidth; ++x, pSrc += 4 )
+        {
+            row[x * 3 + 0] = pSrc[2];
+            row[x * 3 + 1] = pSrc[1];
+            row[x * 3 + 2] = pSrc[0];
+        }
+        bResult = (fwrite(&row[0], 1, nWidth * 3, pFile) == nWidth * 3);
+    }
+
+    return (fclose(pFile) == 0) && bResult;
+}
+
+// CImageIO::DecodeBmp
+// Uncompressed 8bpp palette, 24bpp and 32bpp bitmaps, bottom-up or top-down
+
+bool CImageIO::DecodeBmp(const BYTE* pData, size_t nSize, CSurface* pSurface) // exception
+{
+    if ( nSize < 14 + 40 || pData[0] != 'B' || pData[1] != 'M' )
+        return false;
+
+    const DWORD dwOffBits = ReadLE32(pData + 10);
+    const DWORD dwInfoSize = ReadLE32(pData + 14);
+    if ( dwInfoSize < 40 || 14 + (size_t)dwInfoSize > nSize )
+        return false;
+
+    const LONG nWidth = (LONG)ReadLE32(pData + 18);
+    const LONG nHeightRaw = (LONG)ReadLE32(pData + 22);
+    const DWORD dwBitCount = ReadLE16(pData + 28);
+    const DWORD dwCompression = ReadLE32(pData + 30);
+    DWORD dwClrUsed = ReadLE32(pData + 46);
+
+    const bool bTopDown = (nHeightRaw < 0);
+    const LONG nHeight = bTopDown ? -nHeightRaw : nHeightRaw;
+
+    // BI_RGB, or BI_BITFIELDS with default 32bpp masks
+    const DWORD BI_RGB_ = 0, BI_BITFIELDS_ = 3;
+    if ( dwCompression != BI_RGB_ && !(dwCompression == BI_BITFIELDS_ && dwBitCount == 32) )
+        return false;
+    if ( dwBitCount != 8 && dwBitCount != 24 && dwBitCount != 32 )
+        return false;
+    if ( nWidth <= 0 || nHeight <= 0 || nWidth > MAX_IMAGE_SIDE || nHeight > MAX_IMAGE_SIDE )
+        return false;
+
+    // palette follows info header
+    const BYTE* pPalette = pData + 14 + dwInfoSize;
+    if ( dwBitCount == 8 )
+    {
+        if ( dwClrUsed == 0 || dwClrUsed > 256 )
+            dwClrUsed = 256;
+        if ( (size_t)(pPalette - pData) + dwClrUsed * 4 > nSize )
+            return false;
+    }
+
+    const size_t nStride = (((size_t)nWidth * dwBitCount + 31) / 32) * 4;
+    if ( dwOffBits > nSize || nStride * nHeight > nSize - dwOffBits )
+        return false;
+
+    CSurface surface(nWidth, nHeight); // exception
+
+    for ( LONG y = 0; y < nHeight; ++y )
+    {
+        const BYTE* pSrc = pData + dwOffBits + nStride * (bTopDown ? y : nHeight - 1 - y);
+        BYTE* pDst = surface.GetRow(y);
+        for ( LONG x = 0; x < nWidth; ++x, pDst += 4 )
+        {
+            switch ( dwBitCount )
+            {
+            case 8:
+                {
+                    const DWORD nIndex = (pSrc[x] < dwClrUsed) ? pSrc[x] : 0;
+                    pDst[0] = pPalette[nIndex * 4 + 0];
+                    pDst[1] = pPalette[nIndex * 4 + 1];
+                    pDst[2] = pPalette[nIndex * 4 + 2];
+                }
+                break;
+            case 24:
+                pDst[0] = pSrc[x * 3 + 0];
+                pDst[1] = pSrc[x * 3 + 1];
+                pDst[2] = pSrc[x * 3 + 2];
+                break;
+            case 32:
+                pDst[0] = pSrc[x * 4 + 0];
+                pDst[1] = pSrc[x * 4 + 1];
+                pDst[2] = pSrc[x * 4 + 2];
+                break;
+            }
+            pDst[3] = 0xFF;
+        }
+    }
+
+    pSurface->Swap(surface);
+    return true;
+}
+
+// CImageIO::DecodePpm
+// Binary P6 pixmap and P5 graymap with 8 bit samples
+
+bool CImageIO::DecodePpm(const BYTE* pData, size_t nSize, CSurface* pSurface) // exception
+{
+    if ( nSize < 3 || pData[0] != 'P' || (pData[1] != '6' && pData[1] != '5') )
+        return false;
+
+    const bool bGray = (pData[1] == '5');
+
+    size_t nPos = 2;
+    LONG nWidth, nHeight, nMaxVal;
+    if ( !ReadPpmNumber(pData, nSize, &nPos, &nWidth) ||
+         !ReadPpmNumber(pData, nSize, &nPos, &nHeight) ||
+         !ReadPpmNumber(pData, nSize, &nPos, &nMaxVal) )
+    {
+        return false;
+    }
+    if ( nPos >= nSize || !isspace(pData[nPos]) )
+        return false;
+    ++nPos; // single whitespace before raster
+
+    if ( nWidth <= 0 || nHeight <= 0 || nWidth > MAX_IMAGE_SIDE || nHeight > MAX_IMAGE_SIDE )
+        return false;
+    if ( nMaxVal <= 0 || nMaxVal > 255 )
+        return false;
+
+    const size_t nChannels = bGray ? 1 : 3;
+    const size_t nStride = (size_t)nWidth * nChannels;
+    if ( nStride * nHeight > nSize - nPos )
+        return false;
+
+    CSurface surface(nWidth, nHeight); // exception
+
+    const BYTE* pSrc = pData + nPos;
+    for ( LONG y = 0; y < nHeight; ++y )
+    {
+        BYTE* pDst = surface.GetRow(y);
+        for ( LONG x = 0; x < nWidth; ++x, pDst += 4, pSrc += nChannels )
+        {
+            const BYTE r = ScalePpmSample(pSrc[0], nMaxVal);
+            const BYTE g = bGray ? r : ScalePpmSample(pSrc[1], nMaxVal);
+            const BYTE b = bGray ? r : ScalePpmSample(pSrc[2], nMaxVal);
+            pDst[0] = b;
+            pDst[1] = g;
+            pDst[2] = r;
+            pDst[3] = 0xFF;
+        }
+    }
+
+    pSurface->Swap(surface);
+    return true;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "surface.h"
+
+//
+// CImageIO static class
+// Image files reading and writing without GDI+.
+// BMP and PPM are built in, other formats are plugged in as decoders.
+//
+
+class CImageIO
+{
+public:
+    // Decoder returns false if data is not of its format
+    typedef bool (*PFNDECODER)(const BYTE* pData, size_t nSize, CSurface* pSurface);
+
+    // Registered decoders are tried before built in ones.
+    // Register decoders on startup, registration is not thread safe.
+    static void RegisterDecoder(PFNDECODER pfnDecoder); // exception
+
+    static bool Decode(
+            const BYTE* pData,
+            size_t nSize,
+            CSurface* pSurface
+            ); // exception
+
+    static bool Load(
+            const char* szFile,
+            CSurface* pSurface
+            ); // exception
+
+    // Format is chosen by extension: .ppm/.pnm is PPM, others are BMP
+    static bool Save(
+            const char* szFile,
+            const CSurface& surface
+            ) throw();
+
+    static bool SaveBmp(
+            const char* szFile,
+            const CSurface& surface
+            ) throw();
+
+    static bool SavePpm(
+            const char* szFile,
+            const CSurface& surface
+            ) throw();
+
+private:
+    static bool DecodeBmp(const BYTE* pData, size_t nSize, CSurface* pSurface); // exception
+    static bool DecodePpm(const BYTE* pData, size_t nSize, CSurface* pSurface); // exception
+};
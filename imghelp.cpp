@@ -3,34 +3,15 @@
 #include "advbitmap.h"
 #include <math.h>
 
-//
-// Consts
-//
-
-static const double _PI = 3.1415926535897932384626433832795;
-static const double DEG_TO_RAD = _PI / 180.0;
-static const double RAD_TO_DEG = 180.0 / _PI;
-
 //
 // Helpers
 //
 
-#define RadToDeg(aRad) ((aRad) * RAD_TO_DEG)
-#define DegToRad(aDeg) ((aDeg) * DEG_TO_RAD)
-
 inline INT Round(const double& dValue) throw()
 {
     return (INT)( dValue + (( dValue > 0 ) ? 0.5 : -0.5) );
 }
 
-inline INT Random(UINT nMaxWidth)
-{
-    if ( nMaxWidth != 0 )
-        return ( rand() % ((INT)nMaxWidth) ) - ( rand() % ((INT)nMaxWidth)/2 );
-    else
-        return 0;
-}
-
 //
 // CImageHelper class
 //
@@ -257,6 +238,172 @@ auto_ptr<Image> CImageHelper::CreateSolidImage(
     return pNewImage;
 }
 
+// CImageHelper::LoadScaledBitmap
+
+HBITMAP CImageHelper::LoadScaledBitmap(
+                    LPCWSTR wszName,
+                    const Size& sizeView,
+                    Color clrBackground,
+                    SIZE* pSizeImage /* = NULL */
+                    ) throw()
+{
+    const SIZE sizeMax = { sizeView.Width, sizeView.Height };
+
+    SIZE sizeImage = { 0, 0 };
+    if ( pSizeImage == NULL )
+        pSizeImage = &sizeImage;
+
+    HBITMAP hBitmap = LoadReducedBitmap(wszName, sizeMax, clrBackground, pSizeImage);
+    if ( hBitmap != NULL )
+        return hBitmap;
+
+    HBITMAP hImageBitmap = NULL;
+    {
+        Bitmap image(wszName);
+        if ( image.GetLastStatus() != Ok || image.GetHBITMAP(clrBackground, &hImageBitmap) != Ok )
+            return NULL;
+    }
+
+    DIBSECTION dibImage = { 0 };
+    ::GetObject(hImageBitmap, sizeof(dibImage), &dibImage);
+
+    // image is never drawn larger than view
+    sizeImage.cx = dibImage.dsBm.bmWidth;
+    sizeImage.cy = dibImage.dsBm.bmHeight;
+    *pSizeImage = sizeImage;
+
+    const SIZE sizeScaled = CPositionGenerator::GetObjectSize(sizeMax, sizeImage, 0.0);
+    if ( sizeScaled.cx >= sizeImage.cx || sizeScaled.cy >= sizeImage.cy )
+        return hImageBitmap;
+
+    hBitmap = CreateScaledBitmap(&dibImage.dsBm, dibImage.dsBmih.biHeight > 0, sizeScaled, clrBackground);
+    if ( hBitmap == NULL )
+        return hImageBitmap; // full size image is drawn slower but right
+
+    ::DeleteObject(hImageBitmap);
+    return hBitmap;
+}
+
+// CImageHelper::LoadReducedBitmap
+
+HBITMAP CImageHelper::LoadReducedBitmap(
+                    LPCWSTR wszName,
+                    const SIZE& sizeView,
+                    Color clrBackground,
+                    SIZE* pSizeImage
+                    ) throw()
+{
+    CComPtr<IWICImagingFactory> pFactory;
+    if ( FAILED(pFactory.CoCreateInstance(CLSID_WICImagingFactory)) )
+        return NULL;
+
+    CComPtr<IWICBitmapDecoder> pDecoder;
+    if ( FAILED(pFactory->CreateDecoderFromFilename(wszName, NULL, GENERIC_READ, 
+                                                     WICDecodeMetadataCacheOnDemand, &pDecoder)) )
+        return NULL;
+
+    CComPtr<IWICBitmapFrameDecode> pFrame;
+    if ( FAILED(pDecoder->GetFrame(0, &pFrame)) )
+        return NULL;
+
+    // decoders which scale while decoding, JPEG does it in DCT domain
+    CComQIPtr<IWICBitmapSourceTransform> pTransform(pFrame);
+    if ( pTransform == NULL )
+        return NULL;
+
+    UINT nWidth = 0, nHeight = 0;
+    if ( FAILED(pFrame->GetSize(&nWidth, &nHeight)) || nWidth == 0 || nHeight == 0 )
+        return NULL;
+
+    const SIZE sizeImage = { (LONG)nWidth, (LONG)nHeight };
+    const SIZE sizeTarget = CPositionGenerator::GetObjectSize(sizeView, sizeImage, 0.0);
+
+    // smallest scale which still covers target
+    UINT nScaledWidth = 0, nScaledHeight = 0;
+    for ( UINT nScale = 8; nScale > 1 && nScaledWidth == 0; nScale /= 2 )
+    {
+        UINT nScaleWidth = (nWidth + nScale - 1) / nScale;
+        UINT nScaleHeight = (nHeight + nScale - 1) / nScale;
+        if ( (LONG)nScaleWidth < sizeTarget.cx || (LONG)nScaleHeight < sizeTarget.cy )
+            continue;
+
+        if ( FAILED(pTransform->GetClosestSize(&nScaleWidth, &nScaleHeight)) )
+            return NULL;
+
+        if ( (LONG)nScaleWidth >= sizeTarget.cx && (LONG)nScaleHeight >= sizeTarget.cy && nScaleWidth < nWidth )
+        {
+            nScaledWidth = nScaleWidth;
+            nScaledHeight = nScaleHeight;
+        }
+    }
+
+    // full resolution is decoded by GDI+
+    if ( nScaledWidth == 0 )
+        return NULL;
+
+    // opaque formats only, JPEG decodes to 24bpp
+    WICPixelFormatGUID format = GUID_WICPixelFormat24bppBGR;
+    if ( FAILED(pTransform->GetClosestPixelFormat(&format)) )
+        return NULL;
+
+    WORD nBitsPixel = 0;
+    if ( IsEqualGUID(format, GUID_WICPixelFormat24bppBGR) )
+        nBitsPixel = 24;
+    else if ( IsEqualGUID(format, GUID_WICPixelFormat32bppBGR) )
+        nBitsPixel = 32;
+    else
+        return NULL;
+
+    const UINT nStride = (nScaledWidth * nBitsPixel / 8 + 3) & ~3;
+    const UINT nSize = nStride * nScaledHeight;
+    BYTE* pBits = (BYTE*)malloc(nSize);
+    if ( pBits == NULL )
+        return NULL;
+
+    HBITMAP hBitmap = NULL;
+    if ( SUCCEEDED(pTransform->CopyPixels(NULL, nScaledWidth, nScaledHeight, &format, 
+                                          WICBitmapTransformRotate0, nStride, nSize, pBits)) )
+    {
+        // decoded rows are top-down
+        const BITMAP bmpReduced = { 0, (LONG)nScaledWidth, (LONG)nScaledHeight, (LONG)nStride, 1, nBitsPixel, pBits };
+        hBitmap = CreateScaledBitmap(&bmpReduced, FALSE, sizeTarget, clrBackground);
+    }
+
+    free(pBits);
+
+    if ( hBitmap != NULL )
+        *pSizeImage = sizeImage;
+    return hBitmap;
+}
+
+// CImageHelper::CreateScaledBitmap
+
+HBITMAP CImageHelper::CreateScaledBitmap(
+                    const BITMAP* pSrcBitmap,
+                    BOOL bSrcBottomUp,
+                    const SIZE& sizeScaled,
+                    Color clrBackground
+                    ) throw()
+{
+    // bitmap is made by GDI+ like view bitmap
+    HBITMAP hBitmap = NULL;
+    {
+        Bitmap scaled(max(sizeScaled.cx, 1), max(sizeScaled.cy, 1), PixelFormat32bppARGB);
+        if ( scaled.GetLastStatus() != Ok || scaled.GetHBITMAP(clrBackground, &hBitmap) != Ok )
+            return NULL;
+    }
+
+    DIBSECTION dib = { 0 };
+    ::GetObject(hBitmap, sizeof(dib), &dib);
+
+    // rows are flipped if orders differ
+    const BOOL bBottomUp = ( dib.dsBmih.biHeight > 0 );
+    AAStretchBlt(&dib.dsBm, 0, 0, dib.dsBm.bmWidth, dib.dsBm.bmHeight, pSrcBitmap, 
+                 NULL, bSrcBottomUp != bBottomUp, NULL, NULL, 1, AA_RESAMPLE_LANCZOS3);
+
+    return hBitmap;
+}
+
 //
 // CImageScatterAnimation class
 //
@@ -276,6 +423,14 @@ CImageScatterAnimation::CImageScatterAnimation(auto_ptr<Image>& image,
     m_dAngleDeg = 0.25 * 360.0 / (double)m_nStepCount;
     m_nStep = 0;
 
+    ::ZeroMemory(&m_mipmap, sizeof(m_mipmap));
+
+    // image is converted once, frames draw its pixels in place
+    m_hImageBitmap = NULL;
+    ::ZeroMemory(&m_bmpImage, sizeof(m_bmpImage));
+    if ( ((Bitmap*)m_image.get())->GetHBITMAP(m_clrFrame, &m_hImageBitmap) == Ok )
+        ::GetObject(m_hImageBitmap, sizeof(m_bmpImage), &m_bmpImage);
+
     if ( rand() % 2 == 1 )
         m_dX *= -1;
     if ( rand() % 2 == 1 )
@@ -288,10 +443,22 @@ CImageScatterAnimation::CImageScatterAnimation(CImageScatterAnimation& other)
     , m_dImageAngleDeg(other.m_dImageAngleDeg)
     , m_clrFrame(other.m_clrFrame)
 {
+    // take over pixels and pyramid along with image
+    m_hImageBitmap = other.m_hImageBitmap;
+    m_bmpImage = other.m_bmpImage;
+    other.m_hImageBitmap = NULL;
+    ::ZeroMemory(&other.m_bmpImage, sizeof(other.m_bmpImage));
+
+    m_mipmap = other.m_mipmap;
+    ::ZeroMemory(&other.m_mipmap, sizeof(other.m_mipmap));
 }
 
 CImageScatterAnimation::~CImageScatterAnimation()
 {
+    AADeleteMipmap(&m_mipmap);
+
+    if ( m_hImageBitmap != NULL )
+        ::DeleteObject(m_hImageBitmap);
 }
 
 void CImageScatterAnimation::ResetAnimation()
@@ -303,23 +470,20 @@ bool CImageScatterAnimation::NextAnimation(HBITMAP hDstBitmap)
 {
     const long nStep = m_nStep++;
 
-    if ( nStep >= m_nStepCount )
+    Point pt = m_ptImageLeftTop;
+    double dAngleDeg = m_dImageAngleDeg;
+    if ( nStep < m_nStepCount )
     {
-        CImagesScatter::DrawImage(hDstBitmap, m_image.get(), 
-            m_ptImageLeftTop, m_dImageAngleDeg, m_clrFrame); // exception
+        pt.X = (int)( (double)m_ptImageLeftTop.X + m_dX * (double)(nStep - m_nStepCount) );
+        pt.Y = (int)( (double)m_ptImageLeftTop.Y + m_dY * (double)(nStep - m_nStepCount) );
+        dAngleDeg = m_dImageAngleDeg - m_dAngleDeg * (double)(nStep - m_nStepCount);
     }
-    else
-    {
-        Point pt(
-            (int)( (double)m_ptImageLeftTop.X + m_dX * (double)(nStep - m_nStepCount) ),
-            (int)( (double)m_ptImageLeftTop.Y + m_dY * (double)(nStep - m_nStepCount) ) );
 
-        double dAngleDeg = 
-            m_dImageAngleDeg - m_dAngleDeg * (double)(nStep - m_nStepCount);
-
-        CImagesScatter::DrawImage(hDstBitmap, m_image.get(), 
-            pt, dAngleDeg, m_clrFrame); // exception
-    }
+    // converted image is drawn in place, otherwise every frame converts it
+    if ( m_bmpImage.bmBits != NULL )
+        CImagesScatter::DrawImage(hDstBitmap, &m_bmpImage, pt, dAngleDeg, &m_mipmap);
+    else
+        CImagesScatter::DrawImage(hDstBitmap, m_image.get(), pt, dAngleDeg, m_clrFrame, &m_mipmap); // exception
 
     return (m_nStep <= m_nStepCount);
 }
@@ -418,32 +582,96 @@ void CImagesScatter::DrawScatterImage(
                     Color clrFrame
                     ) throw(...) // exception
 {
-    const Size sizeView(rect.Width, rect.Height);
-    const Size sizeImageOriginal(pImage->GetWidth(), pImage->GetHeight());
+    HBITMAP hSrcBitmap = NULL;
+    if ( ((Bitmap*)pImage)->GetHBITMAP(clrFrame, &hSrcBitmap) != Ok )
+        return;
+
+    BITMAP bmpSrc = { 0 };
+    if ( ::GetObject(hSrcBitmap, sizeof(BITMAP), &bmpSrc) == 0 || bmpSrc.bmWidth == 0 || bmpSrc.bmHeight == 0 )
+    {
+        ::DeleteObject(hSrcBitmap);
+        return;
+    }
+
+    try
+    {
+        DrawScatterImage(hDstBitmap, rect, &bmpSrc, dMaxAngleDeg, 
+                         nMaxOffset, nFrameThick, clrFrame); // exception
+    }
+    catch (...)
+    {
+        ::DeleteObject(hSrcBitmap);
+        throw;
+    }
+
+    ::DeleteObject(hSrcBitmap);
+}
+
+void CImagesScatter::DrawScatterImage(
+                    HBITMAP hDstBitmap,
+                    const Rect& rect,
+                    const BITMAP* pSrcBitmap,
+                    const double& dMaxAngleDeg,
+                    UINT nMaxOffset,
+                    UINT nFrameThick,
+                    Color clrFrame,
+                    RECT* prcDrawn /* = NULL */
+                    ) throw(...) // exception
+{
+    const SIZE sizeView = { rect.Width, rect.Height };
+    const SIZE sizeImageOriginal = { pSrcBitmap->bmWidth, pSrcBitmap->bmHeight };
 
     // generate shift, scale and rotation
-    Size sizeImage;
-    Point ptImageLeftTop;
+    SIZE sizeImage;
+    POINT ptImageLeftTop;
     double dImageAngleDeg;
     CPositionGenerator::Generate(sizeView, sizeImageOriginal, dMaxAngleDeg, nMaxOffset, 
                                  &ptImageLeftTop, &dImageAngleDeg, &sizeImage);
 
-    // make new image that scaled and has frame
-    auto_ptr<Image> image = CImageHelper::ScaleAndFrameImage(pImage, nFrameThick, sizeImage, clrFrame); // exception
+    // image is scaled and framed while drawn, no intermediate image is made
+    const SIZE sizeScaled = CSurfaceHelper::GetScaledSize(sizeImageOriginal, nFrameThick, sizeImage);
 
     // update size image to avoid floating mistakes
-    sizeImage.Width = image->GetWidth();
-    sizeImage.Height = image->GetHeight();
+    sizeImage.cx = sizeScaled.cx + 2 * (LONG)nFrameThick;
+    sizeImage.cy = sizeScaled.cy + 2 * (LONG)nFrameThick;
 
     // calculate image bounding box
-    const Rect& rectBound = CPositionGenerator::GetBoundingRect(sizeImage, dImageAngleDeg);
+    const RECT rectBound = CPositionGenerator::GetBoundingRect(sizeImage, dImageAngleDeg);
 
     // adjust left/top position
-    ptImageLeftTop.X += abs( rectBound.X );
-    ptImageLeftTop.Y += abs( rectBound.Y );
+    ptImageLeftTop.x += abs( rectBound.left );
+    ptImageLeftTop.y += abs( rectBound.top );
 
     // draw image
-    DrawImage(hDstBitmap, image.get(), ptImageLeftTop, dImageAngleDeg, clrFrame);
+    BITMAP bmpDst = { 0 };
+    ::GetObject(hDstBitmap, sizeof(BITMAP), &bmpDst);
+
+    CSurfaceScatter::DrawFramedImage(&bmpDst, pSrcBitmap, ptImageLeftTop, dImageAngleDeg, 
+                                     sizeScaled, nFrameThick, clrFrame.ToCOLORREF()); // exception
+
+    if ( prcDrawn != NULL )
+    {
+        const RECT rectDst = { 0, 0, bmpDst.bmWidth, abs(bmpDst.bmHeight) };
+        const RECT rectImage = GetImageBoundRect(Point(ptImageLeftTop.x, ptImageLeftTop.y), 
+                                                 sizeImage, dImageAngleDeg);
+        ::IntersectRect(prcDrawn, &rectImage, &rectDst);
+    }
+}
+
+// CImagesScatter::GetImageBoundRect
+
+RECT CImagesScatter::GetImageBoundRect(
+                    const Point& pt,
+                    const SIZE& sizeImage,
+                    const double& dAngleDeg
+                    ) throw()
+{
+    RECT rect = CPositionGenerator::GetBoundingRect(sizeImage, dAngleDeg);
+    ::OffsetRect(&rect, pt.X, pt.Y);
+
+    // rounded corners and filtered edge pixels
+    ::InflateRect(&rect, 2, 2);
+    return rect;
 }
 
 auto_ptr<CImageScatterAnimation> CImagesScatter::CreateScatterImageAnimation(
@@ -455,32 +683,34 @@ auto_ptr<CImageScatterAnimation> CImagesScatter::CreateScatterImageAnimation(
                     Color clrFrame
                     ) throw(...) // exception
 {
-    const Size sizeView(rect.Width, rect.Height);
-    const Size sizeImageOriginal(pImage->GetWidth(), pImage->GetHeight());
+    const SIZE sizeView = { rect.Width, rect.Height };
+    const SIZE sizeImageOriginal = { (LONG)pImage->GetWidth(), (LONG)pImage->GetHeight() };
 
     // generate shift, scale and rotation
-    Size sizeImage;
-    Point ptImageLeftTop;
+    SIZE sizeImage;
+    POINT ptImageLeftTop;
     double dImageAngleDeg;
     CPositionGenerator::Generate(sizeView, sizeImageOriginal, dMaxAngleDeg, nMaxOffset, 
                                  &ptImageLeftTop, &dImageAngleDeg, &sizeImage);
 
     // make new image that scaled and has frame
-    auto_ptr<Image> image = CImageHelper::ScaleAndFrameImage(pImage, nFrameThick, sizeImage, clrFrame); // exception
+    auto_ptr<Image> image = CImageHelper::ScaleAndFrameImage(pImage, nFrameThick, 
+                                Size(sizeImage.cx, sizeImage.cy), clrFrame); // exception
 
     // update size image to avoid floating mistakes
-    sizeImage.Width = image->GetWidth();
-    sizeImage.Height = image->GetHeight();
+    sizeImage.cx = image->GetWidth();
+    sizeImage.cy = image->GetHeight();
 
     // calculate image bounding box
-    const Rect& rectBound = CPositionGenerator::GetBoundingRect(sizeImage, dImageAngleDeg);
+    const RECT rectBound = CPositionGenerator::GetBoundingRect(sizeImage, dImageAngleDeg);
 
     // adjust left/top position
-    ptImageLeftTop.X += abs( rectBound.X );
-    ptImageLeftTop.Y += abs( rectBound.Y );
+    ptImageLeftTop.x += abs( rectBound.left );
+    ptImageLeftTop.y += abs( rectBound.top );
 
     auto_ptr<CImageScatterAnimation>
-        animator(new CImageScatterAnimation(image, ptImageLeftTop, dImageAngleDeg, clrFrame, rect)); // exception
+        animator(new CImageScatterAnimation(image, Point(ptImageLeftTop.x, ptImageLeftTop.y), 
+                                            dImageAngleDeg, clrFrame, rect)); // exception
 
     return animator;
 }
@@ -490,146 +720,32 @@ void CImagesScatter::DrawImage(
                     Image* pSrcImage,
                     const Point& pt,
                     const double& dAngleDeg,
-                    Color clrBackground
+                    Color clrBackground,
+                    AAMIPMAP* pMipmap /* = NULL */
                     ) throw(...) // exception
 {
     HBITMAP hSrcBitmap = NULL;
     ((Bitmap*)pSrcImage)->GetHBITMAP(clrBackground, &hSrcBitmap);
     
-    BITMAP bmpDst = { 0 }, bmpSrc = { 0 };
-    ::GetObject(hDstBitmap, sizeof(BITMAP), &bmpDst);
+    BITMAP bmpSrc = { 0 };
     ::GetObject(hSrcBitmap, sizeof(BITMAP), &bmpSrc);
 
-    const double& dSine = sin( DegToRad(dAngleDeg) );
-    const double& dCosine = cos( DegToRad(dAngleDeg) );
-    XFORM_MATRIX xForm = { 0 };
-    xForm.eM11 = dCosine;
-    xForm.eM12 = dSine;
-    xForm.eM21 = -dSine;
-    xForm.eM22 = dCosine;
-    xForm.eDx = pt.X;
-    xForm.eDy = pt.Y;
-
-    AATransformBlt(&bmpDst, pt.X, pt.Y, &bmpSrc, 0, 0, bmpSrc.bmWidth, bmpSrc.bmHeight, &xForm);
+    DrawImage(hDstBitmap, &bmpSrc, pt, dAngleDeg, pMipmap);
 
     ::DeleteObject(hSrcBitmap);
 }
 
-//
-// CPositionGenerator class 
-//
-
-// CPositionGenerator::Generate
-
-void CPositionGenerator::Generate(
-                    const Size& sizeView,
-                    const Size& sizeObjectOriginal,
-                    const double& dMaxAngleDeg,
-                    const UINT nMaxDeviation, 
-                    Point* pptLeftTop, 
-                    double* pdAngleDeg, 
-                    Size* pSizeObject,
-                    double* pdRatio /* = NULL */
-                    ) throw()
-{
-    const double dAngleDeg = Random( Round(dMaxAngleDeg) );
-    const INT nOffsetX = Random( nMaxDeviation );
-    const INT nOffsetY = Random( nMaxDeviation );
-   
-    RECT rectView = { 0, 0, sizeView.Width, sizeView.Height };
-    ::OffsetRect(&rectView, nOffsetX, nOffsetY);
-    if ( rectView.left < 0 )
-        rectView.left = 0;
-    if ( rectView.right > sizeView.Width )
-        rectView.right = sizeView.Width;
-    if ( rectView.top < 0 )
-        rectView.top = 0;
-    if ( rectView.bottom > sizeView.Height )
-        rectView.bottom = sizeView.Height;
-
-    const Size sizeAdjView( rectView.right - rectView.left, rectView.bottom - rectView.top );
-
-    double dRatio;
-    Size sizeObjectBound;
-    const Size& sizeObject = GetObjectSize(sizeAdjView, sizeObjectOriginal, dAngleDeg,
-                                            &dRatio, &sizeObjectBound);
-
-    const Point ptLeftTop(rectView.left + (sizeAdjView.Width - sizeObjectBound.Width) / 2,
-                          rectView.top +  (sizeAdjView.Height - sizeObjectBound.Height) / 2);
-
-    *pSizeObject = sizeObject;
-    *pdAngleDeg = dAngleDeg;
-    *pptLeftTop = ptLeftTop;
-    if ( pdRatio != NULL ) 
-        *pdRatio = dRatio;
-}
-
-// CPositionGenerator::GetObjectSize
-
-Size CPositionGenerator::GetObjectSize(
-                    const Size& sizeView, 
-                    const Size& sizeObjectOriginal,
+void CImagesScatter::DrawImage(
+                    HBITMAP hDstBitmap,
+                    const BITMAP* pSrcBitmap,
+                    const Point& pt,
                     const double& dAngleDeg,
-                    double* pdRatio /* = NULL */,
-                    Size* pSizeObjectBound /* = NULL */
+                    AAMIPMAP* pMipmap /* = NULL */
                     ) throw()
 {
-    const Rect& rectObjectBound = GetBoundingRect(sizeObjectOriginal, dAngleDeg);
-    const Size sizeObjectBound(rectObjectBound.Width, rectObjectBound.Height);
-
-    const double dWidthRatio = (double)sizeObjectBound.Width / (double)sizeView.Width;
-    const double dHeightRatio = (double)sizeObjectBound.Height / (double)sizeView.Height;   
-    const double dRatio = max(dWidthRatio, dHeightRatio);    
-
-    if ( pSizeObjectBound != NULL )
-    {
-        *pSizeObjectBound = Size(
-            Round((double)sizeObjectBound.Width / dRatio),
-            Round((double)sizeObjectBound.Height / dRatio));
-    }
-    if ( pdRatio != NULL )
-    {
-        *pdRatio = dRatio;
-    }
-
-    return Size(
-        Round((double)sizeObjectOriginal.Width / dRatio),
-        Round((double)sizeObjectOriginal.Height / dRatio));
-}
-
-// CPositionGenerator::GetBoundingSize
-
-Rect CPositionGenerator::GetBoundingRect(
-                    const Size& sizeObject, 
-                    const double& dAngleDeg
-                    ) throw()
-{
-    const double& dSine = sin( DegToRad(dAngleDeg) );
-    const double& dCosine = cos( DegToRad(dAngleDeg) );
-
-    // x' = x * eM11 + y * eM21 + eDx 
-    // y' = x * eM12 + y * eM22 + eDy
-    // eM11 = cosine, eM21 = -sine, eM12 = sine, eM22 = cosine
-
-    const double x[2] = { 0, (double)sizeObject.Width };
-    const double y[2] = { 0, (double)sizeObject.Height }; 
-
-    INT xMin = INT_MAX, yMin = xMin, 
-        xMax = INT_MIN, yMax = xMax;
-    for ( INT ix = 0; ix < 2; ++ix )
-    {
-        for ( INT iy = 0; iy < 2; ++iy )
-        {
-            INT xt = Round( x[ix] * dCosine - y[iy] * dSine );
-            INT yt = Round( x[ix] * dSine + y[iy] * dCosine );
-            if ( xMin > xt ) xMin = xt;
-            if ( xMax < xt ) xMax = xt;
-            if ( yMin > yt ) yMin = yt;
-            if ( yMax < yt ) yMax = yt;
-        }
-    }
-
-    const Rect rectBound(xMin, yMin, xMax - xMin, yMax - yMin);
+    BITMAP bmpDst = { 0 };
+    ::GetObject(hDstBitmap, sizeof(BITMAP), &bmpDst);
 
-    return rectBound;
+    const POINT ptDst = { pt.X, pt.Y };
+    CSurfaceScatter::DrawImage(&bmpDst, pSrcBitmap, ptDst, dAngleDeg, pMipmap);
 }
@@ -1,5 +1,8 @@
 #pragma once
 
+#include "advbitmap.h"
+#include "scatter.h"
+
 //
 // CImageHelper static class
 //
@@ -50,6 +53,30 @@ public:
             const UINT nWidth, const UINT nHeight,
             Color clrBackground = Color::Black
             ) throw(...);
+
+    // Image file scaled down to size it is drawn at in view, NULL if file is not read.
+    // JPEG is decoded at 1/2, 1/4 or 1/8 resolution when it still covers that size.
+    static HBITMAP LoadScaledBitmap(
+            LPCWSTR wszName,
+            const Size& sizeView,
+            Color clrBackground,
+            SIZE* pSizeImage = NULL     // receives full image size
+            ) throw();
+
+private:
+    static HBITMAP LoadReducedBitmap(
+            LPCWSTR wszName,
+            const SIZE& sizeView,
+            Color clrBackground,
+            SIZE* pSizeImage
+            ) throw();
+
+    static HBITMAP CreateScaledBitmap(
+            const BITMAP* pSrcBitmap,
+            BOOL bSrcBottomUp,
+            const SIZE& sizeScaled,
+            Color clrBackground
+            ) throw();
 };
 
 //
@@ -75,6 +102,9 @@ public:
 private:
     // target parameters
     auto_ptr<Image> m_image;
+    HBITMAP m_hImageBitmap; // m_image pixels as DIB, made once and kept between frames
+    BITMAP m_bmpImage; // m_hImageBitmap pixels, drawn in place
+    AAMIPMAP m_mipmap; // m_image pyramid, kept between frames
     const Point m_ptImageLeftTop;
     const double m_dImageAngleDeg; 
     const Color m_clrFrame;
@@ -121,6 +151,18 @@ public:
         Color clrFrame
         ) throw(...); // exception
 
+    // Same as above for source pixels at hand, e.g. prefetched image
+    static void DrawScatterImage(
+        HBITMAP hDstBitmap, 
+        const Rect& rect,
+        const BITMAP* pSrcBitmap,
+        const double& dMaxAngleDeg,
+        UINT nMaxOffset,
+        UINT nFrameThick,
+        Color clrFrame,
+        RECT* prcDrawn = NULL // receives pixels changed in hDstBitmap
+        ) throw(...); // exception
+
     static auto_ptr<CImageScatterAnimation> CreateScatterImageAnimation(
         const Rect& rect,
         Image* pImage,
@@ -130,47 +172,32 @@ public:
         Color clrFrame
         ) throw(...); // exception
 
+    // Pixels covered by image rotated around pt, antialiased edge included
+    static RECT GetImageBoundRect(
+        const Point& pt,
+        const SIZE& sizeImage,
+        const double& dAngleDeg
+        ) throw();
+
     static void DrawImage(
         HBITMAP hDstBitmap,
         Image* pSrcImage,
         const Point& pt,
         const double& dAngleDeg,
-        Color clrBackground
+        Color clrBackground,
+        AAMIPMAP* pMipmap = NULL // mipmap cache of pSrcImage, built on demand
         ) throw(...); // exception
 
+    // Same as above for source pixels at hand, they are neither copied nor converted
+    static void DrawImage(
+        HBITMAP hDstBitmap,
+        const BITMAP* pSrcBitmap,
+        const Point& pt,
+        const double& dAngleDeg,
+        AAMIPMAP* pMipmap = NULL // mipmap cache of pSrcBitmap, built on demand
+        ) throw();
+
 private:
     typedef list<Image*> _ImageList;
     _ImageList m_imageList;
 };
-
-//
-// CPositionGenerator static class
-//
-
-class CPositionGenerator
-{
-public:
-    static void Generate(
-            const Size& sizeView,
-            const Size& sizeObjectOriginal,
-            const double& dMaxAngleDeg,
-            const UINT nMaxDeviation, 
-            Point* pptLeftTop, 
-            double* pdAngleDeg, 
-            Size* pSizeObject,
-            double* pdRatio = NULL
-            ) throw();
-
-    static Size GetObjectSize(
-            const Size& sizeView,
-            const Size& sizeObjectOriginal,
-            const double& dAngleDeg,
-            double* pdRatio = NULL,
-            Size* psizeObjectBound = NULL
-            ) throw();
-
-    static Rect GetBoundingRect(
-            const Size& sizeObject, 
-            const double& dAngleDeg
-            ) throw();
-};
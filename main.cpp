@@ -1,6 +1,9 @@
 #include "stdafx.h"
 #include "imghelp.h"
 #include "appwnd.h"
+#include "filescan.h"
+#include "playlist.h"
+#include "fileindex.h"
 
 //
 // CGdiPlusInit class
@@ -22,68 +25,30 @@ private:
     ULONG_PTR m_gdiplusToken;
 };
 
-//
-// Helper
-//
-
-void EnumImageFiles(LPCWSTR szPath, 
-                    LPCWSTR szMask,
-                    list<wstring>* pImageFiles) throw(...) // exception
-{
-    const UINT nMaxLen = 1023;
-    WCHAR szWildcard[nMaxLen + 1] = { 0 };
-    _snwprintf_s(szWildcard, nMaxLen, nMaxLen, L"%s%s", szPath, szMask);
-
-    const UINT nPathLen = wcslen(szPath);
-
-    WIN32_FIND_DATA wfd = { 0 };
-    HANDLE hFind = ::FindFirstFileW(szWildcard, &wfd);
-    if ( hFind != NULL && hFind != INVALID_HANDLE_VALUE )
-    {
-        do
-        {
-            wcscpy_s(szWildcard + nPathLen, nMaxLen - nPathLen, wfd.cFileName);
-            pImageFiles->push_back( szWildcard ); // exception
-        }
-        while( ::FindNextFileW(hFind, &wfd) );
-
-        ::FindClose(hFind);
-        hFind = NULL;
-    }
-
-    wcscpy_s(szWildcard + nPathLen, nMaxLen - nPathLen, L"*.*");
-
-    hFind = ::FindFirstFileW(szWildcard, &wfd);
-    if ( hFind != NULL && hFind != INVALID_HANDLE_VALUE )
-    {
-        do
-        {
-            if ( _wcsicmp(wfd.cFileName, L".") != 0 && _wcsicmp(wfd.cFileName, L"..") != 0 )
-            {
-                if ( wfd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY )
-                {
-                    WCHAR szSubPath[nMaxLen + 1] = { 0 };
-                    _snwprintf_s(szSubPath, nMaxLen, nMaxLen, L"%s%s\\", szPath, wfd.cFileName);
-
-                    EnumImageFiles(szSubPath, szMask, pImageFiles);
-                }
-            }
-        }
-        while( ::FindNextFileW(hFind, &wfd) );
-
-        ::FindClose(hFind);
-        hFind = NULL;
-    }
-}
-
 //
 // Entry point
 //
 
+static const UINT FRAMES_PER_SECOND = 60;
+static const DWORD IMAGE_DWELL_MSEC = 5000;
+
 int APIENTRY _tWinMain(HINSTANCE hInstance, HINSTANCE, LPTSTR szCmdLine, int)
 {
     CGdiPlusInit gdiPlusInit;
 
+    // command line is [/shuffle[:seed]] path, same seed repeats same order
+    BOOL bShuffle = FALSE;
+    DWORD dwShuffleSeed = ::GetTickCount();
+    if ( _wcsnicmp(szCmdLine, L"/shuffle", 8) == 0 )
+    {
+        bShuffle = TRUE;
+        szCmdLine += 8;
+        if ( *szCmdLine == L':' )
+            dwShuffleSeed = wcstoul(szCmdLine + 1, &szCmdLine, 10);
+        while ( *szCmdLine == L' ' )
+            ++szCmdLine;
+    }
+
     const UINT nMaxLen = 1023;
     WCHAR szPath[nMaxLen + 1] = { 0 };
 
@@ -99,16 +64,20 @@ int APIENTRY _tWinMain(HINSTANCE hInstance, HINSTANCE, LPTSTR szCmdLine, int)
         }
     }
 
-    list<wstring> imagesList;
-    EnumImageFiles(szPath, L"*.bmp", &imagesList);
-    EnumImageFiles(szPath, L"*.jpg", &imagesList);
-    EnumImageFiles(szPath, L"*.jpeg", &imagesList);
-    EnumImageFiles(szPath, L"*.png", &imagesList);
+    // directories not changed since last run are not listed again
+    const wstring indexFile = CAppWindow::GetAppDataFile(L"index.dat");
+    CFileIndex fileIndex;
+    if ( !indexFile.empty() )
+        fileIndex.Load(indexFile.c_str());
 
-    if ( imagesList.empty() )
-    {
-        return 0;
-    }
+    // slideshow starts with first images found, tree is listed in background,
+    // window closes itself if no image is found
+    CPlaylist playlist;
+
+    static const LPCWSTR extensions[] = { L"bmp", L"jpg", L"jpeg", L"png" };
+    CImageFileScanner scanner(extensions, _countof(extensions));
+    if ( !scanner.Start(szPath, &playlist, &fileIndex) )
+        scanner.Scan(szPath, &playlist, &fileIndex);
 
     DEVMODE dm;
     EnumDisplaySettings(NULL, ENUM_CURRENT_SETTINGS, &dm);
@@ -119,25 +88,24 @@ int APIENTRY _tWinMain(HINSTANCE hInstance, HINSTANCE, LPTSTR szCmdLine, int)
     RECT rect = { dm.dmPelsWidth-320, dm.dmPelsHeight-200, dm.dmPelsWidth, dm.dmPelsHeight };
 #endif
 
-    CAppWindow wnd(imagesList);
+    CAppWindow wnd(playlist, &fileIndex, bShuffle, dwShuffleSeed, IMAGE_DWELL_MSEC, FRAMES_PER_SECOND);
     HWND hWnd = wnd.Create(NULL, rect, NULL, WS_POPUP);
     ::SetWindowPos(hWnd, HWND_TOPMOST, 0, 0, 0, 0, SWP_NOMOVE|SWP_NOSIZE);
 
+    // frames are drawn by render thread of window, loop only dispatches messages
     ::ShowWindow(hWnd, SW_SHOW);
-    while (::IsWindow(hWnd))
+
+    MSG msg;
+    while ( ::IsWindow(hWnd) && ::GetMessage(&msg, NULL, 0, 0) > 0 )
     {
-        MSG msg;
-        if (::PeekMessage(&msg, 0, 0, 0, PM_REMOVE))
-        {
-            ::TranslateMessage(&msg);
-            ::DispatchMessage(&msg);
-        }
-        else
-        {
-            wnd.UpdateView();
-            wnd.Repaint();
-        }
+        ::TranslateMessage(&msg);
+        ::DispatchMessage(&msg);
     }
 
+    // directories removed from tree are dropped only when whole tree is listed
+    scanner.Stop();
+    if ( !indexFile.empty() )
+        fileIndex.Save(indexFile.c_str(), szPath, scanner.IsFinished());
+
     return 0;
 }
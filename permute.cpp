@@ -0,0 +1,70 @@
+#include "stdafx.h"
+#include "permute.h"
+
+//
+// CPermutation class
+//
+
+CPermutation::CPermutation(UINT nCount, DWORD dwSeed) throw()
+    : m_nCount(nCount)
+    , m_nHalfBits(1)
+{
+    UINT nBits = 0;
+    while ( nBits < 32 && ((nCount - 1) >> nBits) != 0 )
+        ++nBits;
+
+    m_nHalfBits = max((nBits + 1) / 2, 1U);
+    m_nHalfMask = (DWORD)((1ULL << m_nHalfBits) - 1);
+
+    for ( UINT i = 0; i < ROUNDS; ++i )
+        m_keys[i] = Mix(dwSeed + i * 0x9E3779B9U);
+}
+
+// CPermutation::GetAt
+
+UINT CPermutation::GetAt(UINT nPosition) const throw()
+{
+    ASSERT(nPosition < m_nCount);
+
+    if ( m_nCount <= 1 )
+        return 0;
+
+    DWORD nValue = nPosition;
+    do
+    {
+        nValue = Encrypt(nValue);
+    }
+    while ( nValue >= m_nCount );
+
+    return nValue;
+}
+
+// CPermutation::Encrypt
+
+DWORD CPermutation::Encrypt(DWORD nValue) const throw()
+{
+    DWORD nLeft = (nValue >> m_nHalfBits) & m_nHalfMask;
+    DWORD nRight = nValue & m_nHalfMask;
+
+    for ( UINT i = 0; i < ROUNDS; ++i )
+    {
+        const DWORD nNext = nLeft ^ (Mix(nRight ^ m_keys[i]) & m_nHalfMask);
+        nLeft = nRight;
+        nRight = nNext;
+    }
+
+    return (nLeft << m_nHalfBits) | nRight;
+}
+
+// CPermutation::Mix
+
+DWORD CPermutation::Mix(DWORD nValue) throw()
+{
+    // murmur3 finalizer
+    nValue ^= nValue >> 16;
+    nValue *= 0x85EBCA6BU;
+    nValue ^= nValue >> 13;
+    nValue *= 0xC2B2AE35U;
+    nValue ^= nValue >> 16;
+    return nValue;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+//
+// CPermutation class
+// Pseudo-random order of indexes 0..N-1 computed without any table.
+// Balanced Feistel network permutes smallest domain of even bit count which
+// covers N, results outside range are passed through network again. Network
+// is bijective, so walk ends in range, it takes below 4 rounds on average.
+// Same seed gives same order.
+//
+
+class CPermutation
+{
+public:
+    CPermutation(UINT nCount, DWORD dwSeed) throw();
+
+    // Index at position, each index of range is at one position only
+    UINT GetAt(UINT nPosition) const throw();
+
+private:
+    enum { ROUNDS = 4 };
+
+    DWORD Encrypt(DWORD nValue) const throw();
+    static DWORD Mix(DWORD nValue) throw();
+
+private:
+    UINT m_nCount;
+    UINT m_nHalfBits;
+    DWORD m_nHalfMask;
+    DWORD m_keys[ROUNDS];
+};
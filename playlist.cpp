@@ -0,0 +1,145 @@
+#include "stdafx.h"
+#include "playlist.h"
+
+//
+// CPlaylist class
+//
+
+CPlaylist::CPlaylist()
+    : m_nBlocks(0)
+    , m_nBlockUsed(0)
+    , m_nCount(0)
+    , m_bComplete(FALSE)
+{
+    ::ZeroMemory(m_chunks, sizeof(m_chunks));
+    ::ZeroMemory(m_blocks, sizeof(m_blocks));
+}
+
+CPlaylist::~CPlaylist()
+{
+    for ( UINT i = 0; i < MAX_CHUNKS; ++i )
+        delete[] m_chunks[i];
+    for ( UINT i = 0; i < m_nBlocks; ++i )
+        delete[] m_blocks[i];
+}
+
+// CPlaylist::Append
+
+void CPlaylist::Append(const wstring& directory, const LPCWSTR* pNames, UINT nNames) throw(...) // exception
+{
+    if ( nNames == 0 )
+        return;
+
+    CComCritSecLock<CComAutoCriticalSection> lock(m_cs);
+
+    DWORD nDirectory = 0;
+    if ( !Intern(directory.c_str(), directory.size(), &nDirectory) ) // exception
+        return;
+
+    UINT nCount = (UINT)m_nCount;
+    for ( UINT i = 0; i < nNames && nCount < MAX_CHUNKS * CHUNK_SIZE; ++i )
+    {
+        _Entry*& pChunk = m_chunks[nCount >> CHUNK_SHIFT];
+        if ( pChunk == NULL )
+            pChunk = new _Entry[CHUNK_SIZE]; // exception
+
+        _Entry& entry = pChunk[nCount & (CHUNK_SIZE - 1)];
+        if ( !Intern(pNames[i], wcslen(pNames[i]), &entry.nName) ) // exception
+            break;
+
+        entry.nDirectory = nDirectory;
+        ++nCount;
+    }
+
+    // paths are written before they are counted
+    ::InterlockedExchange(&m_nCount, (LONG)nCount);
+}
+
+// CPlaylist::SetComplete
+
+void CPlaylist::SetComplete() throw()
+{
+    ::InterlockedExchange(&m_bComplete, TRUE);
+}
+
+// CPlaylist::IsComplete
+
+BOOL CPlaylist::IsComplete() const throw()
+{
+    return m_bComplete;
+}
+
+// CPlaylist::GetCount
+
+UINT CPlaylist::GetCount() const throw()
+{
+    return (UINT)m_nCount;
+}
+
+// CPlaylist::GetAt
+
+wstring CPlaylist::GetAt(UINT nIndex) const throw(...) // exception
+{
+    LPCWSTR wszDirectory = GetDirectory(nIndex);
+    LPCWSTR wszName = GetName(nIndex);
+
+    const size_t nDirectoryLength = wcslen(wszDirectory);
+    const size_t nNameLength = wcslen(wszName);
+
+    wstring path;
+    path.reserve(nDirectoryLength + nNameLength); // exception
+    path.append(wszDirectory, nDirectoryLength);
+    path.append(wszName, nNameLength);
+    return path;
+}
+
+// CPlaylist::GetDirectory
+
+LPCWSTR CPlaylist::GetDirectory(UINT nIndex) const throw()
+{
+    ASSERT(nIndex < GetCount());
+    return GetText(m_chunks[nIndex >> CHUNK_SHIFT][nIndex & (CHUNK_SIZE - 1)].nDirectory);
+}
+
+// CPlaylist::GetName
+
+LPCWSTR CPlaylist::GetName(UINT nIndex) const throw()
+{
+    ASSERT(nIndex < GetCount());
+    return GetText(m_chunks[nIndex >> CHUNK_SHIFT][nIndex & (CHUNK_SIZE - 1)].nName);
+}
+
+// CPlaylist::Intern
+
+BOOL CPlaylist::Intern(LPCWSTR wszText, size_t nLength, DWORD* pnOffset) throw(...) // exception
+{
+    // text never spans blocks, so it is read by one pointer
+    const size_t nSize = nLength + 1;
+    if ( nSize > BLOCK_SIZE )
+        return FALSE;
+
+    if ( m_nBlocks == 0 || m_nBlockUsed + nSize > BLOCK_SIZE )
+    {
+        if ( m_nBlocks == MAX_BLOCKS )
+            return FALSE;
+
+        m_blocks[m_nBlocks] = new WCHAR[BLOCK_SIZE]; // exception
+        ++m_nBlocks;
+        m_nBlockUsed = 0;
+    }
+
+    WCHAR* pText = m_blocks[m_nBlocks - 1] + m_nBlockUsed;
+    memcpy(pText, wszText, nLength * sizeof(WCHAR));
+    pText[nLength] = L'\0';
+
+    *pnOffset = ((m_nBlocks - 1) << BLOCK_SHIFT) | m_nBlockUsed;
+    m_nBlockUsed += (UINT)nSize;
+    return TRUE;
+}
+
+// CPlaylist::GetText
+
+LPCWSTR CPlaylist::GetText(DWORD nOffset) const throw()
+{
+    return m_blocks[nOffset >> BLOCK_SHIFT] + (nOffset & (BLOCK_SIZE - 1));
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+//
+// CPlaylist class
+// Image paths found so far, filled by scanner while slideshow runs.
+// Directory and file names are packed into arena blocks, directory of
+// many files is stored once. Each path is two arena offsets in table of
+// fixed chunks. Blocks and chunks never move, so readers take no lock.
+//
+
+class CPlaylist
+{
+public:
+    CPlaylist();
+    ~CPlaylist();
+
+    // Files of one directory, directory ends with backslash.
+    // Readers see them when call returns, paths over capacity are dropped.
+    void Append(const wstring& directory, const LPCWSTR* pNames, UINT nNames) throw(...); // exception
+
+    // No paths are appended after it
+    void SetComplete() throw();
+    BOOL IsComplete() const throw();
+
+    UINT GetCount() const throw();
+
+    // nIndex is below count read before
+    wstring GetAt(UINT nIndex) const throw(...); // exception
+    LPCWSTR GetDirectory(UINT nIndex) const throw();
+    LPCWSTR GetName(UINT nIndex) const throw();
+
+private:
+    enum
+    {
+        CHUNK_SHIFT = 12,
+        CHUNK_SIZE = 1 << CHUNK_SHIFT,
+        MAX_CHUNKS = 4096,              // 16M paths
+
+        BLOCK_SHIFT = 20,
+        BLOCK_SIZE = 1 << BLOCK_SHIFT,  // characters, 2 MB
+        MAX_BLOCKS = 4096               // offset is 32 bit
+    };
+
+    struct _Entry
+    {
+        DWORD nDirectory;               // arena offsets
+        DWORD nName;
+    };
+
+    BOOL Intern(LPCWSTR wszText, size_t nLength, DWORD* pnOffset) throw(...); // exception
+    LPCWSTR GetText(DWORD nOffset) const throw();
+
+private:
+    _Entry* m_chunks[MAX_CHUNKS];
+    WCHAR* m_blocks[MAX_BLOCKS];
+    UINT m_nBlocks;                     // appends only
+    UINT m_nBlockUsed;                  // characters of last block
+    volatile LONG m_nCount;             // published paths
+    volatile LONG m_bComplete;
+    CComAutoCriticalSection m_cs;       // appends
+};
@@ -0,0 +1,282 @@
+#include "stdafx.h"
+#include "prefetch.h"
+#include "imghelp.h"
+#include "prevcache.h"
+#include "playlist.h"
+#include "fileindex.h"
+#include "permute.h"
+#include <process.h>
+
+static const DWORD PLAYLIST_POLL_MSEC = 50;
+
+//
+// CImagePrefetcher class
+//
+
+CImagePrefetcher::CImagePrefetcher(
+                    const CPlaylist* pPlaylist,
+                    const Size& sizeMax,
+                    Color clrBackground,
+                    CPreviewCache* pCache,
+                    CFileIndex* pIndex,
+                    BOOL bShuffle,
+                    DWORD dwShuffleSeed,
+                    UINT nDepth /* = 4 */,
+                    LONG nMaxBytes /* = 128 << 20 */,
+                    UINT nThreads /* = 2 */
+                    ) throw(...) // exception
+    : m_pPlaylist(pPlaylist)
+    , m_sizeMax(sizeMax)
+    , m_clrBackground(clrBackground)
+    , m_pCache(pCache)
+    , m_pIndex(pIndex)
+    , m_bShuffle(bShuffle)
+    , m_bShuffleFirstPass(pPlaylist->IsComplete())
+    , m_dwShuffleSeed(dwShuffleSeed)
+    , m_pSlots(NULL)
+    , m_nDepth(( nDepth > 0 ) ? (LONG)nDepth : 1)
+    , m_nMaxBytes(nMaxBytes)
+    , m_nNextClaim(0)
+    , m_nNextPop(0)
+    , m_nBytes(0)
+    , m_bCancelled(FALSE)
+    , m_hCancelEvent(NULL)
+    , m_hSpaceEvent(NULL)
+{
+    // one wait covers all workers on cancel
+    nThreads = min(nThreads, (UINT)MAXIMUM_WAIT_OBJECTS);
+    m_threads.reserve(nThreads); // exception
+
+    m_pSlots = new _Slot[m_nDepth]; // exception
+    ::ZeroMemory(m_pSlots, sizeof(_Slot) * m_nDepth);
+
+    m_hCancelEvent = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+    m_hSpaceEvent = ::CreateEvent(NULL, FALSE, FALSE, NULL);
+
+    // without workers Pop decodes images itself
+    if ( m_hCancelEvent == NULL || m_hSpaceEvent == NULL )
+        return;
+
+    for ( UINT i = 0; i < nThreads; ++i )
+    {
+        HANDLE hThread = (HANDLE)_beginthreadex(NULL, 0, WorkerProc, this, 0, NULL);
+        if ( hThread == NULL )
+            break;
+
+        m_threads.push_back(hThread);
+    }
+}
+
+CImagePrefetcher::~CImagePrefetcher()
+{
+    Cancel();
+
+    if ( m_hCancelEvent != NULL )
+        ::CloseHandle(m_hCancelEvent);
+    if ( m_hSpaceEvent != NULL )
+        ::CloseHandle(m_hSpaceEvent);
+
+    delete[] m_pSlots;
+}
+
+// CImagePrefetcher::Pop
+
+BOOL CImagePrefetcher::Pop(HBITMAP* phBitmap, BITMAP* pBitmap) throw()
+{
+    ASSERT(phBitmap != NULL);
+    ASSERT(pBitmap != NULL);
+
+    if ( m_bCancelled )
+        return FALSE;
+
+    if ( m_threads.empty() )
+    {
+        LONG nSeq;
+        if ( Claim(&nSeq) )
+            Produce(nSeq);
+    }
+
+    _Slot& slot = m_pSlots[m_nNextPop % m_nDepth];
+    if ( slot.nState != SLOT_READY )
+        return FALSE;
+
+    *phBitmap = slot.hBitmap;
+    *pBitmap = slot.bmp;
+    const LONG nBytes = slot.nBytes;
+    slot.hBitmap = NULL;
+
+    // slot is given back before sequence moves, so its next claimer finds it empty
+    ::InterlockedExchange(&slot.nState, SLOT_EMPTY);
+    ::InterlockedExchangeAdd(&m_nBytes, -nBytes);
+    ::InterlockedIncrement(&m_nNextPop);
+
+    if ( m_hSpaceEvent != NULL )
+        ::SetEvent(m_hSpaceEvent);
+
+    return TRUE;
+}
+
+// CImagePrefetcher::Cancel
+
+void CImagePrefetcher::Cancel() throw()
+{
+    m_bCancelled = TRUE;
+
+    if ( !m_threads.empty() )
+    {
+        ::SetEvent(m_hCancelEvent);
+        ::WaitForMultipleObjects((DWORD)m_threads.size(), &m_threads[0], TRUE, INFINITE);
+
+        for ( size_t i = 0; i < m_threads.size(); ++i )
+            ::CloseHandle(m_threads[i]);
+        m_threads.clear();
+    }
+
+    for ( LONG i = 0; i < m_nDepth; ++i )
+    {
+        if ( m_pSlots[i].hBitmap != NULL )
+            ::DeleteObject(m_pSlots[i].hBitmap);
+
+        ::ZeroMemory(&m_pSlots[i], sizeof(_Slot));
+    }
+
+    m_nBytes = 0;
+}
+
+// CImagePrefetcher::WorkerProc
+
+unsigned __stdcall CImagePrefetcher::WorkerProc(void* pParam)
+{
+    // WIC decoders are COM objects
+    const HRESULT hr = ::CoInitializeEx(NULL, COINIT_MULTITHREADED);
+
+    ((CImagePrefetcher*)pParam)->Work();
+
+    if ( SUCCEEDED(hr) )
+        ::CoUninitialize();
+    return 0;
+}
+
+// CImagePrefetcher::Work
+
+void CImagePrefetcher::Work() throw()
+{
+    HANDLE handles[] = { m_hCancelEvent, m_hSpaceEvent };
+
+    while ( ::WaitForSingleObject(m_hCancelEvent, 0) == WAIT_TIMEOUT )
+    {
+        LONG nSeq;
+        if ( Claim(&nSeq) )
+        {
+            Produce(nSeq);
+            continue;
+        }
+
+        // wait for UI to take an image, growing playlist is polled
+        const DWORD dwTimeout = m_pPlaylist->IsComplete() ? INFINITE : PLAYLIST_POLL_MSEC;
+        const DWORD dwWait = ::WaitForMultipleObjects(2, handles, FALSE, dwTimeout);
+        if ( dwWait != WAIT_OBJECT_0 + 1 && dwWait != WAIT_TIMEOUT )
+            break;
+    }
+}
+
+// CImagePrefetcher::Claim
+
+BOOL CImagePrefetcher::Claim(LONG* pnSeq) throw()
+{
+    for ( ;; )
+    {
+        const LONG nSeq = m_nNextClaim;
+
+        // ring is full or ready images hold too much memory,
+        // claims go in order so image UI waits for is never held back
+        if ( nSeq - m_nNextPop >= m_nDepth || m_nBytes >= m_nMaxBytes )
+            return FALSE;
+
+        // image is not found yet, playlist wraps around when it is complete
+        const BOOL bComplete = m_pPlaylist->IsComplete();
+        const UINT nCount = m_pPlaylist->GetCount();
+        if ( (UINT)nSeq >= nCount && !(bComplete && nCount > 0) )
+            return FALSE;
+
+        if ( ::InterlockedCompareExchange(&m_nNextClaim, nSeq + 1, nSeq) == nSeq )
+        {
+            ::InterlockedExchange(&m_pSlots[nSeq % m_nDepth].nState, SLOT_BUSY);
+            *pnSeq = nSeq;
+            return TRUE;
+        }
+    }
+}
+
+// CImagePrefetcher::Produce
+
+void CImagePrefetcher::Produce(LONG nSeq) throw()
+{
+    _Slot& slot = m_pSlots[nSeq % m_nDepth];
+    ASSERT(slot.nState == SLOT_BUSY);
+
+    // image is skipped if memory runs out
+    wstring name;
+    try
+    {
+        name = m_pPlaylist->GetAt(GetIndex(nSeq)); // exception
+    }
+    catch (...)
+    {
+    }
+
+    LPCWSTR wszName = name.c_str();
+
+    // preview of earlier run needs no decode
+    slot.hBitmap = NULL;
+    if ( m_pCache != NULL )
+        slot.hBitmap = m_pCache->Get(wszName, m_sizeMax);
+
+    if ( slot.hBitmap == NULL )
+    {
+        SIZE sizeImage = { 0, 0 };
+        slot.hBitmap = CImageHelper::LoadScaledBitmap(wszName, m_sizeMax, m_clrBackground, &sizeImage);
+        if ( slot.hBitmap != NULL && m_pCache != NULL )
+            m_pCache->Put(wszName, m_sizeMax, slot.hBitmap);
+        if ( slot.hBitmap != NULL && m_pIndex != NULL )
+            m_pIndex->SetImageSize(name, sizeImage);
+    }
+
+    slot.nBytes = 0;
+    ::ZeroMemory(&slot.bmp, sizeof(slot.bmp));
+    if ( slot.hBitmap != NULL )
+    {
+        ::GetObject(slot.hBitmap, sizeof(slot.bmp), &slot.bmp);
+        slot.nBytes = slot.bmp.bmWidthBytes * slot.bmp.bmHeight;
+    }
+
+    // slot is published after its fields are written
+    ::InterlockedExchangeAdd(&m_nBytes, slot.nBytes);
+    ::InterlockedExchange(&slot.nState, SLOT_READY);
+}
+
+// CImagePrefetcher::GetIndex
+
+UINT CImagePrefetcher::GetIndex(LONG nSeq) const throw()
+{
+    // sequence is below count or playlist is complete, see Claim
+    const UINT nCount = m_pPlaylist->GetCount();
+    UINT nPosition = (UINT)nSeq;
+    if ( !m_bShuffle )
+        return nPosition % nCount;
+
+    // playlist growing while scan runs is shown in order first,
+    // shuffled passes start when it is complete
+    if ( !m_bShuffleFirstPass )
+    {
+        if ( nPosition < nCount )
+            return nPosition;
+
+        nPosition -= nCount;
+    }
+
+    // each pass has its own order, no table is kept for any of them
+    const UINT nPass = nPosition / nCount;
+    const CPermutation permutation(nCount, m_dwShuffleSeed + nPass * 0x9E3779B9U);
+    return permutation.GetAt(nPosition % nCount);
+}
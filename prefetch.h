@@ -0,0 +1,83 @@
+#pragma once
+
+// forward declaration
+class CPreviewCache;
+class CPlaylist;
+class CFileIndex;
+
+//
+// CImagePrefetcher class
+// Decodes and pre-scales next images of the playlist on worker threads.
+// Images are handed over in list or shuffled order through bounded ring of slots,
+// slots are claimed and published by interlocked operations, no locks.
+//
+
+class CImagePrefetcher
+{
+public:
+    CImagePrefetcher(
+            const CPlaylist* pPlaylist,     // can grow while images are decoded
+            const Size& sizeMax,            // view size, images are scaled down to it
+            Color clrBackground,            // transparent pixels are composed on it
+            CPreviewCache* pCache,          // previews of earlier runs, can be NULL
+            CFileIndex* pIndex,             // receives sizes of decoded images, can be NULL
+            BOOL bShuffle,                  // each pass over playlist in other random order
+            DWORD dwShuffleSeed,            // same seed gives same orders
+            UINT nDepth = 4,                // max images decoded ahead
+            LONG nMaxBytes = 128 << 20,     // max pixel bytes held by ready images
+            UINT nThreads = 2
+            ) throw(...); // exception
+    ~CImagePrefetcher();
+
+    // Next image in list order, FALSE if it is not decoded yet.
+    // Caller owns returned bitmap, it is NULL if image is not read.
+    BOOL Pop(HBITMAP* phBitmap, BITMAP* pBitmap) throw();
+
+    // Stops workers and frees images not taken, image being decoded is finished first
+    void Cancel() throw();
+
+private:
+    enum
+    {
+        SLOT_EMPTY = 0,
+        SLOT_BUSY  = 1,
+        SLOT_READY = 2
+    };
+
+    struct _Slot
+    {
+        volatile LONG nState;
+        HBITMAP hBitmap;
+        BITMAP bmp;
+        LONG nBytes;
+    };
+
+    static unsigned __stdcall WorkerProc(void* pParam);
+    void Work() throw();
+    BOOL Claim(LONG* pnSeq) throw();
+    void Produce(LONG nSeq) throw();
+    UINT GetIndex(LONG nSeq) const throw();
+
+private:
+    const CPlaylist* m_pPlaylist;
+    Size m_sizeMax;
+    Color m_clrBackground;
+    CPreviewCache* m_pCache;
+    CFileIndex* m_pIndex;
+    BOOL m_bShuffle;
+    BOOL m_bShuffleFirstPass;       // playlist is complete when slideshow starts
+    DWORD m_dwShuffleSeed;
+
+    _Slot* m_pSlots;
+    LONG m_nDepth;
+    LONG m_nMaxBytes;
+
+    volatile LONG m_nNextClaim;     // next sequence to decode, workers only
+    volatile LONG m_nNextPop;       // next sequence to hand over, UI only
+    volatile LONG m_nBytes;         // pixel bytes of ready slots
+    BOOL m_bCancelled;
+
+    HANDLE m_hCancelEvent;          // manual reset
+    HANDLE m_hSpaceEvent;           // auto reset, set when slot is freed
+    vector<HANDLE> m_threads;
+};
@@ -0,0 +1,476 @@
+#include "stdafx.h"
+#include "prevcache.h"
+
+static const DWORD PACK_MAGIC = 0x4B434150;     // "PACK"
+static const DWORD PACK_VERSION = 1;
+static const DWORD RECORD_MAGIC = 0x56455250;   // "PREV"
+static const DWORD RECORD_TRAILER = 0x444E4550; // "PEND", record is whole
+static const DWORD MAX_PATH_LENGTH = 32767;
+
+// path is padded to keep pixels aligned
+inline DWORD GetPathBytes(DWORD nPathLength) throw()
+{
+    return (nPathLength * sizeof(WCHAR) + 3) & ~3;
+}
+
+//
+// CPreviewCache class
+//
+
+CPreviewCache::CPreviewCache()
+    : m_nMaxBytes(0)
+    , m_hFile(NULL)
+    , m_hMapping(NULL)
+    , m_pView(NULL)
+    , m_nFileSize(0)
+{
+}
+
+CPreviewCache::~CPreviewCache()
+{
+    Close();
+}
+
+// CPreviewCache::Open
+
+BOOL CPreviewCache::Open(LPCWSTR wszPackFile, ULONGLONG nMaxBytes) throw()
+{
+    CComCritSecLock<CComAutoCriticalSection> lock(m_cs);
+
+    Close();
+
+    m_packFile = wszPackFile;
+    m_nMaxBytes = nMaxBytes;
+
+    if ( !OpenFile() )
+    {
+        Close();
+        return FALSE;
+    }
+
+    if ( m_nFileSize > m_nMaxBytes )
+        Compact(m_nMaxBytes / 2);
+
+    return TRUE;
+}
+
+// CPreviewCache::Close
+
+void CPreviewCache::Close() throw()
+{
+    CComCritSecLock<CComAutoCriticalSection> lock(m_cs);
+
+    Unmap();
+
+    if ( m_hFile != NULL )
+        ::CloseHandle(m_hFile);
+    m_hFile = NULL;
+    m_nFileSize = 0;
+
+    m_index.clear();
+}
+
+// CPreviewCache::Get
+
+HBITMAP CPreviewCache::Get(LPCWSTR wszName, const Size& sizeView) throw()
+{
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if ( !GetFileKey(wszName, &data) )
+        return NULL;
+
+    CComCritSecLock<CComAutoCriticalSection> lock(m_cs);
+
+    _Index::const_iterator i = m_index.find(wszName);
+    if ( m_pView == NULL || i == m_index.end() )
+        return NULL;
+
+    // image is changed or view is resized
+    _RecordHeader* pRecord = GetRecord(i->second);
+    if ( pRecord->nFileSizeLow != data.nFileSizeLow || pRecord->nFileSizeHigh != data.nFileSizeHigh ||
+         ::CompareFileTime(&pRecord->ftLastWrite, &data.ftLastWriteTime) != 0 ||
+         pRecord->nViewWidth != sizeView.Width || pRecord->nViewHeight != sizeView.Height )
+    {
+        return NULL;
+    }
+
+    // bitmap is made by GDI+ like view bitmap
+    HBITMAP hBitmap = NULL;
+    {
+        Bitmap preview(pRecord->nWidth, pRecord->nHeight, PixelFormat32bppARGB);
+        if ( preview.GetLastStatus() != Ok || preview.GetHBITMAP(Color::Black, &hBitmap) != Ok )
+            return NULL;
+    }
+
+    DIBSECTION dib = { 0 };
+    ::GetObject(hBitmap, sizeof(dib), &dib);
+    if ( dib.dsBm.bmBits == NULL || dib.dsBm.bmBitsPixel != 32 ||
+         dib.dsBm.bmWidth != pRecord->nWidth || dib.dsBm.bmHeight != pRecord->nHeight )
+    {
+        ::DeleteObject(hBitmap);
+        return NULL;
+    }
+
+    // stored rows are top-down
+    const BYTE* pPixels = (const BYTE*)pRecord + sizeof(_RecordHeader) + GetPathBytes(pRecord->nPathLength);
+    const BOOL bBottomUp = ( dib.dsBmih.biHeight > 0 );
+    const DWORD nRowBytes = (DWORD)pRecord->nWidth * 4;
+    for ( LONG y = 0; y < pRecord->nHeight; ++y )
+    {
+        const LONG yDst = bBottomUp ? pRecord->nHeight - 1 - y : y;
+        memcpy((BYTE*)dib.dsBm.bmBits + yDst * dib.dsBm.bmWidthBytes, pPixels + y * nRowBytes, nRowBytes);
+    }
+
+    ::GetSystemTimeAsFileTime(&pRecord->ftLastUse);
+    return hBitmap;
+}
+
+// CPreviewCache::Put
+
+void CPreviewCache::Put(LPCWSTR wszName, const Size& sizeView, HBITMAP hBitmap) throw()
+{
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if ( !GetFileKey(wszName, &data) )
+        return;
+
+    DIBSECTION dib = { 0 };
+    if ( ::GetObject(hBitmap, sizeof(dib), &dib) != sizeof(dib) ||
+         dib.dsBm.bmBits == NULL || dib.dsBm.bmBitsPixel != 32 )
+    {
+        return;
+    }
+
+    _RecordHeader header = { 0 };
+    header.dwMagic = RECORD_MAGIC;
+    header.nPathLength = (DWORD)wcslen(wszName);
+    header.nFileSizeLow = data.nFileSizeLow;
+    header.nFileSizeHigh = data.nFileSizeHigh;
+    header.ftLastWrite = data.ftLastWriteTime;
+    header.nViewWidth = sizeView.Width;
+    header.nViewHeight = sizeView.Height;
+    header.nWidth = dib.dsBm.bmWidth;
+    header.nHeight = dib.dsBm.bmHeight;
+    header.dwRecordSize = GetRecordSize(header.nPathLength, header.nWidth, header.nHeight);
+    header.dwChecksum = GetChecksum(&header, wszName);
+    ::GetSystemTimeAsFileTime(&header.ftLastUse);
+
+    if ( header.dwRecordSize == 0 )
+        return;
+
+    // record is written at once, so crash leaves at most one torn record
+    BYTE* pRecord = (BYTE*)malloc(header.dwRecordSize);
+    if ( pRecord == NULL )
+        return;
+
+    memset(pRecord, 0, header.dwRecordSize);
+    memcpy(pRecord, &header, sizeof(header));
+    memcpy(pRecord + sizeof(header), wszName, header.nPathLength * sizeof(WCHAR));
+
+    BYTE* pPixels = pRecord + sizeof(header) + GetPathBytes(header.nPathLength);
+    const BOOL bBottomUp = ( dib.dsBmih.biHeight > 0 );
+    const DWORD nRowBytes = (DWORD)header.nWidth * 4;
+    for ( LONG y = 0; y < header.nHeight; ++y )
+    {
+        const LONG ySrc = bBottomUp ? header.nHeight - 1 - y : y;
+        memcpy(pPixels + y * nRowBytes, (const BYTE*)dib.dsBm.bmBits + ySrc * dib.dsBm.bmWidthBytes, nRowBytes);
+    }
+
+    const DWORD dwTrailer = RECORD_TRAILER;
+    memcpy(pRecord + header.dwRecordSize - sizeof(DWORD), &dwTrailer, sizeof(DWORD));
+
+    CComCritSecLock<CComAutoCriticalSection> lock(m_cs);
+
+    // room is made by dropping least recently used previews
+    BOOL bWrite = ( m_hFile != NULL && header.dwRecordSize <= m_nMaxBytes / 2 );
+    if ( bWrite && m_nFileSize + header.dwRecordSize > m_nMaxBytes )
+        bWrite = Compact(m_nMaxBytes / 2);
+
+    if ( bWrite )
+    {
+        LARGE_INTEGER nOffset;
+        nOffset.QuadPart = (LONGLONG)m_nFileSize;
+        ::SetFilePointerEx(m_hFile, nOffset, NULL, FILE_BEGIN);
+
+        if ( WriteData(m_hFile, pRecord, header.dwRecordSize) )
+        {
+            // view is extended over new record
+            Unmap();
+            m_nFileSize += header.dwRecordSize;
+            Map();
+
+            m_index[wszName] = (ULONGLONG)nOffset.QuadPart;
+        }
+        else
+        {
+            ::SetFilePointerEx(m_hFile, nOffset, NULL, FILE_BEGIN);
+            ::SetEndOfFile(m_hFile);
+        }
+    }
+
+    free(pRecord);
+}
+
+// CPreviewCache::OpenFile
+
+BOOL CPreviewCache::OpenFile() throw()
+{
+    ASSERT(m_hFile == NULL);
+
+    m_hFile = ::CreateFileW(m_packFile.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
+                            NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if ( m_hFile == INVALID_HANDLE_VALUE )
+    {
+        m_hFile = NULL;
+        return FALSE;
+    }
+
+    LARGE_INTEGER nSize;
+    if ( !::GetFileSizeEx(m_hFile, &nSize) )
+        return FALSE;
+
+    m_nFileSize = (ULONGLONG)nSize.QuadPart;
+    if ( !Map() )
+        return FALSE;
+
+    // pack of other version or with torn header is started anew
+    const _PackHeader* pHeader = (const _PackHeader*)m_pView;
+    if ( m_nFileSize < sizeof(_PackHeader) ||
+         pHeader->dwMagic != PACK_MAGIC || pHeader->dwVersion != PACK_VERSION )
+    {
+        if ( !Reset() )
+            return FALSE;
+    }
+
+    Scan();
+    return TRUE;
+}
+
+// CPreviewCache::Map
+
+BOOL CPreviewCache::Map() throw()
+{
+    ASSERT(m_hMapping == NULL && m_pView == NULL);
+
+    // empty file cannot be mapped
+    if ( m_nFileSize == 0 )
+        return TRUE;
+    if ( m_nFileSize > (SIZE_T)-1 )
+        return FALSE;
+
+    m_hMapping = ::CreateFileMappingW(m_hFile, NULL, PAGE_READWRITE, 0, 0, NULL);
+    if ( m_hMapping == NULL )
+        return FALSE;
+
+    m_pView = (BYTE*)::MapViewOfFile(m_hMapping, FILE_MAP_WRITE, 0, 0, 0);
+    if ( m_pView == NULL )
+    {
+        ::CloseHandle(m_hMapping);
+        m_hMapping = NULL;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+// CPreviewCache::Unmap
+
+void CPreviewCache::Unmap() throw()
+{
+    if ( m_pView != NULL )
+        ::UnmapViewOfFile(m_pView);
+    m_pView = NULL;
+
+    if ( m_hMapping != NULL )
+        ::CloseHandle(m_hMapping);
+    m_hMapping = NULL;
+}
+
+// CPreviewCache::Scan
+
+void CPreviewCache::Scan() throw()
+{
+    m_index.clear();
+    if ( m_pView == NULL )
+        return;
+
+    ULONGLONG nOffset = sizeof(_PackHeader);
+    while ( nOffset + sizeof(_RecordHeader) <= m_nFileSize )
+    {
+        const _RecordHeader* pRecord = GetRecord(nOffset);
+        if ( pRecord->dwMagic != RECORD_MAGIC )
+            break;
+
+        const DWORD dwRecordSize = GetRecordSize(pRecord->nPathLength, pRecord->nWidth, pRecord->nHeight);
+        if ( dwRecordSize == 0 || dwRecordSize != pRecord->dwRecordSize || nOffset + dwRecordSize > m_nFileSize )
+            break;
+
+        const BYTE* pRecordBytes = (const BYTE*)pRecord;
+        LPCWSTR wszPath = (LPCWSTR)(pRecordBytes + sizeof(_RecordHeader));
+        if ( *(const DWORD*)(pRecordBytes + dwRecordSize - sizeof(DWORD)) != RECORD_TRAILER ||
+             GetChecksum(pRecord, wszPath) != pRecord->dwChecksum )
+        {
+            break;
+        }
+
+        // later record of same image replaces earlier one
+        m_index[wstring(wszPath, pRecord->nPathLength)] = nOffset;
+        nOffset += dwRecordSize;
+    }
+
+    // tail torn by crash is cut off, appends go after last whole record
+    if ( nOffset < m_nFileSize )
+    {
+        Unmap();
+
+        LARGE_INTEGER nEnd;
+        nEnd.QuadPart = (LONGLONG)nOffset;
+        if ( ::SetFilePointerEx(m_hFile, nEnd, NULL, FILE_BEGIN) && ::SetEndOfFile(m_hFile) )
+            m_nFileSize = nOffset;
+
+        if ( !Map() )
+            m_index.clear();
+    }
+}
+
+// CPreviewCache::Reset
+
+BOOL CPreviewCache::Reset() throw()
+{
+    Unmap();
+    m_index.clear();
+
+    LARGE_INTEGER nBegin;
+    nBegin.QuadPart = 0;
+    if ( !::SetFilePointerEx(m_hFile, nBegin, NULL, FILE_BEGIN) || !::SetEndOfFile(m_hFile) )
+        return FALSE;
+
+    const _PackHeader header = { PACK_MAGIC, PACK_VERSION };
+    if ( !WriteData(m_hFile, &header, sizeof(header)) )
+        return FALSE;
+
+    m_nFileSize = sizeof(header);
+    return Map();
+}
+
+// CPreviewCache::Compact
+
+BOOL CPreviewCache::Compact(ULONGLONG nMaxBytes) throw()
+{
+    if ( m_pView == NULL )
+        return FALSE;
+
+    // records by last use, most recent first
+    typedef pair<ULONGLONG, ULONGLONG> _Use; // last use, offset
+    vector<_Use> records;
+    records.reserve(m_index.size());
+    for ( _Index::const_iterator i = m_index.begin(); i != m_index.end(); ++i )
+    {
+        const _RecordHeader* pRecord = GetRecord(i->second);
+
+        ULARGE_INTEGER nLastUse;
+        nLastUse.LowPart = pRecord->ftLastUse.dwLowDateTime;
+        nLastUse.HighPart = pRecord->ftLastUse.dwHighDateTime;
+        records.push_back(_Use(nLastUse.QuadPart, i->second));
+    }
+    sort(records.rbegin(), records.rend());
+
+    // records kept are copied to new pack, stale ones are not in index
+    const wstring tempFile = m_packFile + L".tmp";
+    HANDLE hTempFile = ::CreateFileW(tempFile.c_str(), GENERIC_WRITE, 0, NULL,
+                                     CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if ( hTempFile == INVALID_HANDLE_VALUE )
+        return FALSE;
+
+    const _PackHeader header = { PACK_MAGIC, PACK_VERSION };
+    BOOL bOk = WriteData(hTempFile, &header, sizeof(header));
+    ULONGLONG nSize = sizeof(header);
+    for ( size_t i = 0; bOk && i < records.size(); ++i )
+    {
+        const _RecordHeader* pRecord = GetRecord(records[i].second);
+        if ( nSize + pRecord->dwRecordSize > nMaxBytes )
+            continue;
+
+        bOk = WriteData(hTempFile, pRecord, pRecord->dwRecordSize);
+        nSize += pRecord->dwRecordSize;
+    }
+
+    ::CloseHandle(hTempFile);
+
+    // pack is replaced as whole, crash leaves either old or new one
+    Unmap();
+    ::CloseHandle(m_hFile);
+    m_hFile = NULL;
+
+    if ( !bOk || !::MoveFileExW(tempFile.c_str(), m_packFile.c_str(), MOVEFILE_REPLACE_EXISTING) )
+    {
+        ::DeleteFileW(tempFile.c_str());
+        bOk = FALSE;
+    }
+
+    if ( !OpenFile() )
+    {
+        Close();
+        return FALSE;
+    }
+
+    return bOk;
+}
+
+// CPreviewCache::GetRecord
+
+CPreviewCache::_RecordHeader* CPreviewCache::GetRecord(ULONGLONG nOffset) const throw()
+{
+    ASSERT(m_pView != NULL);
+    ASSERT(nOffset + sizeof(_RecordHeader) <= m_nFileSize);
+
+    return (_RecordHeader*)(m_pView + (SIZE_T)nOffset);
+}
+
+// CPreviewCache::GetFileKey
+
+BOOL CPreviewCache::GetFileKey(LPCWSTR wszName, WIN32_FILE_ATTRIBUTE_DATA* pData) throw()
+{
+    return ::GetFileAttributesExW(wszName, GetFileExInfoStandard, pData);
+}
+
+// CPreviewCache::GetRecordSize
+
+DWORD CPreviewCache::GetRecordSize(DWORD nPathLength, LONG nWidth, LONG nHeight) throw()
+{
+    if ( nPathLength == 0 || nPathLength > MAX_PATH_LENGTH || nWidth <= 0 || nHeight <= 0 )
+        return 0;
+
+    const ULONGLONG nSize = sizeof(_RecordHeader) + GetPathBytes(nPathLength) +
+                            (ULONGLONG)nWidth * (ULONGLONG)nHeight * 4 + sizeof(DWORD);
+    if ( nSize > MAXDWORD )
+        return 0;
+
+    return (DWORD)nSize;
+}
+
+// CPreviewCache::GetChecksum
+
+DWORD CPreviewCache::GetChecksum(const _RecordHeader* pHeader, LPCWSTR wszPath) throw()
+{
+    // FNV-1a of fields before checksum and path
+    DWORD dwHash = 2166136261U;
+
+    const BYTE* pBytes = (const BYTE*)pHeader;
+    const SIZE_T nHeaderBytes = (const BYTE*)&pHeader->dwChecksum - pBytes;
+    for ( SIZE_T i = 0; i < nHeaderBytes; ++i )
+        dwHash = (dwHash ^ pBytes[i]) * 16777619U;
+
+    pBytes = (const BYTE*)wszPath;
+    const SIZE_T nPathBytes = pHeader->nPathLength * sizeof(WCHAR);
+    for ( SIZE_T i = 0; i < nPathBytes; ++i )
+        dwHash = (dwHash ^ pBytes[i]) * 16777619U;
+
+    return dwHash;
+}
+
+// CPreviewCache::WriteData
+
+BOOL CPreviewCache::WriteData(HANDLE hFile, const void* pData, DWORD nSize) throw()
+{
+    DWORD nWritten = 0;
+    return ::WriteFile(hFile, pData, nSize, &nWritten, NULL) && nWritten == nSize;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+//
+// CPreviewCache class
+// Persistent cache of scaled images, survives restarts.
+// Previews are appended to pack file which is memory mapped, index is rebuilt
+// from record headers on open. Records are keyed by path, file size, file time
+// and view size. Torn tail left by crash is cut off on open, pack is compacted
+// to most recently used records when it grows over size cap.
+// Methods are thread safe.
+//
+
+class CPreviewCache
+{
+public:
+    CPreviewCache();
+    ~CPreviewCache();
+
+    BOOL Open(LPCWSTR wszPackFile, ULONGLONG nMaxBytes) throw();
+    void Close() throw();
+
+    // Cached preview of image for view size, NULL if there is none or it is stale
+    HBITMAP Get(LPCWSTR wszName, const Size& sizeView) throw();
+
+    // Stores 32bpp preview, older one of same image is dropped on compaction
+    void Put(LPCWSTR wszName, const Size& sizeView, HBITMAP hBitmap) throw();
+
+private:
+    struct _PackHeader
+    {
+        DWORD dwMagic;
+        DWORD dwVersion;
+    };
+
+    // followed by path, pixels of top-down rows and trailer
+    struct _RecordHeader
+    {
+        DWORD dwMagic;
+        DWORD dwRecordSize;
+        DWORD nPathLength;
+        DWORD nFileSizeLow;
+        DWORD nFileSizeHigh;
+        FILETIME ftLastWrite;
+        LONG nViewWidth;
+        LONG nViewHeight;
+        LONG nWidth;
+        LONG nHeight;
+        DWORD dwChecksum;       // of fields above and path
+        FILETIME ftLastUse;     // updated in place
+    };
+
+    typedef map<wstring, ULONGLONG> _Index; // record offset by path
+
+    BOOL OpenFile() throw();
+    BOOL Map() throw();
+    void Unmap() throw();
+    void Scan() throw();
+    BOOL Reset() throw();
+    BOOL Compact(ULONGLONG nMaxBytes) throw();
+
+    _RecordHeader* GetRecord(ULONGLONG nOffset) const throw();
+    static BOOL GetFileKey(LPCWSTR wszName, WIN32_FILE_ATTRIBUTE_DATA* pData) throw();
+    static DWORD GetRecordSize(DWORD nPathLength, LONG nWidth, LONG nHeight) throw();
+    static DWORD GetChecksum(const _RecordHeader* pHeader, LPCWSTR wszPath) throw();
+    static BOOL WriteData(HANDLE hFile, const void* pData, DWORD nSize) throw();
+
+private:
+    CComAutoCriticalSection m_cs;
+    wstring m_packFile;
+    ULONGLONG m_nMaxBytes;
+
+    HANDLE m_hFile;
+    HANDLE m_hMapping;
+    BYTE* m_pView;
+    ULONGLONG m_nFileSize;
+
+    _Index m_index;
+};
@@ -0,0 +1,450 @@
+#include "scatter.h"
+#include "imageio.h"
+#include <stdlib.h>
+#include <limits.h>
+#include <math.h>
+
+using namespace std;
+
+//
+// Consts
+//
+
+static const double _PI = 3.1415926535897932384626433832795;
+static const double DEG_TO_RAD = _PI / 180.0;
+
+// Thin outer frame is darker than frame
+static const double FRAME_SHADOW_RATIO = 0.91;
+
+//
+// Helpers
+//
+
+#define DegToRad(aDeg) ((aDeg) * DEG_TO_RAD)
+
+inline INT Round(const double& dValue) throw()
+{
+    return (INT)( dValue + (( dValue > 0 ) ? 0.5 : -0.5) );
+}
+
+inline INT Random(UINT nMaxWidth)
+{
+    if ( nMaxWidth != 0 )
+        return ( rand() % ((INT)nMaxWidth) ) - ( rand() % ((INT)nMaxWidth)/2 );
+    else
+        return 0;
+}
+
+//
+// CSurfaceHelper class
+//
+
+// CSurfaceHelper::GetScaledSize
+
+SIZE CSurfaceHelper::GetScaledSize(
+                    const SIZE& sizeImage,
+                    UINT nFrameThick,
+                    const SIZE& sizeMax
+                    ) throw()
+{
+    const SIZE sizeMaxNoFrame = { sizeMax.cx - 2 * (LONG)nFrameThick,
+                                  sizeMax.cy - 2 * (LONG)nFrameThick };
+
+    const double dWidthRatio = ((double)sizeMaxNoFrame.cx) / ((double)sizeImage.cx);
+    const double dHeightRatio = ((double)sizeMaxNoFrame.cy) / ((double)sizeImage.cy);
+    const double dRatio = (dWidthRatio < dHeightRatio) ? dWidthRatio : dHeightRatio;
+
+    const SIZE sizeScaled = { Round(dRatio * ((double)sizeImage.cx)),
+                              Round(dRatio * ((double)sizeImage.cy)) };
+    return sizeScaled;
+}
+
+// CSurfaceHelper::GetFrameBorderColor
+
+COLORREF CSurfaceHelper::GetFrameBorderColor(COLORREF clrFrame) throw()
+{
+    return RGB(
+        (BYTE)Round((double)GetRValue(clrFrame) * FRAME_SHADOW_RATIO),
+        (BYTE)Round((double)GetGValue(clrFrame) * FRAME_SHADOW_RATIO),
+        (BYTE)Round((double)GetBValue(clrFrame) * FRAME_SHADOW_RATIO));
+}
+
+// CSurfaceHelper::ScaleAndFrameSurface
+
+auto_ptr<CSurface> CSurfaceHelper::ScaleAndFrameSurface(
+                    const CSurface& image,
+                    UINT nFrameThick,
+                    const SIZE& sizeMax,
+                    COLORREF clrFrame /* = RGB(245, 245, 245) */
+                    ) // exception
+{
+    const SIZE sizeImage = { (LONG)image.GetWidth(), (LONG)image.GetHeight() };
+    const SIZE sizeScaled = GetScaledSize(sizeImage, nFrameThick, sizeMax);
+
+    const UINT nNewWidthNoFrame = (UINT)sizeScaled.cx;
+    const UINT nNewHeightNoFrame = (UINT)sizeScaled.cy;
+
+    auto_ptr<CSurface> pNewSurface( new CSurface(nFrameThick + nNewWidthNoFrame + nFrameThick,
+                                                 nFrameThick + nNewHeightNoFrame + nFrameThick) ); // exception
+
+    pNewSurface->Fill(GetFrameBorderColor(clrFrame));
+
+    const RECT rectFrame = { 1, 1, (LONG)pNewSurface->GetWidth() - 1, (LONG)pNewSurface->GetHeight() - 1 };
+    pNewSurface->FillRect(rectFrame, clrFrame);
+
+    AAStretchBlt(pNewSurface->GetBitmap(), nFrameThick, nFrameThick,
+                 nNewWidthNoFrame, nNewHeightNoFrame, image.GetBitmap());
+
+    return pNewSurface;
+}
+
+// CSurfaceHelper::CreateSolidSurface
+
+auto_ptr<CSurface> CSurfaceHelper::CreateSolidSurface(
+                    UINT nWidth,
+                    UINT nHeight,
+                    COLORREF clrBackground /* = RGB(0, 0, 0) */
+                    ) // exception
+{
+    auto_ptr<CSurface> pNewSurface( new CSurface(nWidth, nHeight) ); // exception
+    pNewSurface->Fill(clrBackground);
+    return pNewSurface;
+}
+
+//
+// CSurfaceScatter class
+//
+
+// CSurfaceScatter constructor/destructor
+
+CSurfaceScatter::CSurfaceScatter()
+{
+}
+
+CSurfaceScatter::~CSurfaceScatter()
+{
+    Clear();
+}
+
+// CSurfaceScatter::Clear
+
+void CSurfaceScatter::Clear() throw()
+{
+    _SurfaceList::iterator i = m_imageList.begin(), iend = m_imageList.end();
+    for ( ; i!= iend; ++i )
+    {
+        delete *i;
+    }
+    m_imageList.clear();
+}
+
+// CSurfaceScatter::AddImage
+
+bool CSurfaceScatter::AddImage(const char* szImage) // exception
+{
+    auto_ptr<CSurface> pImage( new CSurface ); // exception
+    if ( !CImageIO::Load(szImage, pImage.get()) ) // exception
+        return false;
+
+    AddImage(pImage); // exception
+    return true;
+}
+
+void CSurfaceScatter::AddImage(auto_ptr<CSurface>& pImage) // exception
+{
+    m_imageList.push_back(pImage.get()); // exception
+    pImage.release();
+}
+
+// CSurfaceScatter::Generate
+
+auto_ptr<CSurface> CSurfaceScatter::Generate(
+                    UINT nWidth,
+                    UINT nHeight,
+                    const double& dMaxAngleDeg,
+                    UINT nMaxOffset,
+                    UINT nFrameThick,
+                    COLORREF clrFrame /* = RGB(245, 245, 245) */,
+                    COLORREF clrBackground /* = RGB(255, 255, 255) */
+                    ) const // exception
+{
+    const RECT rectNewImage = { 0, 0, (LONG)nWidth, (LONG)nHeight };
+
+    auto_ptr<CSurface> pNewSurface = CSurfaceHelper::CreateSolidSurface(nWidth, nHeight, clrBackground); // exception
+
+    _SurfaceList::const_iterator i = m_imageList.begin(), iend = m_imageList.end();
+    for ( ; i!= iend; ++i )
+    {
+        DrawScatterImage(pNewSurface.get(), rectNewImage, **i, dMaxAngleDeg,
+                         nMaxOffset, nFrameThick, clrFrame); // exception
+    }
+
+    return pNewSurface;
+}
+
+// CSurfaceScatter::DrawScatterImage
+
+void CSurfaceScatter::DrawScatterImage(
+                    CSurface* pDstSurface,
+                    const RECT& rect,
+                    const CSurface& image,
+                    const double& dMaxAngleDeg,
+                    UINT nMaxOffset,
+                    UINT nFrameThick,
+                    COLORREF clrFrame
+                    ) // exception
+{
+    const SIZE sizeView = { rect.right - rect.left, rect.bottom - rect.top };
+    const SIZE sizeImageOriginal = { (LONG)image.GetWidth(), (LONG)image.GetHeight() };
+
+    // generate shift, scale and rotation
+    SIZE sizeImage;
+    POINT ptImageLeftTop;
+    double dImageAngleDeg;
+    CPositionGenerator::Generate(sizeView, sizeImageOriginal, dMaxAngleDeg, nMaxOffset,
+                                 &ptImageLeftTop, &dImageAngleDeg, &sizeImage);
+
+    // image is scaled and framed while drawn, no intermediate surface is made
+    const SIZE sizeScaled = CSurfaceHelper::GetScaledSize(sizeImageOriginal, nFrameThick, sizeImage);
+
+    // update size image to avoid floating mistakes
+    sizeImage.cx = sizeScaled.cx + 2 * (LONG)nFrameThick;
+    sizeImage.cy = sizeScaled.cy + 2 * (LONG)nFrameThick;
+
+    // calculate image bounding box
+    const RECT rectBound = CPositionGenerator::GetBoundingRect(sizeImage, dImageAngleDeg);
+
+    // adjust left/top position
+    ptImageLeftTop.x += rect.left + abs( rectBound.left );
+    ptImageLeftTop.y += rect.top + abs( rectBound.top );
+
+    // draw image
+    DrawFramedImage(pDstSurface->GetBitmap(), image.GetBitmap(), ptImageLeftTop, dImageAngleDeg,
+                    sizeScaled, nFrameThick, clrFrame);
+}
+
+// CSurfaceScatter::DrawImage
+
+void CSurfaceScatter::DrawImage(
+                    const BITMAP* pDstBitmap,
+                    const BITMAP* pSrcBitmap,
+                    const POINT& pt,
+                    const double& dAngleDeg,
+                    AAMIPMAP* pMipmap /* = NULL */
+                    ) throw()
+{
+    const double dSine = sin( DegToRad(dAngleDeg) );
+    const double dCosine = cos( DegToRad(dAngleDeg) );
+    XFORM_MATRIX xForm = { 0 };
+    xForm.eM11 = dCosine;
+    xForm.eM12 = dSine;
+    xForm.eM21 = -dSine;
+    xForm.eM22 = dCosine;
+    xForm.eDx = pt.x;
+    xForm.eDy = pt.y;
+
+    // pyramid is needed for downscaling only and built once per image
+    if ( pMipmap != NULL && pMipmap->nLevels == 0 && AAIsChunkFiltering(&xForm) )
+        AACreateMipmap(pSrcBitmap, pMipmap);
+
+    AATransformBltParallel(pDstBitmap, pt.x, pt.y, pSrcBitmap, 0, 0, pSrcBitmap->bmWidth, pSrcBitmap->bmHeight, &xForm,
+                           0, NULL, NULL, pMipmap);
+}
+
+// CSurfaceScatter::DrawFramedImage
+
+void CSurfaceScatter::DrawFramedImage(
+                    const BITMAP* pDstBitmap,
+                    const BITMAP* pSrcBitmap,
+                    const POINT& pt,
+                    const double& dAngleDeg,
+                    const SIZE& sizeScaled,
+                    UINT nFrameThick,
+                    COLORREF clrFrame
+                    ) // exception
+{
+    if ( sizeScaled.cx <= 0 || sizeScaled.cy <= 0 )
+        return;
+
+    // downscaled source is resampled to its size first: separable filter reads
+    // source once, while chunks of rotated source read it several times
+    XFORM_MATRIX xFormScale = { 0 };
+    xFormScale.eM11 = (double)sizeScaled.cx / (double)pSrcBitmap->bmWidth;
+    xFormScale.eM22 = (double)sizeScaled.cy / (double)pSrcBitmap->bmHeight;
+
+    CSurface scaled;
+    if ( AAIsChunkFiltering(&xFormScale) )
+    {
+        scaled.Create((UINT)sizeScaled.cx, (UINT)sizeScaled.cy); // exception
+        if ( AAResampleBlt(scaled.GetBitmap(), 0, 0, sizeScaled.cx, sizeScaled.cy,
+                           pSrcBitmap, 0, 0, pSrcBitmap->bmWidth, pSrcBitmap->bmHeight) )
+        {
+            pSrcBitmap = scaled.GetBitmap();
+            xFormScale.eM11 = 1.0;
+            xFormScale.eM22 = 1.0;
+        }
+    }
+
+    // frame pixels are destination pixels rotated around frame left/top
+    const double dSine = sin( DegToRad(dAngleDeg) );
+    const double dCosine = cos( DegToRad(dAngleDeg) );
+    XFORM_MATRIX xFormFrame = { 0 };
+    xFormFrame.eM11 = dCosine;
+    xFormFrame.eM12 = dSine;
+    xFormFrame.eM21 = -dSine;
+    xFormFrame.eM22 = dCosine;
+    xFormFrame.eDx = pt.x;
+    xFormFrame.eDy = pt.y;
+
+    // source is scaled into frame hole and rotated with frame by one matrix,
+    // pixel centers are aligned as resampling does
+    const double dScaleX = xFormScale.eM11;
+    const double dScaleY = xFormScale.eM22;
+    xFormScale.eDx = nFrameThick + 0.5 * (dScaleX - 1.0);
+    xFormScale.eDy = nFrameThick + 0.5 * (dScaleY - 1.0);
+
+    XFORM_MATRIX xForm;
+    MultMatrix(&xForm, &xFormScale, &xFormFrame);
+
+    // source position is whole pixel for blitter, so it is rounded inside frame
+    const POINT ptSrc = { Round(xForm.eDx), Round(xForm.eDy) };
+    xForm.eDx = ptSrc.x;
+    xForm.eDy = ptSrc.y;
+
+    // rounded source left/top in frame pixels
+    const double dOffsetX = (ptSrc.x - pt.x) * dCosine + (ptSrc.y - pt.y) * dSine;
+    const double dOffsetY = (ptSrc.y - pt.y) * dCosine - (ptSrc.x - pt.x) * dSine;
+
+    // source wholly covers its pixels [0...width-1], frame is not drawn there.
+    // One pixel margin hides rounding of source stepping.
+    AAFRAME frame;
+    frame.nWidth = sizeScaled.cx + 2 * (LONG)nFrameThick;
+    frame.nHeight = sizeScaled.cy + 2 * (LONG)nFrameThick;
+    frame.dHoleLeft = dOffsetX + 1.0;
+    frame.dHoleTop = dOffsetY + 1.0;
+    frame.dHoleRight = dOffsetX + (pSrcBitmap->bmWidth - 1) * dScaleX - 1.0;
+    frame.dHoleBottom = dOffsetY + (pSrcBitmap->bmHeight - 1) * dScaleY - 1.0;
+    frame.clrFrame = clrFrame;
+    frame.clrBorder = CSurfaceHelper::GetFrameBorderColor(clrFrame);
+    AAFrameBlt(pDstBitmap, &frame, &xFormFrame);
+
+    AATransformBltParallel(pDstBitmap, ptSrc.x, ptSrc.y, pSrcBitmap, 0, 0, pSrcBitmap->bmWidth, pSrcBitmap->bmHeight, &xForm);
+}
+
+//
+// CPositionGenerator class
+//
+
+// CPositionGenerator::Generate
+
+void CPositionGenerator::Generate(
+                    const SIZE& sizeView,
+                    const SIZE& sizeObjectOriginal,
+                    const double& dMaxAngleDeg,
+                    const UINT nMaxDeviation,
+                    POINT* pptLeftTop,
+                    double* pdAngleDeg,
+                    SIZE* pSizeObject,
+                    double* pdRatio /* = NULL */
+                    ) throw()
+{
+    const double dAngleDeg = Random( Round(dMaxAngleDeg) );
+    const INT nOffsetX = Random( nMaxDeviation );
+    const INT nOffsetY = Random( nMaxDeviation );
+
+    RECT rectView = { nOffsetX, nOffsetY, sizeView.cx + nOffsetX, sizeView.cy + nOffsetY };
+    if ( rectView.left < 0 )
+        rectView.left = 0;
+    if ( rectView.right > sizeView.cx )
+        rectView.right = sizeView.cx;
+    if ( rectView.top < 0 )
+        rectView.top = 0;
+    if ( rectView.bottom > sizeView.cy )
+        rectView.bottom = sizeView.cy;
+
+    const SIZE sizeAdjView = { rectView.right - rectView.left, rectView.bottom - rectView.top };
+
+    double dRatio;
+    SIZE sizeObjectBound;
+    const SIZE sizeObject = GetObjectSize(sizeAdjView, sizeObjectOriginal, dAngleDeg,
+                                          &dRatio, &sizeObjectBound);
+
+    const POINT ptLeftTop = { rectView.left + (sizeAdjView.cx - sizeObjectBound.cx) / 2,
+                              rectView.top +  (sizeAdjView.cy - sizeObjectBound.cy) / 2 };
+
+    *pSizeObject = sizeObject;
+    *pdAngleDeg = dAngleDeg;
+    *pptLeftTop = ptLeftTop;
+    if ( pdRatio != NULL )
+        *pdRatio = dRatio;
+}
+
+// CPositionGenerator::GetObjectSize
+
+SIZE CPositionGenerator::GetObjectSize(
+                    const SIZE& sizeView,
+                    const SIZE& sizeObjectOriginal,
+                    const double& dAngleDeg,
+                    double* pdRatio /* = NULL */,
+                    SIZE* pSizeObjectBound /* = NULL */
+                    ) throw()
+{
+    const RECT rectObjectBound = GetBoundingRect(sizeObjectOriginal, dAngleDeg);
+    const SIZE sizeObjectBound = { rectObjectBound.right - rectObjectBound.left,
+                                   rectObjectBound.bottom - rectObjectBound.top };
+
+    const double dWidthRatio = (double)sizeObjectBound.cx / (double)sizeView.cx;
+    const double dHeightRatio = (double)sizeObjectBound.cy / (double)sizeView.cy;
+    const double dRatio = (dWidthRatio > dHeightRatio) ? dWidthRatio : dHeightRatio;
+
+    if ( pSizeObjectBound != NULL )
+    {
+        pSizeObjectBound->cx = Round((double)sizeObjectBound.cx / dRatio);
+        pSizeObjectBound->cy = Round((double)sizeObjectBound.cy / dRatio);
+    }
+    if ( pdRatio != NULL )
+    {
+        *pdRatio = dRatio;
+    }
+
+    const SIZE sizeObject = { Round((double)sizeObjectOriginal.cx / dRatio),
+                              Round((double)sizeObjectOriginal.cy / dRatio) };
+    return sizeObject;
+}
+
+// CPositionGenerator::GetBoundingRect
+
+RECT CPositionGenerator::GetBoundingRect(
+                    const SIZE& sizeObject,
+                    const double& dAngleDeg
+                    ) throw()
+{
+    const double dSine = sin( DegToRad(dAngleDeg) );
+    const double dCosine = cos( DegToRad(dAngleDeg) );
+
+    // x' = x * eM11 + y * eM21 + eDx
+    // y' = x * eM12 + y * eM22 + eDy
+    // eM11 = cosine, eM21 = -sine, eM12 = sine, eM22 = cosine
+
+    const double x[2] = { 0, (double)sizeObject.cx };
+    const double y[2] = { 0, (double)sizeObject.cy };
+
+    INT xMin = INT_MAX, yMin = xMin,
+        xMax = INT_MIN, yMax = xMax;
+    for ( INT ix = 0; ix < 2; ++ix )
+    {
+        for ( INT iy = 0; iy < 2; ++iy )
+        {
+            INT xt = Round( x[ix] * dCosine - y[iy] * dSine );
+            INT yt = Round( x[ix] * dSine + y[iy] * dCosine );
+            if ( xMin > xt ) xMin = xt;
+            if ( xMax < xt ) xMax = xt;
+            if ( yMin > yt ) yMin = yt;
+            if ( yMax < yt ) yMax = yt;
+        }
+    }
+
+    const RECT rectBound = { xMin, yMin, xMax, yMax };
+
+    return rectBound;
+}
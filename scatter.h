@@ -0,0 +1,136 @@
+#pragma once
+
+#include "aatypes.h"
+#include "advbitmap.h"
+#include "surface.h"
+
+#include <list>
+#include <memory>
+
+//
+// Portable scatter rendering, it needs no GDI and runs headless.
+// Images are CSurface, colors are COLORREF.
+//
+
+//
+// CSurfaceHelper static class
+//
+
+class CSurfaceHelper
+{
+public:
+    // Size of image scaled to fit sizeMax with frame, frame is not included
+    static SIZE GetScaledSize(
+            const SIZE& sizeImage,
+            UINT nFrameThick,
+            const SIZE& sizeMax
+            ) throw();
+
+    // Thin outer frame color
+    static COLORREF GetFrameBorderColor(COLORREF clrFrame) throw();
+
+    static std::auto_ptr<CSurface> ScaleAndFrameSurface(
+            const CSurface& image,
+            UINT nFrameThick,
+            const SIZE& sizeMax,
+            COLORREF clrFrame = RGB(245, 245, 245)
+            ); // exception
+
+    static std::auto_ptr<CSurface> CreateSolidSurface(
+            UINT nWidth,
+            UINT nHeight,
+            COLORREF clrBackground = RGB(0, 0, 0)
+            ); // exception
+};
+
+//
+// CSurfaceScatter class
+//
+
+class CSurfaceScatter
+{
+public:
+    CSurfaceScatter();
+    ~CSurfaceScatter();
+
+    void Clear() throw();
+    void AddImage(std::auto_ptr<CSurface>& pImage); // exception
+    bool AddImage(const char* szImage); // exception, false if image is not read
+
+    std::auto_ptr<CSurface> Generate(
+            UINT nWidth,
+            UINT nHeight,
+            const double& dMaxAngleDeg,
+            UINT nMaxOffset,
+            UINT nFrameThick,
+            COLORREF clrFrame = RGB(245, 245, 245),
+            COLORREF clrBackground = RGB(255, 255, 255)
+            ) const; // exception
+
+    static void DrawScatterImage(
+            CSurface* pDstSurface,
+            const RECT& rect,
+            const CSurface& image,
+            const double& dMaxAngleDeg,
+            UINT nMaxOffset,
+            UINT nFrameThick,
+            COLORREF clrFrame
+            ); // exception
+
+    static void DrawImage(
+            const BITMAP* pDstBitmap,
+            const BITMAP* pSrcBitmap,
+            const POINT& pt,
+            const double& dAngleDeg,
+            AAMIPMAP* pMipmap = NULL // mipmap cache of pSrcBitmap, built on demand
+            ) throw();
+
+    // Same as DrawImage of ScaleAndFrameSurface result without framed surface.
+    // Source is scaled and rotated in one pass, downscaled source is resampled
+    // to scaled size first. Frame is drawn procedurally around it.
+    static void DrawFramedImage(
+            const BITMAP* pDstBitmap,
+            const BITMAP* pSrcBitmap,
+            const POINT& pt,                // left/top of framed image
+            const double& dAngleDeg,
+            const SIZE& sizeScaled,         // scaled source size, see GetScaledSize
+            UINT nFrameThick,
+            COLORREF clrFrame
+            ); // exception
+
+private:
+    typedef std::list<CSurface*> _SurfaceList;
+    _SurfaceList m_imageList;
+};
+
+//
+// CPositionGenerator static class
+//
+
+class CPositionGenerator
+{
+public:
+    static void Generate(
+            const SIZE& sizeView,
+            const SIZE& sizeObjectOriginal,
+            const double& dMaxAngleDeg,
+            const UINT nMaxDeviation,
+            POINT* pptLeftTop,
+            double* pdAngleDeg,
+            SIZE* pSizeObject,
+            double* pdRatio = NULL
+            ) throw();
+
+    static SIZE GetObjectSize(
+            const SIZE& sizeView,
+            const SIZE& sizeObjectOriginal,
+            const double& dAngleDeg,
+            double* pdRatio = NULL,
+            SIZE* psizeObjectBound = NULL
+            ) throw();
+
+    static RECT GetBoundingRect(
+            const SIZE& sizeObject,
+            const double& dAngleDeg
+            ) throw();
+};
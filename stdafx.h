@@ -21,6 +21,7 @@
 #include <windows.h>
 
 #include <objbase.h>
+#include <shlobj.h>
 
 #include <stdlib.h>
 #include <malloc.h>
@@ -30,8 +31,17 @@
 #include <gdiplus.h>
 #pragma comment(lib, "gdiplus.lib")
 
+#include <wincodec.h>
+#pragma comment(lib, "windowscodecs.lib")
+
+#include <mmsystem.h>
+#pragma comment(lib, "winmm.lib")
+
 #include <string>
 #include <list>
+#include <vector>
+#include <map>
+#include <algorithm>
 #include <memory>
 
 using namespace std;
@@ -0,0 +1,106 @@
+#include "surface.h"
+#include <string.h>
+
+//
+// CSurface class
+//
+
+CSurface::CSurface() throw()
+    : m_pBits(NULL)
+{
+    memset(&m_bmp, 0, sizeof(m_bmp));
+}
+
+CSurface::CSurface(UINT nWidth, UINT nHeight) // exception
+    : m_pBits(NULL)
+{
+    memset(&m_bmp, 0, sizeof(m_bmp));
+    Create(nWidth, nHeight); // exception
+}
+
+CSurface::~CSurface() throw()
+{
+    Destroy();
+}
+
+// CSurface::Create
+
+void CSurface::Create(UINT nWidth, UINT nHeight) // exception
+{
+    Destroy();
+
+    const size_t nSize = (size_t)nWidth * nHeight * 4;
+    m_pBits = new BYTE[nSize > 0 ? nSize : 1]; // exception
+    memset(m_pBits, 0, nSize);
+
+    m_bmp.bmType = 0;
+    m_bmp.bmWidth = (LONG)nWidth;
+    m_bmp.bmHeight = (LONG)nHeight;
+    m_bmp.bmWidthBytes = (LONG)nWidth * 4;
+    m_bmp.bmPlanes = 1;
+    m_bmp.bmBitsPixel = 32;
+    m_bmp.bmBits = m_pBits;
+}
+
+// CSurface::Attach
+
+void CSurface::Attach(const BITMAP& bmp) throw()
+{
+    ASSERT(bmp.bmBitsPixel == 32);
+    ASSERT(bmp.bmBits != NULL);
+
+    Destroy();
+    m_bmp = bmp;
+}
+
+// CSurface::Destroy
+
+void CSurface::Destroy() throw()
+{
+    delete[] m_pBits;
+    m_pBits = NULL;
+    memset(&m_bmp, 0, sizeof(m_bmp));
+}
+
+// CSurface::Swap
+
+void CSurface::Swap(CSurface& other) throw()
+{
+    const BITMAP bmp = m_bmp;
+    m_bmp = other.m_bmp;
+    other.m_bmp = bmp;
+
+    BYTE* pBits = m_pBits;
+    m_pBits = other.m_pBits;
+    other.m_pBits = pBits;
+}
+
+// CSurface::Fill
+
+void CSurface::Fill(COLORREF clr) throw()
+{
+    const RECT rect = { 0, 0, m_bmp.bmWidth, m_bmp.bmHeight };
+    FillRect(rect, clr);
+}
+
+void CSurface::FillRect(const RECT& rect, COLORREF clr) throw()
+{
+    // clip by surface
+    const LONG nLeft = (rect.left > 0) ? rect.left : 0;
+    const LONG nTop = (rect.top > 0) ? rect.top : 0;
+    const LONG nRight = (rect.right < m_bmp.bmWidth) ? rect.right : m_bmp.bmWidth;
+    const LONG nBottom = (rect.bottom < m_bmp.bmHeight) ? rect.bottom : m_bmp.bmHeight;
+    if ( nLeft >= nRight || nTop >= nBottom )
+        return;
+
+    // BGRX pixel of opaque color
+    const DWORD dwPixel =
+        (DWORD)GetBValue(clr) | ((DWORD)GetGValue(clr) << 8) | ((DWORD)GetRValue(clr) << 16) | 0xFF000000;
+
+    for ( LONG y = nTop; y < nBottom; ++y )
+    {
+        BYTE* pRow = GetRow((UINT)y) + nLeft * 4;
+        for ( LONG x = nLeft; x < nRight; ++x, pRow += 4 )
+            memcpy(pRow, &dwPixel, 4);
+    }
+}
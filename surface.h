@@ -0,0 +1,49 @@
+#pragma once
+
+#include "aatypes.h"
+
+//
+// CSurface class
+// 32bpp top-down pixel buffer, portable replacement of GDI bitmaps.
+// Pixels are BGRX (RGB32), so surface goes to AATransformBlt as is.
+//
+
+class CSurface
+{
+public:
+    CSurface() throw();
+    CSurface(UINT nWidth, UINT nHeight); // exception
+    ~CSurface() throw();
+
+    void Create(UINT nWidth, UINT nHeight); // exception
+    void Attach(const BITMAP& bmp) throw(); // pixels are not owned
+    void Destroy() throw();
+    void Swap(CSurface& other) throw();
+
+    bool IsEmpty() const throw() { return m_bmp.bmBits == NULL; }
+    UINT GetWidth() const throw() { return (UINT)m_bmp.bmWidth; }
+    UINT GetHeight() const throw() { return (UINT)m_bmp.bmHeight; }
+    LONG GetStride() const throw() { return m_bmp.bmWidthBytes; }
+    const BITMAP* GetBitmap() const throw() { return &m_bmp; }
+
+    BYTE* GetRow(UINT y) throw()
+    {
+        ASSERT(y < GetHeight());
+        return (BYTE*)m_bmp.bmBits + (size_t)y * m_bmp.bmWidthBytes;
+    }
+    const BYTE* GetRow(UINT y) const throw()
+    {
+        ASSERT(y < GetHeight());
+        return (const BYTE*)m_bmp.bmBits + (size_t)y * m_bmp.bmWidthBytes;
+    }
+
+    void Fill(COLORREF clr) throw();
+    void FillRect(const RECT& rect, COLORREF clr) throw();
+
+private:
+    CSurface(const CSurface&);
+    CSurface& operator=(const CSurface&);
+
+    BITMAP m_bmp;
+    BYTE* m_pBits; // own pixels, NULL for attached bitmap
+};